@@ -4,6 +4,7 @@
 #include <string>
 #include <stdint.h>
 #include <vector>
+#include "../include/playback_stats.h"
 
 typedef enum {
 	PLAYMODE_TS = 0,
@@ -41,6 +42,7 @@ class cPlayback
 		bool SetSpeed(int speed);
 		bool GetSpeed(int &speed) const;
 		bool GetPosition(int &position, int &duration);	/* pos: current time in ms, dur: file length in ms */
+		bool GetStatistics(playback_stats_t &stats);
 		bool SetPosition(int position, bool absolute = false);	/* position: jump in ms */
 		void FindAllPids(uint16_t *apids, unsigned short *ac3flags, uint16_t *numpida, std::string *language);
 		void FindAllSubs(uint16_t *pids, unsigned short *supported, uint16_t *numpida, std::string *language);
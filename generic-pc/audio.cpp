@@ -24,6 +24,10 @@
 
 #include "audio_lib.h"
 #include "dmx_lib.h"
+#include "ringbuffer.h"
+#include "audio_out.h"
+#include "framestats.h"
+#include "faststart.h"
 #include "lt_debug.h"
 
 #define lt_debug(args...) _lt_debug(HAL_DEBUG_AUDIO, this, args)
@@ -35,24 +39,22 @@ extern "C" {
 #include <libavutil/opt.h>
 #include <libavutil/samplefmt.h>
 #include <libswresample/swresample.h>
-#include <ao/ao.h>
 }
 /* ffmpeg buf 2k */
 #define INBUF_SIZE 0x0800
-/* my own buf 16k */
+/* demux ring buffer 16k */
 #define DMX_BUF_SZ 0x4000
 
 cAudio * audioDecoder = NULL;
 extern cDemux *audioDemux;
-static uint8_t *dmxbuf = NULL;
-static int bufpos;
+static DmxRingBuffer *dmxbuf = NULL;
 
 extern bool HAL_nodec;
 
-static cAudio *gThiz = NULL;
-
-static ao_device *adevice = NULL;
-static ao_sample_format sformat;
+/* libao device, fed by its own thread */
+static AudioOutput *aout = NULL;
+/* PrepareClipPlay / WriteClip source, mixed over the live audio */
+static AudioSource *clip = NULL;
 
 static AVCodecContext *c = NULL;
 static AVCodecParameters *p = NULL;
@@ -61,23 +63,45 @@ cAudio::cAudio(void *, void *, void *)
 {
 	thread_started = false;
 	if (!HAL_nodec)
-		dmxbuf = (uint8_t *)malloc(DMX_BUF_SZ);
-	bufpos = 0;
+		dmxbuf = new DmxRingBuffer(DMX_BUF_SZ);
 	curr_pts = 0;
-	gThiz = this;
+	StreamType = AUDIO_FMT_AUTO;
+	volume = 100;
+	Muted = false;
 	ao_initialize();
+	aout = new AudioOutput();
 }
 
 cAudio::~cAudio(void)
 {
 	closeDevice();
-	free(dmxbuf);
-	if (adevice)
-		ao_close(adevice);
-	adevice = NULL;
+	delete dmxbuf;
+	dmxbuf = NULL;
+	clip = NULL; /* owned by aout */
+	delete aout; /* closes the device */
+	aout = NULL;
 	ao_shutdown();
 }
 
+int64_t cAudio::getPts(void)
+{
+	/* the pts of what is audible now, not of what was decoded last */
+	int64_t pts = aout->getPts();
+	if (pts == AV_NOPTS_VALUE)
+		return curr_pts;
+	return pts;
+}
+
+void cAudio::setLatency(int ms)
+{
+	aout->setLatency(ms);
+}
+
+unsigned int cAudio::getUnderruns(void)
+{
+	return aout->getUnderruns();
+}
+
 void cAudio::openDevice(void)
 {
 	lt_debug("%s\n", __func__);
@@ -91,20 +115,46 @@ void cAudio::closeDevice(void)
 int cAudio::do_mute(bool enable, bool remember)
 {
 	lt_debug("%s(%d, %d)\n", __func__, enable, remember);
+	if (remember)
+		Muted = enable;
+	aout->setMute(enable);
 	return 0;
 }
 
 int cAudio::setVolume(unsigned int left, unsigned int right)
 {
 	lt_debug("%s(%d, %d)\n", __func__, left, right);
+	volume = (left + right) / 2;
+	aout->setVolume(left, right);
 	return 0;
 }
 
+/* for the zap time log */
+static int64_t zap_start = 0;
+
+static enum AVCodecID codec_from_format(AUDIO_FORMAT f)
+{
+	switch (f) {
+		case AUDIO_FMT_MPEG:
+		case AUDIO_FMT_MPG1:		return AV_CODEC_ID_MP2;
+		case AUDIO_FMT_MP3:		return AV_CODEC_ID_MP3;
+		case AUDIO_FMT_DOLBY_DIGITAL:	return AV_CODEC_ID_AC3;
+		case AUDIO_FMT_AAC:		return AV_CODEC_ID_AAC;
+		case AUDIO_FMT_AAC_PLUS:	return AV_CODEC_ID_AAC_LATM;
+		case AUDIO_FMT_DD_PLUS:		return AV_CODEC_ID_EAC3;
+		case AUDIO_FMT_DTS:		return AV_CODEC_ID_DTS;
+		default:			return AV_CODEC_ID_NONE;
+	}
+}
+
 int cAudio::Start(void)
 {
 	lt_debug("%s >\n", __func__);
-	if (! HAL_nodec)
+	if (! HAL_nodec) {
+		zap_start = hal_time_us();
+		dmxbuf->startFiller(audioDemux);
 		Thread::startThread();
+	}
 	lt_debug("%s <\n", __func__);
 	return 0;
 }
@@ -112,10 +162,14 @@ int cAudio::Start(void)
 int cAudio::Stop(void)
 {
 	lt_debug("%s >\n", __func__);
+	if (dmxbuf)
+		dmxbuf->stopFiller(); /* wakes up the decoder if it waits for data */
 	if (thread_started)
 	{
 		thread_started = false;
+		aout->flush(); /* unblock the decoder if the PCM ring is full */
 		Thread::joinThread();
+		aout->flush();
 	}
 	lt_debug("%s <\n", __func__);
 	return 0;
@@ -134,6 +188,7 @@ void cAudio::SetSyncMode(AVSYNC_TYPE Mode)
 void cAudio::SetStreamType(AUDIO_FORMAT type)
 {
 	lt_debug("%s %d\n", __func__, type);
+	StreamType = type; /* codec hint for the next Start() */
 };
 
 int cAudio::setChannel(int /*channel*/)
@@ -143,54 +198,35 @@ int cAudio::setChannel(int /*channel*/)
 
 int cAudio::PrepareClipPlay(int ch, int srate, int bits, int le)
 {
-	lt_debug("%s ch %d srate %d bits %d le %d adevice %p\n", __func__, ch, srate, bits, le, adevice);;
-	int driver;
-	int byte_format = le ? AO_FMT_LITTLE : AO_FMT_BIG;
-	if (sformat.bits != bits || sformat.channels != ch || sformat.rate != srate ||
-	    sformat.byte_format != byte_format || adevice == NULL)
-	{
-		driver = ao_default_driver_id();
-		sformat.bits = bits;
-		sformat.channels = ch;
-		sformat.rate = srate;
-		sformat.byte_format = byte_format;
-		sformat.matrix = 0;
-		if (adevice)
-			ao_close(adevice);
-		adevice = ao_open_live(driver, &sformat, NULL);
-		ao_info *ai = ao_driver_info(driver);
-		lt_info("%s: changed params ch %d srate %d bits %d le %d adevice %p\n",
-			__func__, ch, srate, bits, le, adevice);;
-		lt_info("libao driver: %d name '%s' short '%s' author '%s'\n",
-				driver, ai->name, ai->short_name, ai->author);
+	lt_debug("%s ch %d srate %d bits %d le %d\n", __func__, ch, srate, bits, le);
+	int fmt = le ? AO_FMT_LITTLE : AO_FMT_BIG;
+	/* the clip is mixed over the live audio, the device is not touched */
+	if (clip && !clip->sameFormat(bits, ch, srate, fmt)) {
+		aout->closeSource(clip);
+		clip = NULL;
 	}
-	return 0;
+	if (!clip)
+		clip = aout->openSource(bits, ch, srate, fmt);
+	return clip ? 0 : -1;
 };
 
 int cAudio::WriteClip(unsigned char *buffer, int size)
 {
 	lt_debug("cAudio::%s buf 0x%p size %d\n", __func__, buffer, size);
-	if (!adevice) {
-		lt_info("%s: adevice not opened?\n", __func__);
+	if (!clip) {
+		lt_info("%s: clip not prepared?\n", __func__);
 		return 0;
 	}
-	ao_play(adevice, (char *)buffer, size);
-	return size;
+	return aout->writeSource(clip, buffer, size);
 };
 
 int cAudio::StopClip()
 {
 	lt_debug("%s\n", __func__);
-#if 0
-	/* don't do anything - closing / reopening ao all the time makes for long delays
-	 * reinit on-demand (e.g. for changed parameters) instead */
-	if (!adevice) {
-		lt_info("%s: adevice not opened?\n", __func__);
-		return 0;
-	}
-	ao_close(adevice);
-	adevice = NULL;
-#endif
+	/* what is queued still plays out */
+	if (clip)
+		aout->closeSource(clip);
+	clip = NULL;
 	return 0;
 };
 
@@ -273,38 +309,6 @@ void cAudio::setBypassMode(bool disable)
 	lt_debug("%s %d\n", __func__, disable);
 }
 
-static int _my_read(void *, uint8_t *buf, int buf_size)
-{
-	return gThiz->my_read(buf, buf_size);
-}
-
-int cAudio::my_read(uint8_t *buf, int buf_size)
-{
-	int tmp = 0;
-	if (audioDecoder && bufpos < DMX_BUF_SZ - 4096) {
-		while (bufpos < buf_size && ++tmp < 20) { /* retry max 20 times */
-			int ret = audioDemux->Read(dmxbuf + bufpos, DMX_BUF_SZ - bufpos, 10);
-			if (ret > 0)
-				bufpos += ret;
-			if (! thread_started)
-				break;
-		}
-	}
-	if (bufpos == 0)
-		return 0;
-	//lt_info("%s buf_size %d bufpos %d th %d tmp %d\n", __func__, buf_size, bufpos, thread_started, tmp);
-	if (bufpos > buf_size) {
-		memcpy(buf, dmxbuf, buf_size);
-		memmove(dmxbuf, dmxbuf + buf_size, bufpos - buf_size);
-		bufpos -= buf_size;
-		return buf_size;
-	}
-	memcpy(buf, dmxbuf, bufpos);
-	tmp = bufpos;
-	bufpos = 0;
-	return tmp;
-}
-
 void cAudio::run()
 {
 	lt_info("====================== start decoder thread ================================\n");
@@ -317,11 +321,7 @@ void cAudio::run()
 	AVFrame *frame;
 	uint8_t *inbuf = (uint8_t *)av_malloc(INBUF_SIZE);
 	AVPacket avpkt;
-	int ret, driver;
-	/* libao */
-	ao_info *ai;
-	// ao_device *adevice;
-	// ao_sample_format sformat;
+	int ret;
 	/* resample */
 	SwrContext *swr = NULL;
 	uint8_t *obuf = NULL;
@@ -330,28 +330,56 @@ void cAudio::run()
 	int o_ch, o_sr; /* output channels and sample rate */
 	uint64_t o_layout; /* output channels layout */
 	char tmp[64] = "unknown";
+	const char *env = getenv("HAL_AUDIO_DOWNMIX");
+	bool downmix = env && atoi(env); /* let swresample mix 5.1 down to stereo */
+
+	/* fast start, see cVideo::run() */
+	bool fast = faststart_enabled();
+	int key = faststart_key(audioDemux ? audioDemux->getPesPid() : -1);
+	enum AVCodecID id = fast ? codec_from_format(StreamType) : AV_CODEC_ID_NONE;
+	AVCodecParameters *cached = avcodec_parameters_alloc();
+	bool have_cached = fast && cached && faststart_lookup(key, id, cached);
+	bool first = true;
+	/* resampler input, taken from the decoded frames */
+	int i_fmt = -1, i_sr = 0;
+	uint64_t i_layout = 0;
+	if (have_cached && id == AV_CODEC_ID_NONE)
+		id = cached->codec_id;
 
 	curr_pts = 0;
 	av_init_packet(&avpkt);
 	inp = av_find_input_format("mpegts");
 	AVIOContext *pIOCtx = avio_alloc_context(inbuf, INBUF_SIZE, // internal Buffer and its size
 			0,		// bWriteable (1=true,0=false)
-			NULL,		// user data; will be passed to our callback functions
-			_my_read,	// read callback
+			dmxbuf,		// user data; will be passed to our callback functions
+			DmxRingBuffer::avio_read,	// read callback
 			NULL,		// write callback
 			NULL);		// seek callback
 	avfc = avformat_alloc_context();
 	avfc->pb = pIOCtx;
 	avfc->iformat = inp;
 	avfc->probesize = 188*5;
+	if (fast)
+		faststart_setup(avfc);
 	thread_started = true;
 
 	if (avformat_open_input(&avfc, NULL, inp, NULL) < 0) {
 		lt_info("%s: avformat_open_input() failed.\n", __func__);
 		goto out;
 	}
-	ret = avformat_find_stream_info(avfc, NULL);
-	lt_debug("%s: avformat_find_stream_info: %d\n", __func__, ret);
+	if (id == AV_CODEC_ID_NONE) {
+		/* unknown codec, let libavformat find out. Can take a while */
+		ret = avformat_find_stream_info(avfc, NULL);
+		lt_debug("%s: avformat_find_stream_info: %d\n", __func__, ret);
+	} else {
+		/* the rest of the parameters comes with the first decoded frame */
+		while (avfc->nb_streams < 1 && thread_started) {
+			lt_info("%s: nb_streams %d, should be 1 => retry\n", __func__, avfc->nb_streams);
+			if (av_read_frame(avfc, &avpkt) < 0)
+				lt_info("%s: av_read_frame < 0\n", __func__);
+			av_packet_unref(&avpkt);
+		}
+	}
 	if (avfc->nb_streams != 1)
 	{
 		lt_info("%s: nb_streams: %d, should be 1!\n", __func__, avfc->nb_streams);
@@ -361,14 +389,23 @@ void cAudio::run()
 	if (p->codec_type != AVMEDIA_TYPE_AUDIO)
 		lt_info("%s: stream 0 no audio codec? 0x%x\n", __func__, p->codec_type);
 
-	codec = avcodec_find_decoder(p->codec_id);
+	if (id == AV_CODEC_ID_NONE)
+		id = p->codec_id;
+	else if (id != p->codec_id && p->codec_id != AV_CODEC_ID_NONE) {
+		/* the stream type from zapit was wrong, trust the demuxer */
+		lt_info("%s: hint %s ignored, probed %s\n", __func__, avcodec_get_name(id), avcodec_get_name(p->codec_id));
+		id = p->codec_id;
+	}
+	codec = avcodec_find_decoder(id);
 	if (!codec) {
-		lt_info("%s: Codec for %s not found\n", __func__, avcodec_get_name(p->codec_id));
+		lt_info("%s: Codec for %s not found\n", __func__, avcodec_get_name(id));
 		goto out;
 	}
 	if (c)
 		av_free(c);
 	c = avcodec_alloc_context3(codec);
+	if (have_cached && cached->codec_id == codec->id)
+		avcodec_parameters_to_context(c, cached);
 	if (avcodec_open2(c, codec, NULL) < 0) {
 		lt_info("%s: avcodec_open2() failed\n", __func__);
 		goto out;
@@ -378,47 +415,6 @@ void cAudio::run()
 		lt_info("%s: av_frame_alloc failed\n", __func__);
 		goto out2;
 	}
-	/* output sample rate, channels, layout could be set here if necessary */
-	o_ch = p->channels;		/* 2 */
-	o_sr = p->sample_rate;		/* 48000 */
-	o_layout = p->channel_layout;	/* AV_CH_LAYOUT_STEREO */
-	if (sformat.channels != o_ch || sformat.rate != o_sr ||
-	    sformat.byte_format != AO_FMT_NATIVE || sformat.bits != 16 || adevice == NULL)
-	{
-		driver = ao_default_driver_id();
-		sformat.bits = 16;
-		sformat.channels = o_ch;
-		sformat.rate = o_sr;
-		sformat.byte_format = AO_FMT_NATIVE;
-		sformat.matrix = 0;
-		if (adevice)
-			ao_close(adevice);
-		adevice = ao_open_live(driver, &sformat, NULL);
-		ai = ao_driver_info(driver);
-		lt_info("%s: changed params ch %d srate %d bits %d adevice %p\n",
-			__func__, o_ch, o_sr, 16, adevice);
-		if(ai)
-			lt_info("libao driver: %d name '%s' short '%s' author '%s'\n",
-				driver, ai->name, ai->short_name, ai->author);
-	}
-#if 0
-	lt_info(" driver options:");
-	for (int i = 0; i < ai->option_count; ++i)
-		fprintf(stderr, " %s", ai->options[i]);
-	fprintf(stderr, "\n");
-#endif
-	av_get_sample_fmt_string(tmp, sizeof(tmp), c->sample_fmt);
-	lt_info("decoding %s, sample_fmt %d (%s) sample_rate %d channels %d\n",
-		 avcodec_get_name(p->codec_id), c->sample_fmt, tmp, p->sample_rate, p->channels);
-	swr = swr_alloc_set_opts(swr,
-				 o_layout, AV_SAMPLE_FMT_S16, o_sr,			/* output */
-				 p->channel_layout, c->sample_fmt, p->sample_rate,	/* input */
-				 0, NULL);
-	if (! swr) {
-		lt_info("could not alloc resample context\n");
-		goto out3;
-	}
-	swr_init(swr);
 	while (thread_started) {
 		int gotframe = 0;
 		if (av_read_frame(avfc, &avpkt) < 0)
@@ -426,13 +422,55 @@ void cAudio::run()
 		avcodec_decode_audio4(c, frame, &gotframe, &avpkt);
 		if (gotframe && thread_started) {
 			int out_linesize;
-			obuf_sz = av_rescale_rnd(swr_get_delay(swr, p->sample_rate) +
-						 frame->nb_samples, o_sr, p->sample_rate, AV_ROUND_UP);
+			uint64_t layout = frame->channel_layout;
+			if (!layout)
+				layout = av_get_default_channel_layout(frame->channels);
+			if (frame->format != i_fmt || frame->sample_rate != i_sr || layout != i_layout) {
+				/* first frame or format change: set up resampler and device */
+				i_fmt = frame->format;
+				i_sr = frame->sample_rate;
+				i_layout = layout;
+				/* output sample rate, channels, layout could be set here if necessary */
+				o_ch = frame->channels;
+				o_sr = i_sr;
+				o_layout = i_layout;
+				if (o_ch > 2 && downmix) {
+					o_ch = 2;
+					o_layout = AV_CH_LAYOUT_STEREO;
+				}
+				av_get_sample_fmt_string(tmp, sizeof(tmp), (enum AVSampleFormat)i_fmt);
+				lt_info("decoding %s, sample_fmt %d (%s) sample_rate %d channels %d\n",
+					 avcodec_get_name(id), i_fmt, tmp, i_sr, frame->channels);
+				if (!aout->open(16, o_ch, o_sr)) {
+					lt_info("%s: could not open audio device\n", __func__);
+					av_packet_unref(&avpkt);
+					break;
+				}
+				swr_free(&swr);
+				swr = swr_alloc_set_opts(NULL,
+							 o_layout, AV_SAMPLE_FMT_S16, o_sr,			/* output */
+							 i_layout, (enum AVSampleFormat)i_fmt, i_sr,		/* input */
+							 0, NULL);
+				if (!swr || swr_init(swr) < 0) {
+					lt_info("could not alloc resample context\n");
+					av_packet_unref(&avpkt);
+					break;
+				}
+				obuf_sz_max = 0; /* channel count may have changed */
+				if (first) {
+					first = false;
+					lt_info("%s: first frame after %" PRId64 " ms\n", __func__,
+						(hal_time_us() - zap_start) / 1000);
+					faststart_store(key, c);
+				}
+			}
+			obuf_sz = av_rescale_rnd(swr_get_delay(swr, i_sr) +
+						 frame->nb_samples, o_sr, i_sr, AV_ROUND_UP);
 			if (obuf_sz > obuf_sz_max) {
 				lt_info("obuf_sz: %d old: %d\n", obuf_sz, obuf_sz_max);
-				av_free(obuf);
+				av_freep(&obuf);
 				if (av_samples_alloc(&obuf, &out_linesize, o_ch,
-							frame->nb_samples, AV_SAMPLE_FMT_S16, 1) < 0) {
+							obuf_sz, AV_SAMPLE_FMT_S16, 1) < 0) {
 					lt_info("av_samples_alloc failed\n");
 					av_packet_unref(&avpkt);
 					break; /* while (thread_started) */
@@ -445,14 +483,16 @@ void cAudio::run()
 			lt_debug("%s: pts 0x%" PRIx64 " %3f\n", __func__, curr_pts, curr_pts/90000.0);
 			int o_buf_sz = av_samples_get_buffer_size(&out_linesize, o_ch,
 								  obuf_sz, AV_SAMPLE_FMT_S16, 1);
-			ao_play(adevice, (char *)obuf, o_buf_sz);
+			int64_t pts_end = AV_NOPTS_VALUE;
+			if (curr_pts != AV_NOPTS_VALUE)
+				pts_end = curr_pts + (int64_t)obuf_sz * 90000 / o_sr;
+			aout->write(obuf, o_buf_sz, pts_end); /* blocks while the PCM ring is full */
 		}
 		av_packet_unref(&avpkt);
 	}
 	// ao_close(adevice); /* can take long :-( */
 	av_free(obuf);
 	swr_free(&swr);
- out3:
 	av_frame_free(&frame);
  out2:
 	avcodec_close(c);
@@ -462,5 +502,6 @@ void cAudio::run()
 	avformat_close_input(&avfc);
 	av_free(pIOCtx->buffer);
 	av_free(pIOCtx);
+	avcodec_parameters_free(&cached);
 	lt_info("======================== end decoder thread ================================\n");
 }
@@ -0,0 +1,286 @@
+/*
+ * (C) 2026 libstb-hal contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * software volume / mute / dynamic range compression for interleaved S16.
+ * Gains are Q14 fixed point. While a gain changes it is ramped per sample
+ * frame (scalar code), a constant gain is applied with SSE2 / NEON.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "audio_dsp.h"
+#include "lt_debug.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_NEON 1
+#endif
+
+#define lt_debug(args...) _lt_debug(HAL_DEBUG_AUDIO, this, args)
+#define lt_info(args...) _lt_info(HAL_DEBUG_AUDIO, this, args)
+
+#define UNITY		(1 << 14)
+#define RAMP_MS		10	/* 0 -> unity gain, fast enough for mute, no clicks */
+#define DRC_BLOCK	64	/* frames per DRC gain computation */
+#define DRC_THRESHOLD	0.25f	/* -12 dBFS */
+#define DRC_RATIO	4.0f
+#define DRC_ATTACK_MS	5
+#define DRC_RELEASE_MS	200
+
+static int gcd(int a, int b)
+{
+	while (b) {
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+AudioDSP::AudioDSP()
+{
+	ch = 2;
+	rate = 48000;
+	mute = false;
+	drc = false;
+	drc_env = 0;
+	for (int i = 0; i < DSP_MAX_CH; i++) {
+		vol[i] = UNITY;
+		target[i] = UNITY;
+		cur[i] = UNITY << 8;
+	}
+	ramp_step = (UNITY << 8) / (rate * RAMP_MS / 1000);
+	buildGainTable();
+}
+
+void AudioDSP::setFormat(int channels, int r)
+{
+	m.lock();
+	ch = channels;
+	if (ch > DSP_MAX_CH)
+		ch = DSP_MAX_CH;
+	if (ch < 1)
+		ch = 1;
+	rate = r > 0 ? r : 48000;
+	ramp_step = (UNITY << 8) / (rate * RAMP_MS / 1000);
+	if (ramp_step < 1)
+		ramp_step = 1;
+	for (int i = 0; i < DSP_MAX_CH; i++)
+		cur[i] = target[i] << 8;
+	buildGainTable();
+	m.unlock();
+}
+
+void AudioDSP::setVolume(int left, int right)
+{
+	/* 0..100 => -63..0 dB, like the spark / duckbox mixers, 0 is off */
+	int l = (left > 100) ? 100 : left;
+	int r = (right > 100) ? 100 : right;
+	int gl = l ? (int)(UNITY * powf(10.0f, (l - 100) * 0.63f / 20.0f)) : 0;
+	int gr = r ? (int)(UNITY * powf(10.0f, (r - 100) * 0.63f / 20.0f)) : 0;
+	lt_debug("%s(%d, %d) => %d %d\n", __func__, left, right, gl, gr);
+	m.lock();
+	vol[0] = gl;
+	vol[1] = gr;
+	for (int i = 2; i < DSP_MAX_CH; i++) /* center, surround, LFE */
+		vol[i] = (gl + gr) / 2;
+	m.unlock();
+}
+
+void AudioDSP::setMute(bool enable)
+{
+	m.lock();
+	mute = enable;
+	m.unlock();
+}
+
+void AudioDSP::setDRC(bool enable)
+{
+	m.lock();
+	drc = enable;
+	drc_env = 0;
+	m.unlock();
+}
+
+void AudioDSP::buildGainTable()
+{
+	/* the gain pattern repeats every lcm(ch, 8) samples, that is a whole
+	 * number of 8 sample vectors */
+	gtab_len = ch * 8 / gcd(ch, 8);
+	unity = true;
+	for (int i = 0; i < gtab_len; i++) {
+		int g = cur[i % ch] >> 8;
+		if (g > 0x7fff)
+			g = 0x7fff;
+		gtab[i] = g;
+		if (g != UNITY)
+			unity = false;
+	}
+}
+
+void AudioDSP::updateDRC(const int16_t *buf, int frames)
+{
+	int n = frames * ch;
+	int peak = 0;
+	int i = 0;
+#if defined(__SSE2__)
+	__m128i vmax = _mm_setzero_si128();
+	for (; i + 8 <= n; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(buf + i));
+		/* |s| = max(s, -s), saturating so -32768 does not wrap */
+		s = _mm_max_epi16(s, _mm_subs_epi16(_mm_setzero_si128(), s));
+		vmax = _mm_max_epi16(vmax, s);
+	}
+	int16_t tmp[8] __attribute__((aligned(16)));
+	_mm_store_si128((__m128i *)tmp, vmax);
+	for (int j = 0; j < 8; j++)
+		peak = std::max(peak, (int)tmp[j]);
+#elif HAVE_NEON
+	int16x8_t vmax = vdupq_n_s16(0);
+	for (; i + 8 <= n; i += 8)
+		vmax = vmaxq_s16(vmax, vqabsq_s16(vld1q_s16(buf + i)));
+	int16_t tmp[8];
+	vst1q_s16(tmp, vmax);
+	for (int j = 0; j < 8; j++)
+		peak = std::max(peak, (int)tmp[j]);
+#endif
+	for (; i < n; i++)
+		peak = std::max(peak, abs(buf[i]));
+
+	float p = peak / 32768.0f;
+	float ms = frames * 1000.0f / rate;
+	float coeff = expf(-ms / (p > drc_env ? DRC_ATTACK_MS : DRC_RELEASE_MS));
+	drc_env = p + coeff * (drc_env - p);
+}
+
+/* scalar path, gains slew towards their target by at most ramp_step per frame */
+void AudioDSP::ramp(int16_t *buf, int frames)
+{
+	for (int f = 0; f < frames; f++) {
+		for (int c = 0; c < ch; c++) {
+			int t = target[c] << 8;
+			if (cur[c] < t)
+				cur[c] = std::min(cur[c] + ramp_step, t);
+			else if (cur[c] > t)
+				cur[c] = std::max(cur[c] - ramp_step, t);
+			int v = (*buf * (cur[c] >> 8)) >> 14;
+			if (v > 32767)
+				v = 32767;
+			else if (v < -32768)
+				v = -32768;
+			*buf++ = v;
+		}
+	}
+}
+
+void AudioDSP::process(int16_t *buf, int frames)
+{
+	m.lock();
+	while (frames > 0) {
+		int len = std::min(frames, DRC_BLOCK);
+		int drc_gain = UNITY;
+		if (drc) {
+			updateDRC(buf, len);
+			if (drc_env > DRC_THRESHOLD) {
+				/* above the threshold, the level rises only 1/DRC_RATIO */
+				float out = DRC_THRESHOLD * powf(drc_env / DRC_THRESHOLD, 1.0f / DRC_RATIO);
+				drc_gain = (int)(UNITY * out / drc_env);
+			}
+		}
+		bool steady = true;
+		for (int c = 0; c < ch; c++) {
+			target[c] = mute ? 0 : (vol[c] * drc_gain) >> 14;
+			if (cur[c] != target[c] << 8)
+				steady = false;
+		}
+		if (!steady) {
+			ramp(buf, len);
+			buildGainTable();
+		} else if (!unity) {
+			/* constant gain, gtab is aligned with buf as every block starts
+			 * on a sample frame and gtab_len is a multiple of ch */
+			int n = len * ch;
+			int i = 0;
+			int g = 0;
+#if defined(__SSE2__)
+			for (; i + 8 <= n; i += 8) {
+				__m128i s = _mm_loadu_si128((__m128i *)(buf + i));
+				__m128i gv = _mm_load_si128((const __m128i *)(gtab + g));
+				__m128i lo = _mm_mullo_epi16(s, gv);
+				__m128i hi = _mm_mulhi_epi16(s, gv);
+				__m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 14);
+				__m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 14);
+				_mm_storeu_si128((__m128i *)(buf + i), _mm_packs_epi32(p0, p1));
+				g += 8;
+				if (g == gtab_len)
+					g = 0;
+			}
+#elif HAVE_NEON
+			for (; i + 8 <= n; i += 8) {
+				int16x8_t s = vld1q_s16(buf + i);
+				int16x8_t gv = vld1q_s16(gtab + g);
+				int32x4_t p0 = vmull_s16(vget_low_s16(s), vget_low_s16(gv));
+				int32x4_t p1 = vmull_s16(vget_high_s16(s), vget_high_s16(gv));
+				vst1q_s16(buf + i, vcombine_s16(vqshrn_n_s32(p0, 14), vqshrn_n_s32(p1, 14)));
+				g += 8;
+				if (g == gtab_len)
+					g = 0;
+			}
+#endif
+			for (; i < n; i++) {
+				int v = (buf[i] * gtab[g]) >> 14;
+				if (v > 32767)
+					v = 32767;
+				else if (v < -32768)
+					v = -32768;
+				buf[i] = v;
+				if (++g == gtab_len)
+					g = 0;
+			}
+		}
+		buf += len * ch;
+		frames -= len;
+	}
+	m.unlock();
+}
+
+void AudioDSP::mix(int16_t *dst, const int16_t *src, size_t samples)
+{
+	size_t i = 0;
+#if defined(__SSE2__)
+	for (; i + 8 <= samples; i += 8) {
+		__m128i d = _mm_loadu_si128((__m128i *)(dst + i));
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_adds_epi16(d, s));
+	}
+#elif HAVE_NEON
+	for (; i + 8 <= samples; i += 8)
+		vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+#endif
+	for (; i < samples; i++) {
+		int v = dst[i] + src[i];
+		if (v > 32767)
+			v = 32767;
+		else if (v < -32768)
+			v = -32768;
+		dst[i] = v;
+	}
+}
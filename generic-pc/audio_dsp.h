@@ -0,0 +1,61 @@
+/*
+ * (C) 2026 libstb-hal contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * software volume / mute / dynamic range compression for interleaved S16
+ */
+
+#ifndef __AUDIO_DSP_H
+#define __AUDIO_DSP_H
+
+#include <stdint.h>
+#include <mutex_abstraction.h>
+
+#define DSP_MAX_CH 8
+
+class AudioDSP
+{
+public:
+	AudioDSP();
+	void setFormat(int channels, int rate);
+	void setVolume(int left, int right);	/* 0..100, like the hardware mixers */
+	void setMute(bool enable);
+	void setDRC(bool enable);
+	/* in place, native endian S16, frames = samples per channel */
+	void process(int16_t *buf, int frames);
+	/* dst += src, saturating */
+	static void mix(int16_t *dst, const int16_t *src, size_t samples);
+private:
+	void updateDRC(const int16_t *buf, int frames);
+	void ramp(int16_t *buf, int frames);
+	void buildGainTable();
+
+	Mutex m;
+	int ch;
+	int rate;
+	int vol[DSP_MAX_CH];		/* volume gains, Q14 */
+	bool mute;
+	bool drc;
+	float drc_env;			/* peak envelope, 0..1 */
+	int target[DSP_MAX_CH];		/* vol * mute * drc, Q14 */
+	int cur[DSP_MAX_CH];		/* current gain, Q14 << 8 for smooth ramps */
+	int ramp_step;			/* max. gain change per frame, Q14 << 8 */
+	/* constant gains, interleaved like the samples, lcm(ch, 8) entries */
+	int16_t gtab[8 * DSP_MAX_CH] __attribute__((aligned(16)));
+	int gtab_len;
+	bool unity;			/* all gains 1.0, nothing to do */
+};
+
+#endif
@@ -67,7 +67,10 @@ class cAudio : public Thread
 		/* construct & destruct */
 		cAudio(void *, void *, void *);
 		~cAudio(void);
-		int64_t getPts() { return curr_pts; }
+		int64_t getPts(void);
+		/* PCM queued in front of the sound device, in ms */
+		void setLatency(int ms);
+		unsigned int getUnderruns(void);
 
 		void *GetHandle() { return NULL; };
 		/* shut up */
@@ -98,7 +101,6 @@ class cAudio : public Thread
 		void SetSpdifDD(bool enable);
 		void ScheduleMute(bool On);
 		void EnableAnalogOut(bool enable);
-		int my_read(uint8_t *buf, int buf_size);
 };
 
 #endif
@@ -0,0 +1,495 @@
+/*
+ * (C) 2026 libstb-hal contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * audio output stage: the decoder queues PCM into a ring buffer, a
+ * separate thread feeds libao. The audio clock is derived from what is
+ * still queued plus the latency of the sound system.
+ * Clips and other sources are converted to the device format when they
+ * are written and mixed over the live stream chunk by chunk.
+ */
+
+#include <cstdlib>
+#include <cstring>
+
+#include "audio_out.h"
+#include "lt_debug.h"
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/mathematics.h>
+#include <libswresample/swresample.h>
+}
+
+#define lt_debug(args...) _lt_debug(HAL_DEBUG_AUDIO, this, args)
+#define lt_info(args...) _lt_info(HAL_DEBUG_AUDIO, this, args)
+
+/* PCM queued between decoder and output thread */
+#define LATENCY_MS 100
+/* libao -> pulseaudio -> hardware, was the "18000" A/V sync magic in glfb */
+#define DEV_LATENCY_MS 200
+/* ao_play() chunk size, limits the granularity of the audio clock */
+#define CHUNKS_PER_SEC 50
+/* device format if only sources play */
+#define MIX_CHANNELS 2
+#define MIX_RATE 48000
+/* converted samples queued per source, a multiple of all frame sizes up to 8ch */
+#define SRC_RING_SIZE (192 * 1024)
+
+extern bool HAL_headless;
+
+static bool native_order(int bits, int byte_format)
+{
+	if (bits != 16 || byte_format == AO_FMT_NATIVE)
+		return true;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	return byte_format == AO_FMT_LITTLE;
+#else
+	return byte_format == AO_FMT_BIG;
+#endif
+}
+
+AudioSource::AudioSource(int b, int ch, int r, int bf) : ring(SRC_RING_SIZE)
+{
+	bits = b;
+	channels = ch;
+	rate = r;
+	byte_format = bf;
+	o_channels = o_rate = 0;
+	swr = NULL;
+	gen = 0;
+	eof = false;
+	writers = 0;
+}
+
+AudioSource::~AudioSource()
+{
+	swr_free(&swr);
+}
+
+/* caller holds m */
+bool AudioSource::configure(int och, int orate)
+{
+	o_channels = och;
+	o_rate = orate;
+	gen++;	/* what a writer converted for the old format is dropped */
+	swr_free(&swr);
+	swr = swr_alloc_set_opts(NULL,
+				 av_get_default_channel_layout(och), AV_SAMPLE_FMT_S16, orate,
+				 av_get_default_channel_layout(channels),
+				 bits == 8 ? AV_SAMPLE_FMT_U8 : AV_SAMPLE_FMT_S16, rate,
+				 0, NULL);
+	if (swr && swr_init(swr) < 0)
+		swr_free(&swr);
+	return swr != NULL;
+}
+
+AudioOutput::AudioOutput()
+{
+	dev = NULL;
+	memset(&fmt, 0, sizeof(fmt));
+	frame_bytes = 0;
+	use_dsp = false;
+	running = false;
+	playing = false;
+	pts_end = AV_NOPTS_VALUE;
+	bytes_written = 0;
+	bytes_played = 0;
+	underruns = 0;
+
+	const char *tmp = getenv("HAL_AUDIO_LATENCY_MS");
+	latency_ms = tmp ? atoi(tmp) : LATENCY_MS;
+	tmp = getenv("HAL_AUDIO_DEVICE_LATENCY_MS");
+	dev_latency_ms = tmp ? atoi(tmp) : DEV_LATENCY_MS;
+	tmp = getenv("HAL_AUDIO_DRC");
+	if (tmp && atoi(tmp))
+		dsp.setDRC(true);
+}
+
+AudioOutput::~AudioOutput()
+{
+	close();
+	for (std::vector<AudioSource *>::iterator it = sources.begin(); it != sources.end(); ++it)
+		delete *it;
+}
+
+/* static */ int AudioOutput::driver()
+{
+	/* headless: libao's null driver swallows the samples, no sound card needed */
+	if (HAL_headless)
+		return ao_driver_id("null");
+	return ao_default_driver_id();
+}
+
+void AudioOutput::resizeRing()
+{
+	size_t size = (size_t)fmt.rate * latency_ms / 1000;
+	if (size < 1024)
+		size = 1024;
+	ring.resize(size * frame_bytes); /* whole sample frames, so spans never split one */
+}
+
+bool AudioOutput::open(int bits, int channels, int rate, int byte_format)
+{
+	dev_m.lock();
+	bool ret = openDev(bits, channels, rate, byte_format);
+	dev_m.unlock();
+	return ret;
+}
+
+void AudioOutput::close()
+{
+	dev_m.lock();
+	closeDev();
+	dev_m.unlock();
+}
+
+/* caller holds dev_m */
+bool AudioOutput::openDev(int bits, int channels, int rate, int byte_format)
+{
+	if (dev && fmt.bits == bits && fmt.channels == channels &&
+	    fmt.rate == rate && fmt.byte_format == byte_format)
+		return true;
+	closeDev();
+	int drv = driver();
+	fmt.bits = bits;
+	fmt.channels = channels;
+	fmt.rate = rate;
+	fmt.byte_format = byte_format;
+	fmt.matrix = 0;
+	dev = ao_open_live(drv, &fmt, NULL);
+	lt_info("%s: changed params ch %d srate %d bits %d fmt %d adevice %p\n",
+		__func__, channels, rate, bits, byte_format, dev);
+	ao_info *ai = ao_driver_info(drv);
+	if (ai)
+		lt_info("libao driver: %d name '%s' short '%s' author '%s'\n",
+			drv, ai->name, ai->short_name, ai->author);
+	if (!dev)
+		return false;
+	frame_bytes = bits / 8 * channels;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	use_dsp = (bits == 16 && byte_format != AO_FMT_BIG);
+#else
+	use_dsp = (bits == 16 && byte_format != AO_FMT_LITTLE);
+#endif
+	dsp.setFormat(channels, rate);
+	resizeRing();
+	flush();
+	ring.start();
+	silence.resize(rate / CHUNKS_PER_SEC * frame_bytes);
+	/* sources follow the device format, what they had queued is lost */
+	src_m.lock();
+	for (std::vector<AudioSource *>::iterator it = sources.begin(); it != sources.end(); ++it) {
+		AudioSource *src = *it;
+		src->m.lock();
+		src->configure(channels, rate);
+		src->ring.flush();
+		src->space_c.broadcast();
+		src->m.unlock();
+	}
+	src_m.unlock();
+	running = true;
+	Thread::startThread();
+	return true;
+}
+
+/* caller holds dev_m */
+void AudioOutput::closeDev()
+{
+	if (running) {
+		running = false;
+		ring.stop();
+		wakeup();
+		Thread::joinThread();
+	}
+	if (dev)
+		ao_close(dev);
+	dev = NULL;
+}
+
+void AudioOutput::setLatency(int ms)
+{
+	/* the ring is resized on the next format change */
+	latency_ms = ms;
+}
+
+void AudioOutput::setDeviceLatency(int ms)
+{
+	dev_latency_ms = ms;
+}
+
+size_t AudioOutput::write(const uint8_t *data, size_t len, int64_t pts)
+{
+	size_t done = 0;
+	while (done < len && running) {
+		size_t n;
+		uint8_t *p = ring.writeSpan(n);
+		if (!p)
+			break;
+		if (n > len - done)
+			n = len - done;
+		memcpy(p, data + done, n);
+		pts_m.lock();
+		if (ring.commit(n)) /* false if flushed in between */
+			bytes_written += n;
+		pts_m.unlock();
+		done += n;
+		wakeup();
+	}
+	if (pts != AV_NOPTS_VALUE) {
+		pts_m.lock();
+		pts_end = pts;
+		pts_m.unlock();
+	}
+	return done;
+}
+
+void AudioOutput::flush()
+{
+	/* the output thread may be playing a span in place, resetting the
+	 * ring under its feet would let the next write() overwrite it */
+	play_m.lock();
+	pts_m.lock();
+	ring.flush();
+	bytes_written = bytes_played = 0;
+	pts_end = AV_NOPTS_VALUE;
+	playing = false;
+	pts_m.unlock();
+	play_m.unlock();
+}
+
+int64_t AudioOutput::getPts()
+{
+	pts_m.lock();
+	int64_t ret = pts_end;
+	if (ret != AV_NOPTS_VALUE && fmt.rate > 0 && frame_bytes > 0) {
+		int64_t queued = (bytes_written - bytes_played) / frame_bytes;
+		queued += (int64_t)dev_latency_ms * fmt.rate / 1000;
+		ret -= queued * 90000 / fmt.rate;
+	}
+	pts_m.unlock();
+	return ret;
+}
+
+void AudioOutput::wakeup()
+{
+	wake_m.lock();
+	wake_c.signal();
+	wake_m.unlock();
+}
+
+AudioSource *AudioOutput::openSource(int bits, int channels, int rate, int byte_format)
+{
+	if ((bits != 8 && bits != 16) || channels < 1 || rate < 1) {
+		lt_info("%s: unsupported format bits %d ch %d rate %d\n", __func__, bits, channels, rate);
+		return NULL;
+	}
+	/* the decoder must not reopen the device between the format check,
+	 * configure() and adding the source, open() would miss it */
+	dev_m.lock();
+	if (!dev && !openDev(16, MIX_CHANNELS, MIX_RATE, AO_FMT_NATIVE)) {
+		dev_m.unlock();
+		return NULL;
+	}
+	if (!use_dsp) {
+		dev_m.unlock();
+		lt_info("%s: device format is not S16, cannot mix\n", __func__);
+		return NULL;
+	}
+	AudioSource *src = new AudioSource(bits, channels, rate, byte_format);
+	if (!src->configure(fmt.channels, fmt.rate)) {
+		dev_m.unlock();
+		lt_info("%s: could not alloc resample context\n", __func__);
+		delete src;
+		return NULL;
+	}
+	src_m.lock();
+	sources.push_back(src);
+	src_m.unlock();
+	dev_m.unlock();
+	lt_info("%s: %p ch %d srate %d bits %d fmt %d\n", __func__, src, channels, rate, bits, byte_format);
+	return src;
+}
+
+size_t AudioOutput::writeSource(AudioSource *src, const uint8_t *data, size_t len)
+{
+	int in_frame = src->bits / 8 * src->channels;
+	int frames = len / in_frame;
+	src_m.lock();
+	src->writers++; /* mixPending() must not delete it while we are in here */
+	src_m.unlock();
+	src->m.lock();
+	if (src->swr && frames > 0 && !src->eof) {
+		const uint8_t *in = data;
+		if (!native_order(src->bits, src->byte_format)) {
+			src->swapped.resize(frames * in_frame);
+			const uint16_t *s = (const uint16_t *)data;
+			uint16_t *d = (uint16_t *)&src->swapped[0];
+			for (int i = 0; i < frames * src->channels; i++)
+				d[i] = (s[i] << 8) | (s[i] >> 8);
+			in = &src->swapped[0];
+		}
+		int o_frame = 2 * src->o_channels;
+		int out_max = av_rescale_rnd(swr_get_delay(src->swr, src->rate) + frames,
+					     src->o_rate, src->rate, AV_ROUND_UP);
+		src->obuf.resize(out_max * o_frame);
+		uint8_t *out = &src->obuf[0];
+		int n = swr_convert(src->swr, &out, out_max, &in, frames);
+		size_t todo = n > 0 ? n * o_frame : 0;
+		unsigned int gen = src->gen;
+		/* waiting for ring space releases m, so a format change or
+		 * closeSource() gets through; the rest is dropped then */
+		while (todo > 0 && !src->eof && src->gen == gen) {
+			size_t space;
+			uint8_t *p = src->ring.writeSpan(space, false);
+			if (!p) {
+				src->m.unlock();
+				wakeup(); /* not under m, the output thread takes it to signal space_c */
+				src->m.lock();
+				if (src->ring.fill() == src->ring.size() && !src->eof && src->gen == gen)
+					src->space_c.wait(&src->m);
+				continue;
+			}
+			if (space > todo)
+				space = todo;
+			memcpy(p, out, space);
+			src->ring.commit(space);
+			out += space;
+			todo -= space;
+		}
+	}
+	src->m.unlock();
+	src_m.lock();
+	src->writers--;
+	src_m.unlock();
+	wakeup(); /* new data, or the source may be deleted now */
+	return len;
+}
+
+void AudioOutput::closeSource(AudioSource *src)
+{
+	src_m.lock();
+	src->m.lock();
+	src->eof = true;
+	src->space_c.broadcast(); /* a writer waiting for space gives up */
+	src->m.unlock();
+	src_m.unlock();
+	wakeup(); /* the output thread deletes it once drained and no writer is left */
+}
+
+/* true if any source has data queued, deletes drained closed sources */
+bool AudioOutput::mixPending()
+{
+	bool ret = false;
+	src_m.lock();
+	std::vector<AudioSource *>::iterator it = sources.begin();
+	while (it != sources.end()) {
+		AudioSource *src = *it;
+		if (src->ring.fill() > 0) {
+			ret = true;
+			++it;
+		} else if (src->eof && src->writers == 0) {
+			lt_debug("%s: source %p done\n", __func__, src);
+			it = sources.erase(it);
+			delete src;
+		} else
+			++it;
+	}
+	src_m.unlock();
+	return ret;
+}
+
+void AudioOutput::mixSources(int16_t *buf, size_t samples)
+{
+	src_m.lock();
+	for (std::vector<AudioSource *>::iterator it = sources.begin(); it != sources.end(); ++it) {
+		AudioSource *src = *it;
+		RingBuffer &r = src->ring;
+		size_t done = 0;
+		while (done < samples) {
+			size_t len;
+			const uint8_t *p = r.readSpan(len, false);
+			if (!p)
+				break;	/* ran dry, the rest of this chunk is live audio only */
+			len /= 2;
+			if (len > samples - done)
+				len = samples - done;
+			AudioDSP::mix(buf + done, (const int16_t *)p, len);
+			r.consume(len * 2);
+			done += len;
+		}
+		if (done > 0) {
+			src->m.lock(); /* a writer checks for space under m, no lost wakeup */
+			src->space_c.signal();
+			src->m.unlock();
+		}
+	}
+	src_m.unlock();
+}
+
+void AudioOutput::run()
+{
+	lt_info("%s: start\n", __func__);
+	hal_set_threadname("hal:aout");
+	size_t chunk = fmt.rate / CHUNKS_PER_SEC * frame_bytes;
+	while (running) {
+		size_t len;
+		uint8_t *out;
+		play_m.lock();
+		const uint8_t *p = ring.readSpan(len, false);
+		bool mix = use_dsp && mixPending();
+		if (!p) {
+			if (playing) {
+				underruns++;
+				lt_info("%s: underrun #%u\n", __func__, underruns);
+				playing = false;
+			}
+			if (!mix) {
+				play_m.unlock();
+				/* sleep until there is live or source data */
+				wake_m.lock();
+				while (running && ring.fill() == 0 && !mixPending())
+					wake_c.wait(&wake_m);
+				wake_m.unlock();
+				continue;
+			}
+			/* only sources are playing, mix them into silence */
+			len = silence.size();
+			memset(&silence[0], 0, len);
+			out = &silence[0];
+		} else {
+			if (len > chunk)
+				len = chunk;
+			/* the span belongs to this thread until consume(), modify it in place */
+			out = (uint8_t *)p;
+		}
+		if (mix)
+			mixSources((int16_t *)out, len / 2);
+		if (use_dsp)
+			dsp.process((int16_t *)out, len / frame_bytes);
+		ao_play(dev, (char *)out, len);
+		if (p) {
+			pts_m.lock();
+			if (ring.consume(len)) {
+				bytes_played += len;
+				playing = true;
+			}
+			pts_m.unlock();
+		}
+		play_m.unlock();
+	}
+	lt_info("%s: end\n", __func__);
+}
@@ -0,0 +1,135 @@
+/*
+ * (C) 2026 libstb-hal contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * audio output stage: PCM ring buffer and libao output thread
+ */
+
+#ifndef __AUDIO_OUT_H
+#define __AUDIO_OUT_H
+
+#include <stdint.h>
+#include <vector>
+#include <thread_abstraction.h>
+#include <mutex_abstraction.h>
+#include <condition_abstraction.h>
+#include "ringbuffer.h"
+#include "audio_dsp.h"
+
+extern "C" {
+#include <ao/ao.h>
+}
+
+struct SwrContext;
+
+/* additional PCM source (clips, UI sounds), converted to the device
+ * format on write and mixed over the live stream by the output thread */
+class AudioSource
+{
+public:
+	bool sameFormat(int b, int ch, int r, int bf) {
+		return bits == b && channels == ch && rate == r && byte_format == bf;
+	}
+private:
+	friend class AudioOutput;
+	AudioSource(int bits, int channels, int rate, int byte_format);
+	~AudioSource();
+	bool configure(int o_channels, int o_rate);
+
+	int bits, channels, rate, byte_format;	/* input format */
+	int o_channels, o_rate;			/* device format, always S16 */
+	SwrContext *swr;
+	Mutex m;				/* protects swr, the buffers, gen and eof */
+	Condition space_c;			/* signalled on consume, format change and close */
+	std::vector<uint8_t> swapped;		/* input in native byte order */
+	std::vector<uint8_t> obuf;		/* converted samples */
+	RingBuffer ring;
+	unsigned int gen;			/* bumped by configure() */
+	bool eof;				/* closed, delete when drained */
+	int writers;				/* threads in writeSource(), protected by src_m */
+};
+
+class AudioOutput : public Thread
+{
+public:
+	AudioOutput();
+	~AudioOutput();
+
+	/* (re)opens the device if the format changed, drops queued data then */
+	bool open(int bits, int channels, int rate, int byte_format = AO_FMT_NATIVE);
+	void close();
+	bool isOpen() { return dev != NULL; }	/* only a hint, may change right after */
+
+	/* queue PCM, blocks while the ring is full.
+	 * pts_end is the pts of the sample following the data, AV_NOPTS_VALUE if unknown */
+	size_t write(const uint8_t *data, size_t len, int64_t pts_end);
+	void flush();			/* drop everything queued */
+
+	int64_t getPts();		/* pts of the sample that is audible right now */
+	unsigned int getUnderruns() { return underruns; }
+
+	/* export HAL_AUDIO_LATENCY_MS / HAL_AUDIO_DEVICE_LATENCY_MS to change the defaults */
+	void setLatency(int ms);	/* target latency of the PCM ring */
+	void setDeviceLatency(int ms);	/* what the sound system adds after ao_play() */
+
+	/* software mixer, applied in the output thread right before ao_play(),
+	 * so changes are audible after one chunk instead of the whole ring */
+	void setVolume(int left, int right) { dsp.setVolume(left, right); }
+	void setMute(bool enable) { dsp.setMute(enable); }
+	void setDRC(bool enable) { dsp.setDRC(enable); }
+
+	/* mixer sources. The device is opened with a default format if there
+	 * is no live stream, it is never reopened for a source. closeSource()
+	 * lets the queued data play out, the source is deleted afterwards */
+	AudioSource *openSource(int bits, int channels, int rate, int byte_format);
+	size_t writeSource(AudioSource *src, const uint8_t *data, size_t len);
+	void closeSource(AudioSource *src);
+private:
+	void run();
+	bool openDev(int bits, int channels, int rate, int byte_format);
+	void closeDev();
+	void resizeRing();
+	bool mixPending();
+	void mixSources(int16_t *buf, size_t samples);
+	void wakeup();
+	static int driver();
+
+	Mutex dev_m;			/* decoder and clip thread open / close, protects dev, fmt, use_dsp */
+	ao_device *dev;
+	ao_sample_format fmt;
+	int frame_bytes;		/* bytes per sample * channels */
+	bool use_dsp;			/* format is native endian S16 */
+	AudioDSP dsp;
+	int latency_ms;
+	int dev_latency_ms;
+
+	RingBuffer ring;
+	bool running;
+	bool playing;			/* an empty ring now is an underrun */
+	Mutex play_m;			/* held by the output thread while it works on a span */
+	Mutex pts_m;			/* protects the counters and ring commit / consume */
+	int64_t pts_end;		/* pts at the end of the queued data */
+	uint64_t bytes_written;		/* total bytes queued */
+	uint64_t bytes_played;		/* total bytes handed to ao_play */
+	unsigned int underruns;
+
+	std::vector<AudioSource *> sources;
+	Mutex src_m;			/* protects sources */
+	std::vector<uint8_t> silence;	/* a chunk to mix sources into without live data */
+	Mutex wake_m;
+	Condition wake_c;		/* signalled when live or source data is queued */
+};
+
+#endif
@@ -34,6 +34,7 @@
 #include <unistd.h>
 #include "dmx_lib.h"
 #include "lt_debug.h"
+#include "faststart.h"
 
 /* needed for getSTC :-( */
 #include "video_lib.h"
@@ -95,6 +96,7 @@ cDemux::cDemux(int n)
 	else
 		num = n;
 	fd = -1;
+	pes_pid = -1;
 	measure = false;
 	last_measure = 0;
 	last_data = 0;
@@ -114,6 +116,7 @@ bool cDemux::Open(DMX_CHANNEL_TYPE pes_type, void * /*hVideoBuffer*/, int uBuffe
 		lt_info("%s FD ALREADY OPENED? fd = %d\n", __FUNCTION__, fd);
 
 	dmx_type = pes_type;
+	pes_pid = -1;
 	if (pes_type != DMX_PSI_CHANNEL)
 		flags |= O_NONBLOCK;
 
@@ -160,6 +163,7 @@ void cDemux::Close(void)
 		return;
 	}
 	pesfds.clear();
+	pes_pid = -1;
 	ioctl(fd, DMX_STOP);
 	close(fd);
 	fd = -1;
@@ -196,6 +200,9 @@ bool cDemux::Stop(void)
 		lt_info("%s #%d: not open!\n", __FUNCTION__, num);
 		return false;
 	}
+	/* zapit keeps the video demux open across channels, without this a
+	 * radio channel would still see the PID of the last TV channel */
+	pes_pid = -1;
 	ioctl(fd, DMX_STOP);
 	return true;
 }
@@ -382,6 +389,7 @@ bool cDemux::pesFilter(const unsigned short pid)
 
 	lt_debug("%s #%d pid: 0x%04hx fd: %d type: %s\n", __FUNCTION__, num, pid, fd, DMX_T[dmx_type]);
 
+	pes_pid = pid;
 	memset(&p_flt, 0, sizeof(p_flt));
 	p_flt.pid = pid;
 	p_flt.output = DMX_OUT_DECODER;
@@ -390,6 +398,7 @@ bool cDemux::pesFilter(const unsigned short pid)
 	switch (dmx_type) {
 	case DMX_PCR_ONLY_CHANNEL:
 		p_flt.pes_type = DMX_PES_PCR;
+		faststart_set_pcr_pid(pid);	/* a new service, see faststart_key() */
 		if (HAL_nodec)
 			return true;
 		break;
@@ -40,6 +40,7 @@ class cDemux
 		std::vector<pes_pids> pesfds;
 		struct dmx_sct_filter_params s_flt;
 		struct dmx_pes_filter_params p_flt;
+		int pes_pid;
 	public:
 
 		bool Open(DMX_CHANNEL_TYPE pes_type, void * x = NULL, int y = 0);
@@ -53,6 +54,7 @@ class cDemux
 		void * getBuffer();
 		void * getChannel();
 		DMX_CHANNEL_TYPE getChannelType(void) { return dmx_type; };
+		int getPesPid(void) { return pes_pid; };	/* -1 if no pesFilter() since Open() or Stop() */
 		bool addPid(unsigned short pid);
 		void getSTC(int64_t * STC);
 		int getUnit(void);
@@ -0,0 +1,110 @@
+/*
+ * (C) 2026 libstb-hal contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * fast decoder start: codec hints from SetStreamType() and the codec
+ * parameters of the last decode of a PID
+ */
+
+#include <cstdlib>
+#include <map>
+
+#include <mutex_abstraction.h>
+#include "faststart.h"
+#include "lt_debug.h"
+
+#define lt_info_c(args...) _lt_info(HAL_DEBUG_INIT, NULL, args)
+#define lt_debug_c(args...) _lt_debug(HAL_DEBUG_INIT, NULL, args)
+
+/* a few TS packets are enough to find the PES header */
+#define FAST_PROBESIZE (188 * 5)
+/* and not much stream time if it has to look further */
+#define FAST_ANALYZE_DURATION (AV_TIME_BASE / 2)
+/* channels remembered, the whole cache is dropped when it overflows */
+#define MAX_CACHED 64
+
+static std::map<int, AVCodecParameters *> cache;
+static Mutex cache_m;
+static int pcr_pid = 0x1fff;	/* of the current service, protected by cache_m */
+
+bool faststart_enabled(void)
+{
+	static int enabled = -1;
+	if (enabled < 0) {
+		const char *tmp = getenv("HAL_FASTSTART");
+		enabled = tmp ? atoi(tmp) != 0 : 1;
+		lt_info_c("%s: fast start %s\n", __func__, enabled ? "on" : "off");
+	}
+	return enabled;
+}
+
+void faststart_setup(AVFormatContext *avfc)
+{
+	avfc->probesize = FAST_PROBESIZE;
+	/* 0 would mean the libavformat default of 5 seconds */
+	avfc->max_analyze_duration = FAST_ANALYZE_DURATION;
+	avfc->fps_probe_size = 0;
+	/* no avfc->video_codec_id / audio_codec_id: libavformat would force
+	 * it onto every packet, and a wrong stream type could not be noticed */
+}
+
+void faststart_set_pcr_pid(int pid)
+{
+	cache_m.lock();
+	pcr_pid = pid & 0x1fff;
+	cache_m.unlock();
+}
+
+int faststart_key(int pid)
+{
+	if (pid < 0)
+		return -1;
+	cache_m.lock();
+	/* the same PID on another service has other codec parameters */
+	int key = (pcr_pid << 13) | (pid & 0x1fff);
+	cache_m.unlock();
+	return key;
+}
+
+bool faststart_lookup(int key, enum AVCodecID hint, AVCodecParameters *par)
+{
+	bool ret = false;
+	cache_m.lock();
+	std::map<int, AVCodecParameters *>::iterator it = cache.find(key);
+	if (it != cache.end() && it->second && (hint == AV_CODEC_ID_NONE || hint == it->second->codec_id))
+		ret = avcodec_parameters_copy(par, it->second) >= 0;
+	cache_m.unlock();
+	lt_debug_c("%s: pcr 0x%04x pid 0x%04x hint %s => %d\n", __func__, key >> 13, key & 0x1fff, avcodec_get_name(hint), ret);
+	return ret;
+}
+
+void faststart_store(int key, const AVCodecContext *c)
+{
+	if (key < 0)
+		return;
+	cache_m.lock();
+	std::map<int, AVCodecParameters *>::iterator it = cache.find(key);
+	if (it == cache.end()) {
+		if (cache.size() >= MAX_CACHED) {
+			for (it = cache.begin(); it != cache.end(); ++it)
+				avcodec_parameters_free(&it->second);
+			cache.clear();
+		}
+		it = cache.insert(std::make_pair(key, avcodec_parameters_alloc())).first;
+	}
+	if (it->second)
+		avcodec_parameters_from_context(it->second, c);
+	cache_m.unlock();
+}
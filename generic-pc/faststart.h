@@ -0,0 +1,44 @@
+/*
+ * (C) 2026 libstb-hal contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * fast decoder start: codec hints from SetStreamType() and the codec
+ * parameters of the last decode of a PID, so the decoders need not wait
+ * for libavformat to probe the stream
+ */
+
+#ifndef __FASTSTART_H
+#define __FASTSTART_H
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+/* export HAL_FASTSTART=0 to always probe the stream */
+bool faststart_enabled(void);
+/* limit probing. The codec is still the one the demuxer finds, a hint
+ * only picks the decoder if the demuxer has none */
+void faststart_setup(AVFormatContext *avfc);
+/* called on every PCR filter, a PID is cached per PCR PID, i.e. per service */
+void faststart_set_pcr_pid(int pid);
+/* cache key of pid on the current service, -1 if there is no pid */
+int faststart_key(int pid);
+/* copy the cached parameters of key into par if they match hint
+ * (AV_CODEC_ID_NONE matches everything) */
+bool faststart_lookup(int key, enum AVCodecID hint, AVCodecParameters *par);
+/* remember the decoder parameters (incl. extradata) of key */
+void faststart_store(int key, const AVCodecContext *c);
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * (C) 2026 libstb-hal contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * timing helpers and per-frame statistics for the generic-pc decoders
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <inttypes.h>
+#include <time.h>
+
+#include "framestats.h"
+#include "lt_debug.h"
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+#define lt_info_c(args...) _lt_info(HAL_DEBUG_INIT, NULL, args)
+
+static FILE *stats_f = NULL;
+static int64_t stats_start = 0;
+
+int64_t hal_time_us(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+void framestats_init(void)
+{
+	const char *tmp = getenv("HAL_FRAMESTATS");
+	if (!tmp || stats_f)
+		return;
+	if (strcmp(tmp, "-") == 0)
+		stats_f = stderr;
+	else
+		stats_f = fopen(tmp, "w");
+	if (!stats_f) {
+		lt_info_c("%s: could not open %s: %m\n", __func__, tmp);
+		return;
+	}
+	setvbuf(stats_f, NULL, _IOLBF, 0);
+	stats_start = hal_time_us();
+	fprintf(stats_f, "time_ms,pts,decode_us,queue_us,late_us,av_offset_ms\n");
+	lt_info_c("%s: writing frame statistics to %s\n", __func__, tmp);
+}
+
+void framestats_close(void)
+{
+	if (stats_f && stats_f != stderr)
+		fclose(stats_f);
+	stats_f = NULL;
+}
+
+bool framestats_enabled(void)
+{
+	return stats_f != NULL;
+}
+
+void framestats_log(int64_t pts, int decode_us, int queue_us, int late_us, int64_t av_us)
+{
+	if (!stats_f)
+		return;
+	fprintf(stats_f, "%" PRId64 ",%" PRId64 ",%d,%d,%d,",
+		(hal_time_us() - stats_start) / 1000, pts, decode_us, queue_us, late_us);
+	if (av_us == AV_NOPTS_VALUE)	/* no offset sample, leave the column empty */
+		fputc('\n', stats_f);
+	else
+		fprintf(stats_f, "%.1f\n", av_us / 1000.0);
+}
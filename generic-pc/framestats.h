@@ -0,0 +1,40 @@
+/*
+ * (C) 2026 libstb-hal contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * timing helpers and per-frame statistics for the generic-pc decoders
+ */
+
+#ifndef __FRAMESTATS_H
+#define __FRAMESTATS_H
+
+#include <stdint.h>
+
+/* CLOCK_MONOTONIC in microseconds */
+int64_t hal_time_us(void);
+
+/* export HAL_FRAMESTATS=<file> (or "-" for stderr) to get one CSV line
+ * per presented video frame */
+void framestats_init(void);
+void framestats_close(void);
+bool framestats_enabled(void);
+/* pts: frame pts (90kHz)
+ * decode_us: time spent decoding and converting the frame
+ * queue_us: time between queueing by the decoder and presentation
+ * late_us: presentation after the frame was due
+ * av_us: video pts - audio pts, AV_NOPTS_VALUE if either is unknown */
+void framestats_log(int64_t pts, int decode_us, int queue_us, int late_us, int64_t av_us);
+
+#endif
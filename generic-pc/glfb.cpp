@@ -23,6 +23,7 @@
 */
 
 #include <vector>
+#include <algorithm>
 
 #include <sys/types.h>
 #include <signal.h>
@@ -34,13 +35,17 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 #include <unistd.h>
 #include <linux/input.h>
 #include "glfb.h"
 #include <GL/glx.h>
 #include "video_lib.h"
 #include "audio_lib.h"
+#include "framestats.h"
 
 #include "lt_debug.h"
 
@@ -52,11 +57,16 @@
 
 extern cVideo *videoDecoder;
 extern cAudio *audioDecoder;
+extern bool HAL_headless;
 
 static GLFramebuffer *gThiz = 0; /* GLUT does not allow for an arbitrary argument to the render func */
 
-GLFramebuffer::GLFramebuffer(int x, int y): mReInit(true), mShutDown(false), mInitDone(false)
+GLFramebuffer::GLFramebuffer(int x, int y): mReInit(true), mShutDown(false), mRedraw(true), mInitDone(false)
 {
+	mWakeFd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+	if (mWakeFd < 0)
+		lt_info("%s: eventfd failed: %m\n", __func__);
+	mFrameDue = 0;
 	mState.width  = x;
 	mState.height = y;
 	mX = &_mX[0];
@@ -72,8 +82,10 @@ GLFramebuffer::GLFramebuffer(int x, int y): mReInit(true), mShutDown(false), mIn
 	xscale = 1.0;
 	const char *tmp = getenv("GLFB_FULLSCREEN");
 	mFullscreen = !!(tmp);
+	mHeadless = HAL_headless;
 
-	mState.blit = true;
+	mState.blit = false;
+	blit();			/* initial full upload */
 	last_apts = 0;
 
 	/* linux framebuffer compat mode */
@@ -105,9 +117,12 @@ GLFramebuffer::GLFramebuffer(int x, int y): mReInit(true), mShutDown(false), mIn
 GLFramebuffer::~GLFramebuffer()
 {
 	mShutDown = true;
+	wakeup();
 	Thread::joinThread();
 	if (input_fd >= 0)
 		close(input_fd);
+	if (mWakeFd >= 0)
+		close(mWakeFd);
 }
 
 void GLFramebuffer::initKeys()
@@ -176,6 +191,14 @@ void GLFramebuffer::initKeys()
 
 void GLFramebuffer::run()
 {
+	if (mHeadless) {
+		lt_info("GLFB: headless mode, video frames are scheduled but not drawn\n");
+		setupOSDBuffer();
+		mInitDone = true;
+		mainLoop();
+		lt_info("GLFB: GL thread stopping\n");
+		return;
+	}
 	setupCtx();
 	setupOSDBuffer();
 	mInitDone = true; /* signal that setup is finished */
@@ -200,8 +223,9 @@ void GLFramebuffer::run()
 			glutSpecialFunc(GLFramebuffer::specialcb);
 			glutReshapeFunc(GLFramebuffer::resizecb);
 			setupGLObjects(); /* needs GLEW prototypes */
+			setupVsync();
 			glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_CONTINUE_EXECUTION);
-			glutMainLoop();
+			mainLoop();
 			releaseGLObjects();
 		}
 	}
@@ -257,6 +281,10 @@ void GLFramebuffer::setupGLObjects()
 	glGenBuffers(1, &mState.pbo);
 	glGenBuffers(1, &mState.displaypbo);
 
+	/* the OSD PBO keeps its size, it is only orphaned on each upload */
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mState.pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, mState.width * mState.height * 4, NULL, GL_STREAM_DRAW_ARB);
+
 	/* hack to start with black video buffer instead of white */
 	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mState.displaypbo);
 	glBufferData(GL_PIXEL_UNPACK_BUFFER, sizeof(buf), buf, GL_STREAM_DRAW_ARB);
@@ -266,6 +294,30 @@ void GLFramebuffer::setupGLObjects()
 }
 
 
+void GLFramebuffer::setupVsync()
+{
+	/* export GLFB_VSYNC=0 to render without waiting for the vertical blank */
+	const char *tmp = getenv("GLFB_VSYNC");
+	int interval = tmp ? atoi(tmp) : 1;
+	Display *dpy = glXGetCurrentDisplay();
+	const char *ext = glXQueryExtensionsString(dpy, DefaultScreen(dpy));
+	typedef int (*swap_interval_t)(int);
+	static const char *procs[][2] = {
+		{ "GLX_MESA_swap_control", "glXSwapIntervalMESA" },
+		{ "GLX_SGI_swap_control",  "glXSwapIntervalSGI" }
+	};
+	for (unsigned int i = 0; ext && i < sizeof(procs) / sizeof(procs[0]); i++) {
+		if (!strstr(ext, procs[i][0]))
+			continue;
+		swap_interval_t f = (swap_interval_t)glXGetProcAddress((const GLubyte *)procs[i][1]);
+		if (f && f(interval) == 0) {
+			lt_info("GLFB: %s(%d)\n", procs[i][1], interval);
+			return;
+		}
+	}
+	lt_info("GLFB: no swap control extension, vsync not available\n");
+}
+
 void GLFramebuffer::releaseGLObjects()
 {
 	glDeleteBuffers(1, &mState.pbo);
@@ -277,7 +329,68 @@ void GLFramebuffer::releaseGLObjects()
 
 /* static */ void GLFramebuffer::rendercb()
 {
-	gThiz->render();
+	/* expose and friends, the actual rendering happens in mainLoop() */
+	gThiz->mRedraw = true;
+}
+
+void GLFramebuffer::wakeup()
+{
+	uint64_t one = 1;
+	if (mWakeFd < 0)
+		return;
+	/* EAGAIN: the counter is about to overflow, the loop is woken up anyway */
+	while (write(mWakeFd, &one, sizeof(one)) < 0) {
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN)
+			lt_info("GLFB::%s: write: %m\n", __func__);
+		break;
+	}
+}
+
+/* instead of redrawing all the time, sleep until a video frame is due,
+ * the OSD was blit()ed, the window got resized / exposed or a key was pressed */
+void GLFramebuffer::mainLoop()
+{
+	Display *dpy = mHeadless ? NULL : glXGetCurrentDisplay();
+	struct pollfd fds[2];
+	int nfds = dpy ? 2 : 1;
+	fds[0].fd = mWakeFd;
+	fds[0].events = POLLIN;
+	fds[1].fd = dpy ? ConnectionNumber(dpy) : -1;
+	fds[1].events = POLLIN;
+
+	while (!mShutDown) {
+		int timeout = -1;
+		if (dpy && XPending(dpy))
+			timeout = 0;
+		else if (videoDecoder && videoDecoder->buf_num > 0) {
+			int64_t now = hal_time_us();
+			timeout = (mFrameDue > now) ? (mFrameDue - now + 999) / 1000 : 0;
+		}
+		fds[0].revents = fds[1].revents = 0;
+		if (poll(fds, nfds, timeout) < 0 && errno != EINTR) {
+			lt_info("GLFB::%s: poll: %m\n", __func__);
+			break;
+		}
+		if (fds[0].revents & POLLIN) {
+			uint64_t cnt;
+			/* EAGAIN: somebody else already drained the counter */
+			while (read(mWakeFd, &cnt, sizeof(cnt)) < 0) {
+				if (errno == EINTR)
+					continue;
+				if (errno != EAGAIN)
+					lt_info("GLFB::%s: read: %m\n", __func__);
+				break;
+			}
+		}
+		if (dpy) {
+			glutMainLoopEvent();	/* dispatches keyboard, reshape and display callbacks */
+			if (glutGetWindow() == 0) /* window was closed */
+				break;
+		}
+		render();
+	}
 }
 
 
@@ -326,12 +439,24 @@ int sleep_us = 30000;
 
 void GLFramebuffer::render()
 {
-	if(mShutDown)
-		glutLeaveMainLoop();
+	if (mHeadless) {
+		/* same frame scheduling as below, but nothing gets drawn */
+		bltDisplayBuffer();
+		if (mState.blit) {
+			mDamageLock.lock();
+			mDamage.clear();
+			mState.blit = false;
+			mDamageLock.unlock();
+		}
+		return;
+	}
+
+	bool redraw = mRedraw.exchange(false);
 
 	mReInitLock.lock();
 	if (mReInit)
 	{
+		redraw = true;
 		int xoff = 0;
 		int yoff = 0;
 		mVAchanged = true;
@@ -375,13 +500,16 @@ void GLFramebuffer::render()
 	if (!mFullscreen && (*mX != glutGet(GLUT_WINDOW_WIDTH) || *mY != glutGet(GLUT_WINDOW_HEIGHT)))
 		glutReshapeWindow(*mX, *mY);
 
-	bltDisplayBuffer(); /* decoded video stream */
+	if (bltDisplayBuffer()) /* decoded video stream */
+		redraw = true;
 	if (mState.blit) {
 		/* only blit manually after fb->blit(), this helps to find missed blit() calls */
-		mState.blit = false;
 		lt_debug("GLFB::%s blit!\n", __func__);
 		bltOSDBuffer(); /* OSD */
+		redraw = true;
 	}
+	if (!redraw) /* nothing changed, keep the last frame on screen */
+		return;
 
 	glBindTexture(GL_TEXTURE_2D, mState.osdtex);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -447,9 +575,6 @@ void GLFramebuffer::render()
 	GLuint err = glGetError();
 	if (err != 0)
 		lt_info("GLFB::%s: GLError:%d 0x%04x\n", __func__, err, err);
-	if (sleep_us > 0)
-		usleep(sleep_us);
-	glutPostRedisplay();
 }
 
 /* static */ void GLFramebuffer::resizecb(int w, int h)
@@ -472,6 +597,7 @@ void GLFramebuffer::checkReinit(int x, int y)
 		}
 		mReInit = true;
 	}
+	mRedraw = true;
 	mReInitLock.unlock();
 	last_x = x;
 	last_y = y;
@@ -533,34 +659,100 @@ void GLFramebuffer::drawSquare(float size, float x_factor)
 }
 
 
+/* more damaged regions than this are merged into their bounding box */
+#define MAX_DAMAGE 16
+
+void GLFramebuffer::blit(int x, int y, int w, int h)
+{
+	/* clip to the OSD */
+	if (x < 0) {
+		w += x;
+		x = 0;
+	}
+	if (y < 0) {
+		h += y;
+		y = 0;
+	}
+	if (x + w > mState.width)
+		w = mState.width - x;
+	if (y + h > mState.height)
+		h = mState.height - y;
+	if (w <= 0 || h <= 0)
+		return;
+
+	mDamageLock.lock();
+	std::vector<OSDRect>::iterator it;
+	for (it = mDamage.begin(); it != mDamage.end(); ++it) {
+		if (x >= it->x && y >= it->y && x + w <= it->x + it->w && y + h <= it->y + it->h)
+			break; /* already covered */
+	}
+	if (it == mDamage.end()) {
+		OSDRect r = { x, y, w, h };
+		mDamage.push_back(r);
+	}
+	if (mDamage.size() > MAX_DAMAGE) {
+		int x1 = mState.width, y1 = mState.height, x2 = 0, y2 = 0;
+		for (it = mDamage.begin(); it != mDamage.end(); ++it) {
+			x1 = std::min(x1, it->x);
+			y1 = std::min(y1, it->y);
+			x2 = std::max(x2, it->x + it->w);
+			y2 = std::max(y2, it->y + it->h);
+		}
+		OSDRect r = { x1, y1, x2 - x1, y2 - y1 };
+		mDamage.assign(1, r);
+	}
+	mState.blit = true;
+	mDamageLock.unlock();
+	wakeup();
+}
+
 void GLFramebuffer::bltOSDBuffer()
 {
-	/* FIXME: copy each time  */
+	std::vector<OSDRect> damage;
+	mDamageLock.lock();
+	damage.swap(mDamage);
+	mState.blit = false;
+	mDamageLock.unlock();
+
+	/* the PBO has the same layout as the OSD buffer, only the damaged rows
+	 * are copied into it and only the damaged rectangles go to the texture */
+	const int stride = mState.width * 4;
 	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mState.pbo);
-	glBufferData(GL_PIXEL_UNPACK_BUFFER, mOSDBuffer.size(), &mOSDBuffer[0], GL_STREAM_DRAW_ARB);
+	/* orphan the old storage, so we never wait for the previous upload */
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, stride * mState.height, NULL, GL_STREAM_DRAW_ARB);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, mState.width);
 
 	glBindTexture(GL_TEXTURE_2D, mState.osdtex);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, mState.width, mState.height, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+	for (std::vector<OSDRect>::iterator it = damage.begin(); it != damage.end(); ++it) {
+		GLintptr off = it->y * stride;
+		glBufferSubData(GL_PIXEL_UNPACK_BUFFER, off, it->h * stride, &mOSDBuffer[off]);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, it->x, it->y, it->w, it->h, GL_BGRA, GL_UNSIGNED_BYTE,
+				(GLvoid *)(off + it->x * 4));
+	}
 
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
 
-void GLFramebuffer::bltDisplayBuffer()
+bool GLFramebuffer::bltDisplayBuffer()
 {
 	if (!videoDecoder) /* cannot start yet */
-		return;
+		return false;
+	int64_t now = hal_time_us();
+	if (now < mFrameDue) /* the current frame is not yet over */
+		return false;
 	static bool warn = true;
 	cVideo::SWFramebuffer *buf = videoDecoder->getDecBuf();
 	if (!buf) {
 		if (warn)
 			lt_debug("GLFB::%s did not get a buffer...\n", __func__);
 		warn = false;
-		return;
+		return false;
 	}
 	warn = true;
 	int w = buf->width(), h = buf->height();
 	if (w == 0 || h == 0)
-		return;
+		return false;
 
 	AVRational a = buf->AR();
 	if (a.den != 0 && a.num != 0 && av_cmp_q(a, _mVA)) {
@@ -570,20 +762,23 @@ void GLFramebuffer::bltDisplayBuffer()
 		mVAchanged = true;
 	}
 
-	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mState.displaypbo);
-	glBufferData(GL_PIXEL_UNPACK_BUFFER, buf->size(), &(*buf)[0], GL_STREAM_DRAW_ARB);
+	if (!mHeadless) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mState.displaypbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, buf->size(), &(*buf)[0], GL_STREAM_DRAW_ARB);
 
-	glBindTexture(GL_TEXTURE_2D, mState.displaytex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+		glBindTexture(GL_TEXTURE_2D, mState.displaytex);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_BGRA, GL_UNSIGNED_BYTE, 0);
 
-	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
 
 	/* "rate control" mechanism starts here...
 	 * this implementation is pretty naive and not working too well, but
 	 * better this than nothing... :-) */
 	int64_t apts = 0;
-	/* 18000 is the magic value for A/V sync in my libao->pulseaudio->intel_hda setup */
-	int64_t vpts = buf->pts() + 18000;
+	/* the audio pts already accounts for the sound device latency,
+	 * see HAL_AUDIO_DEVICE_LATENCY_MS */
+	int64_t vpts = buf->pts();
 	if (audioDecoder)
 		apts = audioDecoder->getPts();
 	if (apts != last_apts) {
@@ -603,8 +798,18 @@ void GLFramebuffer::bltDisplayBuffer()
 		else if (sleep_us < 1)
 			sleep_us = 1;
 	}
+	if (framestats_enabled()) {
+		int64_t due = std::max(mFrameDue, buf->queued());
+		int64_t av_us = AV_NOPTS_VALUE;
+		if (audioDecoder && apts != AV_NOPTS_VALUE && vpts != AV_NOPTS_VALUE)
+			av_us = (vpts - apts) * 1000 / 90;
+		framestats_log(buf->pts(), buf->dectime(), now - buf->queued(),
+				now > due ? now - due : 0, av_us);
+	}
+	mFrameDue = now + sleep_us;
 	lt_debug("vpts: 0x%" PRIx64 " apts: 0x%" PRIx64 " diff: %6.3f sleep_us %d buf %d\n",
 			buf->pts(), apts, (buf->pts() - apts)/90000.0, sleep_us, videoDecoder->buf_num);
+	return true;
 }
 
 void GLFramebuffer::clear()
@@ -21,6 +21,7 @@
 #include <thread_abstraction.h>
 #include <mutex_abstraction.h>
 
+#include <atomic>
 #include <vector>
 #include <map>
 #include <GL/glew.h>
@@ -42,9 +43,11 @@ public:
 
 	int getOSDWidth() { return mState.width; }
 	int getOSDHeight() { return mState.height; }
-	void blit() { mState.blit = true; }
+	void blit() { blit(0, 0, mState.width, mState.height); }
+	void blit(int x, int y, int w, int h);	/* only upload the changed region */
 
-	void setOutputFormat(AVRational a, int h, int c) { mOA = a; *mY = h; mCrop = c; mReInit = true; }
+	void setOutputFormat(AVRational a, int h, int c) { mOA = a; *mY = h; mCrop = c; mReInit = true; wakeup(); }
+	void wakeup();			/* make the GL thread look for work, callable from any thread */
 
 	void clear();
 	fb_var_screeninfo getScreenInfo() { return screeninfo; }
@@ -66,21 +69,32 @@ private:
 	int GLWinID;
 
 	bool mFullscreen;		/* fullscreen? */
+	bool mHeadless;			/* no window, frames are scheduled but not drawn */
 	bool mReInit;			/* setup things for GL */
 	Mutex mReInitLock;
 	bool mShutDown;			/* if set main loop is left */
+	std::atomic<bool> mRedraw;	/* window needs repainting, set from other threads */
+	int mWakeFd;			/* eventfd to wake up the main loop */
+	int64_t mFrameDue;		/* CLOCK_MONOTONIC us when the next video frame is due */
 	bool mInitDone;			/* condition predicate */
 	// OpenThreads::Condition mInitCond;	/* condition variable for init */
 	// mutable OpenThreads::Mutex mMutex;	/* lock our data */
 
 	std::vector<unsigned char> mOSDBuffer; /* silly bounce buffer */
 
+	struct OSDRect {
+		int x, y, w, h;
+	};
+	std::vector<OSDRect> mDamage;	/* OSD regions changed since last upload */
+	Mutex mDamageLock;
+
 	std::map<unsigned char, int> mKeyMap;
 	std::map<int, int> mSpecialMap;
 	int input_fd;
 	int64_t last_apts;
 
 	static void rendercb();		/* callback for GLUT */
+	void mainLoop();		/* sleeps until there is something to render */
 	void render();			/* actual render function */
 	static void keyboardcb(unsigned char key, int x, int y);
 	static void specialcb(int key, int x, int y);
@@ -91,6 +105,7 @@ private:
 	void setupCtx();		/* create the window and make the context current */
 	void setupOSDBuffer();		/* create the OSD buffer */
 	void setupGLObjects();		/* PBOs, textures and stuff */
+	void setupVsync();		/* sync buffer swaps to the display refresh */
 	void releaseGLObjects();
 	void drawSquare(float size, float x_factor = 1);	/* do not be square */
 
@@ -101,10 +116,10 @@ private:
 		GLuint pbo;		/* PBO we use for transfer to texture */
 		GLuint displaytex;	/* holds the display texture */
 		GLuint displaypbo;
-		bool blit;
+		bool blit;		/* mDamage is not empty */
 	} mState;
 
 	void bltOSDBuffer();
-	void bltDisplayBuffer();
+	bool bltDisplayBuffer();	/* true if a new video frame was uploaded */
 };
 #endif
@@ -1,21 +1,31 @@
+#include <cstdlib>
 #include <cstring>
 #include <unistd.h>
 
 #include "init_lib.h"
 #include "lt_debug.h"
 #include "glfb.h"
+#include "framestats.h"
 #define lt_debug(args...) _lt_debug(TRIPLE_DEBUG_INIT, NULL, args)
 #define lt_info(args...) _lt_info(TRIPLE_DEBUG_INIT, NULL, args)
 
 static bool initialized = false;
 GLFramebuffer *glfb = NULL;
 bool HAL_nodec = false;
+bool HAL_headless = false;
 
 void init_td_api()
 {
 	if (!initialized)
 		lt_debug_init();
 	lt_info("%s begin, initialized=%d, debug=0x%02x\n", __func__, (int)initialized, debuglevel);
+	/* run the whole decode / presentation chain without window and sound card,
+	 * e.g. on CI machines. export HAL_HEADLESS=1
+	 * export HAL_FRAMESTATS=<file> to log per-frame timing */
+	const char *headless = getenv("HAL_HEADLESS");
+	if (headless && atoi(headless) != 0)
+		HAL_headless = true;
+	framestats_init();
 	if (! glfb) {
 		int x = 1280, y = 720; /* default OSD FB resolution */
 		/*
@@ -51,5 +61,6 @@ void shutdown_td_api()
 	if (glfb)
 		delete glfb;
 	glfb = NULL;
+	framestats_close();
 	initialized = false;
 }
@@ -48,6 +48,12 @@ bool cPlayback::GetSpeed(int &/*speed*/) const
 	return true;
 }
 
+/* no statistics from this player */
+bool cPlayback::GetStatistics(playback_stats_t &/*stats*/)
+{
+	return false;
+}
+
 bool cPlayback::GetPosition(int &position, int &duration)
 {
 	printf("%s:%s %d %d\n", FILENAME, __func__, position, duration);
@@ -4,6 +4,7 @@
 #include <string>
 #include <stdint.h>
 #include <vector>
+#include "../include/playback_stats.h"
 
 typedef enum {
 	PLAYMODE_TS = 0,
@@ -36,6 +37,7 @@ class cPlayback
 		bool SetSpeed(int speed);
 		bool GetSpeed(int &speed) const;
 		bool GetPosition(int &position, int &duration);
+		bool GetStatistics(playback_stats_t &stats);
 		void GetPts(uint64_t &pts);
 		bool SetPosition(int position, bool absolute = false);
 		void FindAllPids(int *apids, unsigned int *ac3flags, unsigned int *numpida, std::string *language);
@@ -0,0 +1,236 @@
+/*
+ * (C) 2026 libstb-hal contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ring buffer for feeding libavformat from the demux (and the like)
+ */
+
+#include <cstring>
+#include <unistd.h>
+
+#include "ringbuffer.h"
+#include "dmx_lib.h"
+#include "lt_debug.h"
+
+extern "C" {
+#include <libavutil/error.h>
+}
+
+#define lt_debug(args...) _lt_debug(HAL_DEBUG_DEMUX, this, args)
+#define lt_info(args...) _lt_info(HAL_DEBUG_DEMUX, this, args)
+
+/* demux read timeout, only limits the reaction time on stopFiller() */
+#define DMX_POLL_MS 100
+
+RingBuffer::RingBuffer(size_t size)
+{
+	mRead = mWrite = mFill = 0;
+	mStopped = false;
+	mWriteValid = mReadValid = false;
+	mBuf.resize(size);
+}
+
+RingBuffer::~RingBuffer()
+{
+	stop();
+}
+
+void RingBuffer::resize(size_t size)
+{
+	mLock.lock();
+	mBuf.resize(size);
+	mRead = mWrite = mFill = 0;
+	mWriteValid = mReadValid = false;
+	mSpaceCond.broadcast();
+	mLock.unlock();
+}
+
+void RingBuffer::flush()
+{
+	mLock.lock();
+	mRead = mWrite = mFill = 0;
+	mWriteValid = mReadValid = false;
+	mSpaceCond.broadcast();
+	mLock.unlock();
+}
+
+size_t RingBuffer::fill()
+{
+	mLock.lock();
+	size_t ret = mFill;
+	mLock.unlock();
+	return ret;
+}
+
+void RingBuffer::start()
+{
+	mLock.lock();
+	mStopped = false;
+	mLock.unlock();
+}
+
+void RingBuffer::stop()
+{
+	mLock.lock();
+	mStopped = true;
+	mDataCond.broadcast();
+	mSpaceCond.broadcast();
+	mLock.unlock();
+}
+
+uint8_t *RingBuffer::writeSpan(size_t &len, bool wait)
+{
+	uint8_t *ret = NULL;
+	mLock.lock();
+	while (wait && !mStopped && mFill == mBuf.size())
+		mSpaceCond.wait(&mLock);
+	len = 0;
+	if (!mStopped && mFill < mBuf.size()) {
+		len = mBuf.size() - mFill;
+		if (len > mBuf.size() - mWrite)	/* only up to the wrap point */
+			len = mBuf.size() - mWrite;
+		ret = &mBuf[mWrite];
+		mWriteValid = true;
+	}
+	mLock.unlock();
+	return ret;
+}
+
+bool RingBuffer::commit(size_t len)
+{
+	mLock.lock();
+	bool ret = mWriteValid;
+	if (ret) {
+		mWrite = (mWrite + len) % mBuf.size();
+		mFill += len;
+		mDataCond.signal();
+	}
+	mWriteValid = false;
+	mLock.unlock();
+	return ret;
+}
+
+const uint8_t *RingBuffer::readSpan(size_t &len, bool wait)
+{
+	const uint8_t *ret = NULL;
+	mLock.lock();
+	while (wait && !mStopped && mFill == 0)
+		mDataCond.wait(&mLock);
+	len = 0;
+	if (!mStopped && mFill > 0) {
+		len = mFill;
+		if (len > mBuf.size() - mRead)
+			len = mBuf.size() - mRead;
+		ret = &mBuf[mRead];
+		mReadValid = true;
+	}
+	mLock.unlock();
+	return ret;
+}
+
+bool RingBuffer::consume(size_t len)
+{
+	mLock.lock();
+	bool ret = mReadValid;
+	if (ret) {
+		mRead = (mRead + len) % mBuf.size();
+		mFill -= len;
+		mSpaceCond.signal();
+	}
+	mReadValid = false;
+	mLock.unlock();
+	return ret;
+}
+
+size_t RingBuffer::write(const uint8_t *data, size_t len, bool wait)
+{
+	size_t done = 0;
+	while (done < len) {
+		size_t n;
+		uint8_t *p = writeSpan(n, wait);
+		if (!p)
+			break;
+		if (n > len - done)
+			n = len - done;
+		memcpy(p, data + done, n);
+		if (commit(n))
+			done += n;
+	}
+	return done;
+}
+
+size_t RingBuffer::read(uint8_t *buf, size_t len, bool wait)
+{
+	size_t n;
+	const uint8_t *p = readSpan(n, wait);
+	if (!p)
+		return 0;
+	if (n > len)
+		n = len;
+	memcpy(buf, p, n);
+	if (!consume(n))
+		return 0;
+	return n;
+}
+
+void DmxRingBuffer::startFiller(cDemux *dmx)
+{
+	if (mRunning)
+		stopFiller();
+	mDmx = dmx;
+	flush();
+	start();
+	mRunning = true;
+	Thread::startThread();
+}
+
+void DmxRingBuffer::stopFiller()
+{
+	if (!mRunning)
+		return;
+	mRunning = false;
+	stop();
+	Thread::joinThread();
+}
+
+void DmxRingBuffer::run()
+{
+	lt_debug("%s: start, size %zu\n", __func__, size());
+	hal_set_threadname("hal:dmxbuf");
+	while (mRunning) {
+		size_t len;
+		uint8_t *p = writeSpan(len);
+		if (!p) /* stopped */
+			break;
+		/* the demux reads directly into the ring, no bounce buffer */
+		int ret = mDmx ? mDmx->Read(p, len, DMX_POLL_MS) : -1;
+		if (ret > 0)
+			commit(ret);
+		else if (ret < 0)
+			usleep(DMX_POLL_MS * 1000);
+	}
+	lt_debug("%s: end\n", __func__);
+}
+
+/* static */ int DmxRingBuffer::avio_read(void *opaque, uint8_t *buf, int buf_size)
+{
+	DmxRingBuffer *r = (DmxRingBuffer *)opaque;
+	/* blocks until the filler committed data, at most one contiguous span
+	 * is handed out per call, libavformat will simply call again */
+	int ret = r->read(buf, buf_size);
+	if (ret == 0)
+		return AVERROR_EOF;
+	return ret;
+}
@@ -0,0 +1,97 @@
+/*
+ * (C) 2026 libstb-hal contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * single producer / single consumer byte ring buffer.
+ * producer and consumer work on contiguous spans inside the ring, so
+ * data can be read / written in place without bounce buffers.
+ */
+
+#ifndef __RINGBUFFER_H
+#define __RINGBUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <thread_abstraction.h>
+#include <mutex_abstraction.h>
+#include <condition_abstraction.h>
+
+class cDemux;
+
+class RingBuffer
+{
+public:
+	RingBuffer(size_t size = 0);
+	virtual ~RingBuffer();
+
+	void resize(size_t size);	/* drops contents */
+	void flush();			/* drops contents, keeps size */
+
+	/* producer side: get contiguous free space, fill it, then commit().
+	 * with wait == true, blocks until there is free space or stop() is called.
+	 * commit() / consume() return false if a flush() came in between, the
+	 * span is then discarded */
+	uint8_t *writeSpan(size_t &len, bool wait = true);
+	bool commit(size_t len);
+	/* copying convenience function, returns the number of bytes written */
+	size_t write(const uint8_t *data, size_t len, bool wait = true);
+
+	/* consumer side: get contiguous readable data, use it, then consume().
+	 * with wait == true, blocks until data is available or stop() is called */
+	const uint8_t *readSpan(size_t &len, bool wait = true);
+	bool consume(size_t len);
+	/* copies at most one contiguous span into buf, returns 0 if stopped */
+	size_t read(uint8_t *buf, size_t len, bool wait = true);
+
+	size_t size() { return mBuf.size(); }
+	size_t fill();
+
+	void start();			/* (re)arm after stop() */
+	void stop();			/* wake up all waiters, make them return */
+	bool stopped() { return mStopped; }
+
+protected:
+	std::vector<uint8_t> mBuf;
+	size_t mRead;			/* consumer position */
+	size_t mWrite;			/* producer position */
+	size_t mFill;
+	bool mStopped;
+	bool mWriteValid;		/* no flush() since writeSpan() */
+	bool mReadValid;		/* no flush() since readSpan() */
+	Mutex mLock;
+	Condition mDataCond;		/* signalled on commit() */
+	Condition mSpaceCond;		/* signalled on consume() */
+};
+
+/* ring buffer filled from a cDemux by its own thread */
+class DmxRingBuffer : public RingBuffer, public Thread
+{
+public:
+	DmxRingBuffer(size_t size) : RingBuffer(size), mDmx(NULL), mRunning(false) {}
+	~DmxRingBuffer() { stopFiller(); }
+
+	void startFiller(cDemux *dmx);
+	void stopFiller();
+
+	/* AVIOContext read_packet callback, opaque is the DmxRingBuffer */
+	static int avio_read(void *opaque, uint8_t *buf, int buf_size);
+private:
+	void run();
+	cDemux *mDmx;
+	bool mRunning;
+};
+
+#endif
@@ -24,6 +24,7 @@
  */
 
 #include <unistd.h>
+#include <sys/stat.h>
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
@@ -36,12 +37,19 @@ extern "C" {
 
 /* ffmpeg buf 32k */
 #define INBUF_SIZE 0x8000
-/* my own buf 256k */
+/* demux ring buffer 128k */
 #define DMX_BUF_SZ 0x20000
+/* decoded stills are kept in memory, neutrino shows the same radio and
+ * background pictures over and over again.
+ * export HAL_STILL_CACHE_MB=<n> to change the cache size, 0 disables it */
+#define STILL_CACHE_MB 64
 
 #include "video_lib.h"
 #include "dmx_lib.h"
+#include "ringbuffer.h"
 #include "glfb.h"
+#include "framestats.h"
+#include "faststart.h"
 #include "lt_debug.h"
 #define lt_debug(args...) _lt_debug(TRIPLE_DEBUG_VIDEO, this, args)
 #define lt_info(args...) _lt_info(TRIPLE_DEBUG_VIDEO, this, args)
@@ -54,8 +62,7 @@ int system_rev = 0;
 
 extern bool HAL_nodec;
 
-static uint8_t *dmxbuf;
-static int bufpos;
+static DmxRingBuffer *dmxbuf = NULL;
 
 static const AVRational aspect_ratios[6] = {
 	{  1, 1 },
@@ -71,8 +78,7 @@ cVideo::cVideo(int, void *, void *, unsigned int)
 	lt_debug("%s\n", __func__);
 	av_register_all();
 	if (!HAL_nodec)
-		dmxbuf = (uint8_t *)malloc(DMX_BUF_SZ);
-	bufpos = 0;
+		dmxbuf = new DmxRingBuffer(DMX_BUF_SZ);
 	thread_running = false;
 	w_h_changed = false;
 	dec_w = dec_h = 0;
@@ -86,11 +92,25 @@ cVideo::cVideo(int, void *, void *, unsigned int)
 	v_format = VIDEO_FORMAT_MPEG2;
 	output_h = 0;
 	stillpicture = false;
+	prefetcher = NULL;
+	still_cache_size = 0;
+	still_cache_max = STILL_CACHE_MB << 20;
+	const char *tmp = getenv("HAL_STILL_CACHE_MB");
+	if (tmp) {
+		int mb = atoi(tmp);	/* garbage or < 0: 0, no cache */
+		still_cache_max = (size_t)(mb > 0 ? mb : 0) << 20;
+	}
 }
 
 cVideo::~cVideo(void)
 {
 	Stop();
+	if (prefetcher) {
+		prefetcher->stop();
+		delete prefetcher;
+	}
+	delete dmxbuf;
+	dmxbuf = NULL;
 	/* ouch :-( */
 	videoDecoder = NULL;
 }
@@ -141,11 +161,36 @@ int cVideo::setCroppingMode(int)
 	return 0;
 }
 
+/* for the zap time log */
+static int64_t zap_start = 0;
+
+static enum AVCodecID codec_from_format(VIDEO_FORMAT f)
+{
+	switch (f) {
+		case VIDEO_FORMAT_MPEG2:	return AV_CODEC_ID_MPEG2VIDEO;
+		case VIDEO_FORMAT_MPEG4_H264:	return AV_CODEC_ID_H264;
+		case VIDEO_FORMAT_MPEG4_H265:	return AV_CODEC_ID_HEVC;
+		case VIDEO_FORMAT_VC1:		return AV_CODEC_ID_VC1;
+		case VIDEO_FORMAT_AVS:		return AV_CODEC_ID_CAVS;
+		default:			return AV_CODEC_ID_NONE;
+	}
+}
+
 int cVideo::Start(void *, unsigned short, unsigned short, void *)
 {
 	lt_debug("%s running %d >\n", __func__, thread_running);
-	if (!thread_running && !HAL_nodec)
+	if (!thread_running && !HAL_nodec) {
+		if (!videoDemux || videoDemux->getPesPid() < 0) {
+			/* radio: there is no video PID, so don't run the probe loop on an
+			 * empty stream. Audio plays on its own clock, the GL thread
+			 * only wakes up for OSD changes and stills */
+			lt_info("%s: no video pid, audio only\n", __func__);
+			return 0;
+		}
+		zap_start = hal_time_us();
+		dmxbuf->startFiller(videoDemux);
 		Thread::startThread();
+	}
 	lt_debug("%s running %d <\n", __func__, thread_running);
 	return 0;
 }
@@ -153,6 +198,8 @@ int cVideo::Start(void *, unsigned short, unsigned short, void *)
 int cVideo::Stop(bool)
 {
 	lt_debug("%s running %d >\n", __func__, thread_running);
+	if (dmxbuf)
+		dmxbuf->stopFiller(); /* wakes up the decoder if it waits for data */
 	if (thread_running) {
 		thread_running = false;
 		Thread::joinThread();
@@ -227,32 +274,40 @@ void cVideo::SetVideoMode(analog_mode_t)
 {
 }
 
-void cVideo::ShowPicture(const char *fname)
+class StillPrefetcher : public Thread
 {
-	lt_info("%s(%s)\n", __func__, fname);
-	if (access(fname, R_OK))
-		return;
-	still_m.lock();
-	stillpicture = true;
-	buf_num = 0;
-	buf_in = 0;
-	buf_out = 0;
-	still_m.unlock();
+public:
+	StillPrefetcher(cVideo *v, const std::vector<std::string> &f) : vdec(v), files(f), running(true) {}
+	void stop() { running = false; Thread::joinThread(); }
+private:
+	void run()
+	{
+		hal_set_threadname("hal:stillcache");
+		for (std::vector<std::string>::iterator it = files.begin(); running && it != files.end(); ++it)
+			vdec->cacheStill(it->c_str());
+	}
+	cVideo *vdec;
+	std::vector<std::string> files;
+	bool running;
+};
 
+bool cVideo::decodeStill(const char *fname, SWFramebuffer &f)
+{
 	unsigned int i;
 	int stream_id = -1;
 	int got_frame = 0;
 	int len;
+	bool ret = false;
 	AVFormatContext *avfc = NULL;
 	AVCodecContext *c = NULL;
 	AVCodecParameters *p = NULL;
 	AVCodec *codec;
-	AVFrame *frame, *rgbframe;
+	AVFrame *frame = NULL, *rgbframe = NULL;
 	AVPacket avpkt;
 
 	if (avformat_open_input(&avfc, fname, NULL, NULL) < 0) {
 		lt_info("%s: Could not open file %s\n", __func__, fname);
-		return;
+		return false;
 	}
 
 	if (avformat_find_stream_info(avfc, NULL) < 0) {
@@ -272,7 +327,7 @@ void cVideo::ShowPicture(const char *fname)
 	c = avcodec_alloc_context3(codec);
 	if (avcodec_open2(c, codec, NULL) < 0) {
 		lt_info("%s: Could not find/open the codec, id 0x%x\n", __func__, p->codec_id);
-		goto out_close;
+		goto out_free;
 	}
 	frame = av_frame_alloc();
 	rgbframe = av_frame_alloc();
@@ -301,30 +356,19 @@ void cVideo::ShowPicture(const char *fname)
 		if (!convert)
 			lt_info("%s: ERROR setting up SWS context\n", __func__);
 		else {
-			buf_m.lock();
-			SWFramebuffer *f = &buffers[buf_in];
-			if (f->size() < need)
-				f->resize(need);
-			av_image_fill_arrays(rgbframe->data, rgbframe->linesize, &(*f)[0], AV_PIX_FMT_RGB32,
+			f.resize(need);
+			av_image_fill_arrays(rgbframe->data, rgbframe->linesize, &f[0], AV_PIX_FMT_RGB32,
 					c->width, c->height, 1);
 			sws_scale(convert, frame->data, frame->linesize, 0, c->height,
 					rgbframe->data, rgbframe->linesize);
 			sws_freeContext(convert);
-			f->width(c->width);
-			f->height(c->height);
-			f->pts(AV_NOPTS_VALUE);
+			f.width(c->width);
+			f.height(c->height);
+			f.pts(AV_NOPTS_VALUE);
 			AVRational a = av_guess_sample_aspect_ratio(avfc, avfc->streams[stream_id], frame);
-			f->AR(a);
-			buf_in++;
-			buf_in %= VDEC_MAXBUFS;
-			buf_num++;
-			if (buf_num > (VDEC_MAXBUFS - 1)) {
-				lt_info("%s: buf_num overflow\n", __func__);
-				buf_out++;
-				buf_out %= VDEC_MAXBUFS;
-				buf_num--;
-			}
-			buf_m.unlock();
+			f.AR(a);
+			f.dectime(0);
+			ret = true;
 		}
 	}
 	av_packet_unref(&avpkt);
@@ -335,6 +379,123 @@ void cVideo::ShowPicture(const char *fname)
 	av_frame_free(&rgbframe);
  out_close:
 	avformat_close_input(&avfc);
+	return ret;
+}
+
+/* copies the cached still into f, if it is there and still up to date */
+bool cVideo::getCachedStill(const char *fname, time_t mtime, SWFramebuffer &f)
+{
+	bool ret = false;
+	still_cache_m.lock();
+	for (std::list<StillEntry>::iterator it = still_cache.begin(); it != still_cache.end(); ++it) {
+		if (it->path != fname || it->fmt != AV_PIX_FMT_RGB32)
+			continue;
+		if (it->mtime != mtime) { /* file was changed */
+			still_cache_size -= it->frame.size();
+			still_cache.erase(it);
+			break;
+		}
+		still_cache.splice(still_cache.begin(), still_cache, it); /* most recently used */
+		f = it->frame;
+		ret = true;
+		break;
+	}
+	still_cache_m.unlock();
+	return ret;
+}
+
+void cVideo::putCachedStill(const char *fname, time_t mtime, const SWFramebuffer &f)
+{
+	if (f.size() > still_cache_max)
+		return;
+	still_cache_m.lock();
+	for (std::list<StillEntry>::iterator it = still_cache.begin(); it != still_cache.end(); ++it) {
+		if (it->path == fname && it->fmt == AV_PIX_FMT_RGB32) {
+			still_cache_size -= it->frame.size();
+			still_cache.erase(it);
+			break;
+		}
+	}
+	while (!still_cache.empty() && still_cache_size + f.size() > still_cache_max) {
+		still_cache_size -= still_cache.back().frame.size();
+		still_cache.pop_back();
+	}
+	still_cache.push_front(StillEntry());
+	StillEntry &e = still_cache.front();
+	e.path = fname;
+	e.mtime = mtime;
+	e.fmt = AV_PIX_FMT_RGB32;
+	e.frame = f;
+	still_cache_size += f.size();
+	lt_debug("%s: %s cached, %zu stills, %zu bytes\n", __func__, fname, still_cache.size(), still_cache_size);
+	still_cache_m.unlock();
+}
+
+void cVideo::cacheStill(const char *fname)
+{
+	struct stat st;
+	if (stat(fname, &st))
+		return;
+	SWFramebuffer pic;
+	if (getCachedStill(fname, st.st_mtime, pic))
+		return;
+	if (decodeStill(fname, pic))
+		putCachedStill(fname, st.st_mtime, pic);
+}
+
+void cVideo::PrefetchPictures(const std::vector<std::string> &fnames)
+{
+	lt_info("%s: %zu files\n", __func__, fnames.size());
+	if (prefetcher) {
+		prefetcher->stop();
+		delete prefetcher;
+	}
+	prefetcher = new StillPrefetcher(this, fnames);
+	prefetcher->startThread();
+}
+
+void cVideo::ShowPicture(const char *fname)
+{
+	lt_info("%s(%s)\n", __func__, fname);
+	struct stat st;
+	if (access(fname, R_OK) || stat(fname, &st))
+		return;
+	still_m.lock();
+	stillpicture = true;
+	buf_num = 0;
+	buf_in = 0;
+	buf_out = 0;
+	still_m.unlock();
+
+	buf_m.lock();
+	/* cache hit: copy straight into the output buffer */
+	bool cached = getCachedStill(fname, st.st_mtime, buffers[buf_in]);
+	buf_m.unlock();
+	if (cached)
+		lt_debug("%s: %s from cache\n", __func__, fname);
+	else {
+		SWFramebuffer pic;
+		if (!decodeStill(fname, pic))
+			return;
+		putCachedStill(fname, st.st_mtime, pic);
+		buf_m.lock();
+		buffers[buf_in] = pic;
+		buf_m.unlock();
+	}
+
+	buf_m.lock();
+	buffers[buf_in].queued(hal_time_us());
+	buf_in++;
+	buf_in %= VDEC_MAXBUFS;
+	buf_num++;
+	if (buf_num > (VDEC_MAXBUFS - 1)) {
+		lt_info("%s: buf_num overflow\n", __func__);
+		buf_out++;
+		buf_out %= VDEC_MAXBUFS;
+		buf_num--;
+	}
+	buf_m.unlock();
+	glfb->wakeup();
 	lt_debug("%s(%s) end\n", __func__, fname);
 }
 
@@ -420,30 +581,6 @@ cVideo::SWFramebuffer *cVideo::getDecBuf(void)
 	return p;
 }
 
-static int my_read(void *, uint8_t *buf, int buf_size)
-{
-	int tmp = 0;
-	if (videoDecoder && bufpos < DMX_BUF_SZ - 4096) {
-		while (bufpos < buf_size && ++tmp < 20) { /* retry max 20 times */
-			int ret = videoDemux->Read(dmxbuf + bufpos, DMX_BUF_SZ - bufpos, 20);
-			if (ret > 0)
-				bufpos += ret;
-		}
-	}
-	if (bufpos == 0)
-		return 0;
-	if (bufpos > buf_size) {
-		memcpy(buf, dmxbuf, buf_size);
-		memmove(dmxbuf, dmxbuf + buf_size, bufpos - buf_size);
-		bufpos -= buf_size;
-		return buf_size;
-	}
-	memcpy(buf, dmxbuf, bufpos);
-	tmp = bufpos;
-	bufpos = 0;
-	return tmp;
-}
-
 void cVideo::run(void)
 {
 	lt_info("====================== start decoder thread ================================\n");
@@ -460,24 +597,36 @@ void cVideo::run(void)
 	time_t warn_r = 0; /* last read error */
 	time_t warn_d = 0; /* last decode error */
 
-	bufpos = 0;
 	buf_num = 0;
 	buf_in = 0;
 	buf_out = 0;
 	dec_r = 0;
 
+	/* fast start: take the codec from SetStreamType() or from the last
+	 * decode of this PID instead of waiting for libavformat to probe */
+	bool fast = faststart_enabled();
+	int key = faststart_key(videoDemux ? videoDemux->getPesPid() : -1);
+	enum AVCodecID id = fast ? codec_from_format(v_format) : AV_CODEC_ID_NONE;
+	AVCodecParameters *cached = avcodec_parameters_alloc();
+	bool have_cached = fast && cached && faststart_lookup(key, id, cached);
+	bool first = true;
+	if (have_cached && id == AV_CODEC_ID_NONE)
+		id = cached->codec_id;
+
 	av_init_packet(&avpkt);
 	inp = av_find_input_format("mpegts");
 	AVIOContext *pIOCtx = avio_alloc_context(inbuf, INBUF_SIZE, // internal Buffer and its size
 			0,		// bWriteable (1=true,0=false)
-			NULL,		// user data; will be passed to our callback functions
-			my_read,	// read callback
+			dmxbuf,		// user data; will be passed to our callback functions
+			DmxRingBuffer::avio_read,	// read callback
 			NULL,		// write callback
 			NULL);		// seek callback
 	avfc = avformat_alloc_context();
 	avfc->pb = pIOCtx;
 	avfc->iformat = inp;
 	avfc->probesize = 188*5;
+	if (fast)
+		faststart_setup(avfc);
 
 	thread_running = true;
 	if (avformat_open_input(&avfc, NULL, inp, NULL) < 0) {
@@ -498,12 +647,22 @@ void cVideo::run(void)
 	if (p->codec_type != AVMEDIA_TYPE_VIDEO)
 		lt_info("%s: no video codec? 0x%x\n", __func__, p->codec_type);
 
-	codec = avcodec_find_decoder(p->codec_id);
+	if (id == AV_CODEC_ID_NONE)
+		id = p->codec_id;
+	else if (id != p->codec_id && p->codec_id != AV_CODEC_ID_NONE) {
+		/* the stream type from zapit was wrong, trust the demuxer */
+		lt_info("%s: hint %s ignored, probed %s\n", __func__, avcodec_get_name(id), avcodec_get_name(p->codec_id));
+		id = p->codec_id;
+	}
+	codec = avcodec_find_decoder(id);
 	if (!codec) {
-		lt_info("%s: Codec for %s not found\n", __func__, avcodec_get_name(p->codec_id));
+		lt_info("%s: Codec for %s not found\n", __func__, avcodec_get_name(id));
 		goto out;
 	}
 	c = avcodec_alloc_context3(codec);
+	/* extradata and dimensions of the last decode, if it was the same codec */
+	if (have_cached && cached->codec_id == codec->id)
+		avcodec_parameters_to_context(c, cached);
 	if (avcodec_open2(c, codec, NULL) < 0) {
 		lt_info("%s: Could not open codec\n", __func__);
 		goto out;
@@ -525,6 +684,7 @@ void cVideo::run(void)
 			continue;
 		}
 		int got_frame = 0;
+		int64_t t_dec = hal_time_us();
 		int len = avcodec_decode_video2(c, frame, &got_frame, &avpkt);
 		if (len < 0) {
 			if (warn_d - time(NULL) > 4) {
@@ -571,6 +731,8 @@ void cVideo::run(void)
 				f->pts(vpts);
 				AVRational a = av_guess_sample_aspect_ratio(avfc, avfc->streams[0], frame);
 				f->AR(a);
+				f->queued(hal_time_us());
+				f->dectime(f->queued() - t_dec);
 				buf_in++;
 				buf_in %= VDEC_MAXBUFS;
 				buf_num++;
@@ -582,6 +744,13 @@ void cVideo::run(void)
 				}
 				dec_r = c->time_base.den/(c->time_base.num * c->ticks_per_frame);
 				buf_m.unlock();
+				glfb->wakeup();
+				if (first) {
+					first = false;
+					lt_info("%s: first frame %dx%d after %" PRId64 " ms\n", __func__,
+						c->width, c->height, (hal_time_us() - zap_start) / 1000);
+					faststart_store(key, c);
+				}
 			}
 			lt_debug("%s: time_base: %d/%d, ticks: %d rate: %d pts 0x%" PRIx64 "\n", __func__,
 					c->time_base.num, c->time_base.den, c->ticks_per_frame, dec_r,
@@ -601,8 +770,8 @@ void cVideo::run(void)
 	avformat_close_input(&avfc);
 	av_free(pIOCtx->buffer);
 	av_free(pIOCtx);
+	avcodec_parameters_free(&cached);
 	/* reset output buffers */
-	bufpos = 0;
 	still_m.lock();
 	if (!stillpicture) {
 		buf_num = 0;
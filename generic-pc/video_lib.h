@@ -4,6 +4,9 @@
 #include <thread_abstraction.h>
 #include <mutex_abstraction.h>
 #include <vector>
+#include <list>
+#include <string>
+#include <time.h>
 #include <linux/dvb/video.h>
 #include "../common/cs_types.h"
 #include "dmx_lib.h"
@@ -121,29 +124,37 @@ typedef enum
 
 
 #define VDEC_MAXBUFS 0x30
+class StillPrefetcher;
 class cVideo : public Thread
 {
 	friend class GLFramebuffer;
 	friend class cDemux;
+	friend class StillPrefetcher;
 	private:
 		/* called from GL thread */
 		class SWFramebuffer : public std::vector<unsigned char>
 		{
 		public:
-			SWFramebuffer() : mWidth(0), mHeight(0) {}
+			SWFramebuffer() : mWidth(0), mHeight(0), mDecTime(0), mQueued(0) {}
 			void width(int w) { mWidth = w; }
 			void height(int h) { mHeight = h; }
 			void pts(uint64_t p) { mPts = p; }
 			void AR(AVRational a) { mAR = a; }
+			void dectime(int us) { mDecTime = us; }
+			void queued(int64_t t) { mQueued = t; }
 			int width() const { return mWidth; }
 			int height() const { return mHeight; }
 			int64_t pts() const { return mPts; }
 			AVRational AR() const { return mAR; }
+			int dectime() const { return mDecTime; }
+			int64_t queued() const { return mQueued; }
 		private:
 			int mWidth;
 			int mHeight;
 			int64_t mPts;
 			AVRational mAR;
+			int mDecTime;		/* us spent decoding and converting */
+			int64_t mQueued;	/* hal_time_us() when it was queued */
 		};
 		int buf_in, buf_out, buf_num;
 		int64_t GetPTS(void);
@@ -181,6 +192,8 @@ class cVideo : public Thread
 
 		int SetStreamType(VIDEO_FORMAT type);
 		void ShowPicture(const char * fname);
+		/* decode stills into the ShowPicture() cache in the background */
+		void PrefetchPictures(const std::vector<std::string> &fnames);
 
 		void SetSyncMode(AVSYNC_TYPE mode);
 		bool SetCECMode(VIDEO_HDMI_CEC_MODE) { return true; };
@@ -223,6 +236,22 @@ class cVideo : public Thread
 		bool pig_changed;
 		Mutex still_m;
 		bool stillpicture;
+		/* LRU cache of converted stills, most recently used first */
+		struct StillEntry {
+			std::string path;
+			time_t mtime;
+			int fmt;		/* AVPixelFormat of frame */
+			SWFramebuffer frame;
+		};
+		std::list<StillEntry> still_cache;
+		size_t still_cache_size;	/* bytes */
+		size_t still_cache_max;
+		Mutex still_cache_m;
+		StillPrefetcher *prefetcher;
+		bool decodeStill(const char *fname, SWFramebuffer &f);
+		bool getCachedStill(const char *fname, time_t mtime, SWFramebuffer &f);
+		void putCachedStill(const char *fname, time_t mtime, const SWFramebuffer &f);
+		void cacheStill(const char *fname);
 };
 
 #endif
@@ -0,0 +1,148 @@
+/*
+ * playback statistics, filled by the players for cPlayback::GetStatistics()
+ * part of libstb-hal
+ *
+ * License: GPL v2 or later
+ */
+#ifndef __PLAYBACK_STATS_H__
+#define __PLAYBACK_STATS_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bucket n counts device writes that took less than 2^n ms,
+ * the last one all longer ones */
+#define PLAYBACK_STATS_LATENCY_BUCKETS	10
+
+/* pts jumps larger than this (90kHz) count as gap resp. discontinuity */
+#define PLAYBACK_STATS_PTS_GAP		90000
+
+enum
+{
+	PLAYBACK_STATS_VIDEO,
+	PLAYBACK_STATS_AUDIO,
+	PLAYBACK_STATS_STREAMS
+};
+
+typedef struct
+{
+	uint64_t packets;		/* written to the device */
+	uint64_t bytes;
+	uint64_t write_errors;
+	uint32_t write_latency[PLAYBACK_STATS_LATENCY_BUCKETS];
+	uint32_t write_latency_max;	/* us */
+	uint64_t blocked_us;		/* waited for the device to take data */
+	uint64_t blocked;		/* writes that had to wait */
+	uint64_t pts_gaps;		/* pts jumped ahead */
+	uint64_t pts_discontinuities;	/* pts went back */
+	uint64_t queued_packets;	/* demuxed, not written yet */
+	uint64_t queued_bytes;
+} playback_stream_stats_t;
+
+typedef struct
+{
+	uint64_t read_bytes;		/* input, since the start */
+	uint32_t bitrate_1s;		/* input bits/s, last second */
+	uint32_t bitrate_10s;		/* ... averaged over the last 10 s */
+	uint32_t bitrate_60s;		/* ... and the last minute */
+	int64_t buffered_bytes;		/* read ahead of the demuxer, -1 without buffer */
+	int64_t buffer_size;
+	int32_t buffer_empty_ms;	/* until the buffer runs empty, -1 if it is not draining */
+	playback_stream_stats_t stream[PLAYBACK_STATS_STREAMS];
+	uint32_t seeks;
+	uint32_t seek_latency_last;	/* ms from the request to the first write after it */
+	uint32_t seek_latency_max;
+} playback_stats_t;
+
+static inline int playback_stats_latency_bucket(int64_t usec)
+{
+	int b = 0;
+	while (b < PLAYBACK_STATS_LATENCY_BUCKETS - 1 && usec >= (1000LL << b))
+		b++;
+	return b;
+}
+
+/* The accounting below is shared by libeplayer3 and libeplayer3-arm,
+ * the callers do the locking. */
+
+#define PLAYBACK_STATS_WINDOW	61	/* one second slots, the current one and the last minute */
+
+/* input bitrate: bytes read per second, ring */
+typedef struct
+{
+	uint64_t slot[PLAYBACK_STATS_WINDOW];
+	int64_t newest;			/* second of the newest slot */
+	int64_t start;
+} playback_stats_window_t;
+
+static inline void playback_stats_window_reset(playback_stats_window_t *w, int64_t sec)
+{
+	memset(w->slot, 0, sizeof(w->slot));
+	w->newest = w->start = sec;
+}
+
+/* moves the newest slot to sec, clearing the skipped ones */
+static inline void playback_stats_window_advance(playback_stats_window_t *w, int64_t sec)
+{
+	int64_t i;
+	if (sec - w->newest >= PLAYBACK_STATS_WINDOW)
+		memset(w->slot, 0, sizeof(w->slot));
+	else
+		for (i = w->newest + 1; i <= sec; i++)
+			w->slot[i % PLAYBACK_STATS_WINDOW] = 0;
+	if (sec > w->newest)
+		w->newest = sec;
+}
+
+static inline void playback_stats_window_add(playback_stats_window_t *w, int64_t sec, uint64_t bytes)
+{
+	playback_stats_window_advance(w, sec);
+	w->slot[sec % PLAYBACK_STATS_WINDOW] += bytes;
+}
+
+/* bits/s averaged over the last complete seconds */
+static inline uint32_t playback_stats_window_bitrate(const playback_stats_window_t *w, int64_t now, int seconds)
+{
+	uint64_t bytes = 0;
+	int i;
+	if (seconds > now - w->start)
+		seconds = now - w->start;
+	if (seconds < 1)
+		return 0;
+	for (i = 1; i <= seconds; i++)
+		bytes += w->slot[(now - i) % PLAYBACK_STATS_WINDOW];
+	return bytes * 8 / seconds;
+}
+
+/* a successful device write. last_pts: of the previous write of the
+ * stream, invalid_pts: the player's INVALID_PTS_VALUE */
+static inline void playback_stats_count_write(playback_stream_stats_t *st, int64_t *last_pts, int64_t invalid_pts,
+		uint64_t bytes, int64_t pts, int64_t usec)
+{
+	st->packets++;
+	st->bytes += bytes;
+	st->write_latency[playback_stats_latency_bucket(usec)]++;
+	if (usec > st->write_latency_max)
+		st->write_latency_max = usec;
+
+	/* video pts come in decode order, small steps back are normal */
+	if (pts != invalid_pts) {
+		if (*last_pts != invalid_pts) {
+			if (pts - *last_pts > PLAYBACK_STATS_PTS_GAP)
+				st->pts_gaps++;
+			else if (*last_pts - pts > PLAYBACK_STATS_PTS_GAP)
+				st->pts_discontinuities++;
+		}
+		*last_pts = pts;
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -24,6 +24,7 @@
 #include <vector>
 
 #include <config.h>
+#include <playback_stats.h>
 
 
 typedef enum
@@ -75,6 +76,7 @@ public:
 	bool SetSlow(int slow);
 	bool GetSpeed(int &speed) const;
 	bool GetPosition(int &position, int &duration);
+	bool GetStatistics(playback_stats_t &stats);
 	void GetPts(uint64_t &pts);
 	int GetAPid(void);
 	int GetVPid(void);
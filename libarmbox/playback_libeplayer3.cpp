@@ -707,13 +707,19 @@ bool cPlayback::IsPlaying()
 
 uint64_t cPlayback::GetReadCount()
 {
-	//if (player && player->playback)
-	//{
-	//	return player->playback->readCount;
-	//}
+	playback_stats_t stats;
+	if (GetStatistics(stats))
+		return stats.read_bytes;
 	return 0;
 }
 
+bool cPlayback::GetStatistics(playback_stats_t &stats)
+{
+	if (player && player->playback)
+		return player->playback->Command(player, PLAYBACK_STATS, &stats) == 0;
+	return false;
+}
+
 AVFormatContext *cPlayback::GetAVFormatContext()
 {
 	return NULL;
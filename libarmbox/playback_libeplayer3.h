@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <playback_stats.h>
 
 typedef enum
 {
@@ -58,6 +59,7 @@ class cPlayback
 		void RequestAbort(void);
 		bool IsPlaying(void);
 		uint64_t GetReadCount(void);
+		bool GetStatistics(playback_stats_t &stats);
 
 		void GetChapters(std::vector<int> &positions, std::vector<std::string> &titles);
 		void GetMetadata(std::vector<std::string> &keys, std::vector<std::string> &values);
@@ -0,0 +1,589 @@
+/*
+ * software audio decoding for the ffmpeg container
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+/* Tracks injected as pcm are decoded and resampled by a worker thread, so
+ * a heavy codec does not hold up demuxing and video injection. FFMPEGThread
+ * queues the compressed packets and writes the decoded pcm, with its pts,
+ * to the audio device; all device writes stay in one thread. If the worker
+ * can not be started, the packets are decoded in place as before.
+ */
+
+#define AUDIO_PACKETS_MAX 32 //compressed packets queued for the worker
+#define AUDIO_PCM_MAX (512 * 1024) //bytes of decoded pcm, the worker waits above
+
+typedef struct AudioPacket_s
+{
+	AVPacket packet;
+	AVCodecContext *c;
+	AVStream *stream;
+	uint32_t cAVIdx;
+	uint8_t restart; //resampling has to be set up again
+	pcmPrivateData_t extradata;
+	uint32_t generation;
+	struct AudioPacket_s *next;
+} AudioPacket_t;
+
+typedef struct AudioPcm_s
+{
+	uint8_t *data;
+	uint32_t size; //allocated, the buffer is kept when the chunk is recycled
+	int32_t len;
+	int64_t pts;
+	pcmPrivateData_t extradata;
+	struct AudioPcm_s *next;
+} AudioPcm_t;
+
+static pthread_t audioDecoderThread;
+static pthread_mutex_t audioDecoderMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t audioDecoderCond = PTHREAD_COND_INITIALIZER;
+static int32_t audioDecoderRunning = 0;
+static int32_t audioDecoderStop = 0;
+static int32_t audioDecoderBusy = 0; //decoding a packet outside the mutex
+static uint32_t audioDecoderGeneration = 0; //bumped by a flush, older output is dropped
+static AudioPacket_t *audioPacketHead = NULL;
+static AudioPacket_t *audioPacketTail = NULL;
+static int32_t audioPacketCount = 0;
+static AudioPcm_t *audioPcmHead = NULL;
+static AudioPcm_t *audioPcmTail = NULL;
+static int32_t audioPcmBytes = 0;
+/* written chunks and consumed packets are kept for reuse */
+static AudioPacket_t *audioPacketFree = NULL;
+static int32_t audioPacketFreeCount = 0;
+static AudioPcm_t *audioPcmFree = NULL;
+static int32_t audioPcmFreeCount = 0;
+
+/* decoder state, only used by whoever decodes: the worker or, without it, FFMPEGThread */
+static SwrContext *swr = NULL;
+static AVFrame *decoded_frame = NULL;
+static int32_t out_sample_rate = 44100;
+static int32_t out_channels = 2;
+static uint64_t out_channel_layout = AV_CH_LAYOUT_STEREO;
+static AVCodecContext *decoder_context = NULL;
+static uint32_t decoder_generation = 0;
+static uint8_t decoder_restart = 0;
+
+static void audio_decoder_reset()
+{
+	if (swr)
+	{
+		swr_free(&swr);
+		swr = NULL;
+	}
+	if (decoded_frame)
+	{
+		wrapped_frame_free(&decoded_frame);
+		decoded_frame = NULL;
+	}
+}
+
+/* mutex held */
+static void audio_packet_release(AudioPacket_t *item)
+{
+	wrapped_packet_unref(&item->packet);
+	if (audioPacketFreeCount < AUDIO_PACKETS_MAX)
+	{
+		item->next = audioPacketFree;
+		audioPacketFree = item;
+		audioPacketFreeCount += 1;
+	}
+	else
+	{
+		free(item);
+	}
+}
+
+/* mutex held */
+static void audio_pcm_release(AudioPcm_t *pcm)
+{
+	if (audioPcmFreeCount < AUDIO_PACKETS_MAX)
+	{
+		pcm->next = audioPcmFree;
+		audioPcmFree = pcm;
+		audioPcmFreeCount += 1;
+	}
+	else
+	{
+		av_freep(&pcm->data);
+		free(pcm);
+	}
+}
+
+/* a chunk with room for len bytes */
+static AudioPcm_t *audio_pcm_get(int32_t len)
+{
+	AudioPcm_t *pcm;
+	pthread_mutex_lock(&audioDecoderMutex);
+	pcm = audioPcmFree;
+	if (pcm)
+	{
+		audioPcmFree = pcm->next;
+		audioPcmFreeCount -= 1;
+	}
+	pthread_mutex_unlock(&audioDecoderMutex);
+	if (pcm == NULL)
+	{
+		pcm = calloc(1, sizeof(AudioPcm_t));
+		if (pcm == NULL)
+		{
+			return NULL;
+		}
+	}
+	av_fast_malloc(&pcm->data, &pcm->size, len);
+	if (pcm->data == NULL)
+	{
+		pcm->size = 0;
+		free(pcm);
+		return NULL;
+	}
+	return pcm;
+}
+
+/* mutex held */
+static void audio_queues_clear()
+{
+	while (audioPacketHead)
+	{
+		AudioPacket_t *item = audioPacketHead;
+		audioPacketHead = item->next;
+		audio_packet_release(item);
+	}
+	audioPacketTail = NULL;
+	audioPacketCount = 0;
+	while (audioPcmHead)
+	{
+		AudioPcm_t *pcm = audioPcmHead;
+		audioPcmHead = pcm->next;
+		audio_pcm_release(pcm);
+	}
+	audioPcmTail = NULL;
+	audioPcmBytes = 0;
+}
+
+/* mutex held */
+static void audio_pools_free()
+{
+	while (audioPacketFree)
+	{
+		AudioPacket_t *item = audioPacketFree;
+		audioPacketFree = item->next;
+		free(item);
+	}
+	audioPacketFreeCount = 0;
+	while (audioPcmFree)
+	{
+		AudioPcm_t *pcm = audioPcmFree;
+		audioPcmFree = pcm->next;
+		av_freep(&pcm->data);
+		free(pcm);
+	}
+	audioPcmFreeCount = 0;
+}
+
+/* queues decoded pcm, unless a flush came in meanwhile */
+static void audio_pcm_add(AudioPcm_t *pcm, int32_t len, int64_t pts, pcmPrivateData_t *extradata, uint32_t generation)
+{
+	pthread_mutex_lock(&audioDecoderMutex);
+	if (generation != audioDecoderGeneration)
+	{
+		audio_pcm_release(pcm);
+		pthread_mutex_unlock(&audioDecoderMutex);
+		return;
+	}
+	pcm->len = len;
+	pcm->pts = pts;
+	pcm->extradata = *extradata;
+	pcm->next = NULL;
+	if (audioPcmTail)
+	{
+		audioPcmTail->next = pcm;
+	}
+	else
+	{
+		audioPcmHead = pcm;
+	}
+	audioPcmTail = pcm;
+	audioPcmBytes += len;
+	pthread_cond_broadcast(&audioDecoderCond);
+	pthread_mutex_unlock(&audioDecoderMutex);
+}
+
+static void audio_decode_packet(AudioPacket_t *item)
+{
+	AVCodecContext *c = item->c;
+	AVPacket *packet = &item->packet;
+	pcmPrivateData_t pcmExtradata = item->extradata;
+	if (item->restart || c != decoder_context || item->generation != decoder_generation)
+	{
+		if (item->generation != decoder_generation && c == decoder_context)
+		{
+			avcodec_flush_buffers(c);
+		}
+		decoder_context = c;
+		decoder_generation = item->generation;
+		decoder_restart = 1;
+	}
+	if (decoder_restart)
+	{
+		decoder_restart = 0;
+		pcmExtradata.bResampling = 1;
+		audio_decoder_reset();
+	}
+#if (LIBAVFORMAT_VERSION_MAJOR > 57) || ((LIBAVFORMAT_VERSION_MAJOR == 57) && (LIBAVFORMAT_VERSION_MINOR > 32))
+	while (packet->size > 0 || (!packet->size && !packet->data))
+#else
+	while (packet->size > 0)
+#endif
+	{
+		if (__atomic_load_n(&audioDecoderGeneration, __ATOMIC_RELAXED) != item->generation)
+		{
+			break;
+		}
+		if (!decoded_frame)
+		{
+			decoded_frame = wrapped_frame_alloc();
+			if (!decoded_frame)
+			{
+				ffmpeg_err("out of memory\n");
+				exit(1);
+			}
+		}
+		else
+		{
+			wrapped_frame_unref(decoded_frame);
+		}
+#if (LIBAVFORMAT_VERSION_MAJOR > 57) || ((LIBAVFORMAT_VERSION_MAJOR == 57) && (LIBAVFORMAT_VERSION_MINOR > 32))
+		int ret = avcodec_send_packet(c, packet);
+		if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+		{
+			decoder_restart = 1;
+			break;
+		}
+		if (ret >= 0)
+		{
+			packet->size = 0;
+		}
+		ret = avcodec_receive_frame(c, decoded_frame);
+		if (ret < 0)
+		{
+			if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+			{
+				decoder_restart = 1;
+				break;
+			}
+			else
+			{
+				continue;
+			}
+		}
+#else
+		int32_t got_frame = 0;
+		int32_t len = avcodec_decode_audio4(c, decoded_frame, &got_frame, packet);
+		if (len < 0)
+		{
+			ffmpeg_err("avcodec_decode_audio4: %d\n", len);
+			break;
+		}
+		packet->data += len;
+		packet->size -= len;
+		if (!got_frame)
+		{
+			continue;
+		}
+#endif
+		int32_t e = 0;
+		if (!swr)
+		{
+			if (insert_pcm_as_lpcm)
+			{
+				out_sample_rate = 48000;
+			}
+			else
+			{
+				int32_t rates[] = { 48000, 96000, 192000, 44100, 88200, 176400, 0 };
+				int32_t *rate = rates;
+				int32_t in_rate = c->sample_rate;
+				while (*rate && ((*rate / in_rate) * in_rate != *rate) && (in_rate / *rate) * *rate != in_rate)
+				{
+					rate++;
+				}
+				out_sample_rate = *rate ? *rate : 44100;
+			}
+			swr = swr_alloc();
+			out_channels = c->channels;
+			if (c->channel_layout == 0)
+			{
+				c->channel_layout = av_get_default_channel_layout(c->channels);
+			}
+			out_channel_layout = c->channel_layout;
+			uint8_t downmix = stereo_software_decoder && out_channels > 2 ? 1 : 0;
+#ifdef __sh__
+			// player2 won't play mono
+			if (out_channel_layout == AV_CH_LAYOUT_MONO)
+			{
+				downmix = 1;
+			}
+#endif
+			if (downmix)
+			{
+				out_channel_layout = AV_CH_LAYOUT_STEREO_DOWNMIX;
+				out_channels = 2;
+			}
+			av_opt_set_int(swr, "in_channel_layout",    c->channel_layout,  0);
+			av_opt_set_int(swr, "out_channel_layout",   out_channel_layout, 0);
+			av_opt_set_int(swr, "in_sample_rate",       c->sample_rate,     0);
+			av_opt_set_int(swr, "out_sample_rate",      out_sample_rate,    0);
+			av_opt_set_int(swr, "in_sample_fmt",        c->sample_fmt,      0);
+			av_opt_set_int(swr, "out_sample_fmt",       AV_SAMPLE_FMT_S16,  0);
+			e = swr_init(swr);
+			if (e < 0)
+			{
+				ffmpeg_err("swr_init: %d (icl=%d ocl=%d isr=%d osr=%d isf=%d osf=%d\n",
+				           -e, (int32_t)c->channel_layout, (int32_t)out_channel_layout, c->sample_rate, out_sample_rate, c->sample_fmt, AV_SAMPLE_FMT_S16);
+				swr_free(&swr);
+				swr = NULL;
+			}
+		}
+		uint8_t *output[8] = {NULL};
+		int32_t in_samples = decoded_frame->nb_samples;
+		int32_t out_samples = av_rescale_rnd(swr_get_delay(swr, c->sample_rate) + in_samples, out_sample_rate, c->sample_rate, AV_ROUND_UP);
+		AudioPcm_t *pcm = audio_pcm_get(out_samples * sizeof(int16_t) * out_channels);
+		if (pcm == NULL)
+		{
+			ffmpeg_err("out of memory for %d samples\n", out_samples);
+			continue;
+		}
+		output[0] = pcm->data;
+		int64_t next_in_pts = av_rescale(av_frame_get_best_effort_timestamp(decoded_frame),
+		                                 item->stream->time_base.num * (int64_t)out_sample_rate * c->sample_rate,
+		                                 item->stream->time_base.den);
+		int64_t next_out_pts = av_rescale(swr_next_pts(swr, next_in_pts),
+		                                  item->stream->time_base.den,
+		                                  item->stream->time_base.num * (int64_t)out_sample_rate * c->sample_rate);
+		int64_t pts = calcPts(item->cAVIdx, item->stream, next_out_pts);
+		out_samples = swr_convert(swr, &output[0], out_samples, (const uint8_t **) &decoded_frame->data[0], in_samples);
+		//////////////////////////////////////////////////////////////////////
+		// Update pcmExtradata according to decode parameters
+		pcmExtradata.channels              = av_get_channel_layout_nb_channels(out_channel_layout);
+		pcmExtradata.bits_per_coded_sample = 16;
+		pcmExtradata.sample_rate           = out_sample_rate;
+		// The data described by the sample format is always in native-endian order
+#ifdef WORDS_BIGENDIAN
+		pcmExtradata.ffmpeg_codec_id       = AV_CODEC_ID_PCM_S16BE;
+#else
+		pcmExtradata.ffmpeg_codec_id       = AV_CODEC_ID_PCM_S16LE;
+#endif
+		//////////////////////////////////////////////////////////////////////
+		audio_pcm_add(pcm, out_samples * sizeof(int16_t) * out_channels, pts, &pcmExtradata, item->generation);
+	}
+}
+
+static void audio_decoder_thread(void *arg __attribute__((unused)))
+{
+	char threadname[17] = "audio_decoder";
+	prctl(PR_SET_NAME, (unsigned long)&threadname);
+	pthread_mutex_lock(&audioDecoderMutex);
+	while (!audioDecoderStop)
+	{
+		if (!audioPacketHead || audioPcmBytes >= AUDIO_PCM_MAX)
+		{
+			pthread_cond_wait(&audioDecoderCond, &audioDecoderMutex);
+			continue;
+		}
+		AudioPacket_t *item = audioPacketHead;
+		audioPacketHead = item->next;
+		if (!audioPacketHead)
+		{
+			audioPacketTail = NULL;
+		}
+		audioPacketCount -= 1;
+		audioDecoderBusy = 1;
+		pthread_cond_broadcast(&audioDecoderCond);
+		pthread_mutex_unlock(&audioDecoderMutex);
+
+		audio_decode_packet(item);
+
+		pthread_mutex_lock(&audioDecoderMutex);
+		audio_packet_release(item);
+		audioDecoderBusy = 0;
+		pthread_cond_broadcast(&audioDecoderCond);
+	}
+	pthread_mutex_unlock(&audioDecoderMutex);
+}
+
+static void audio_decoder_start()
+{
+	audioDecoderStop = 0;
+	if (pthread_create(&audioDecoderThread, NULL, (void *)&audio_decoder_thread, NULL) != 0)
+	{
+		ffmpeg_err("can not start the audio decoder thread, decoding in place\n");
+		audioDecoderRunning = 0;
+		return;
+	}
+	audioDecoderRunning = 1;
+}
+
+static void audio_decoder_stop()
+{
+	if (audioDecoderRunning)
+	{
+		pthread_mutex_lock(&audioDecoderMutex);
+		audioDecoderStop = 1;
+		pthread_cond_broadcast(&audioDecoderCond);
+		pthread_mutex_unlock(&audioDecoderMutex);
+		pthread_join(audioDecoderThread, NULL);
+		audioDecoderRunning = 0;
+	}
+	pthread_mutex_lock(&audioDecoderMutex);
+	audio_queues_clear();
+	audio_pools_free();
+	pthread_mutex_unlock(&audioDecoderMutex);
+	audio_decoder_reset();
+	decoder_context = NULL;
+}
+
+/* drops everything queued, returns once the worker does not decode anymore,
+ * so the codec context can be flushed */
+static void audio_decoder_flush()
+{
+	pthread_mutex_lock(&audioDecoderMutex);
+	__atomic_store_n(&audioDecoderGeneration, audioDecoderGeneration + 1, __ATOMIC_RELAXED);
+	audio_queues_clear();
+	while (audioDecoderBusy)
+	{
+		pthread_cond_wait(&audioDecoderCond, &audioDecoderMutex);
+	}
+	pthread_mutex_unlock(&audioDecoderMutex);
+}
+
+/* writes the decoded pcm to the audio device, in pts order */
+static void audio_decoder_write(Context_t *context)
+{
+	AudioPcm_t *pcm;
+	AudioPcm_t *written;
+	if (__atomic_load_n(&audioPcmHead, __ATOMIC_RELAXED) == NULL)
+	{
+		return;
+	}
+	pthread_mutex_lock(&audioDecoderMutex);
+	pcm = audioPcmHead;
+	audioPcmHead = audioPcmTail = NULL;
+	audioPcmBytes = 0;
+	pthread_cond_broadcast(&audioDecoderCond);
+	pthread_mutex_unlock(&audioDecoderMutex);
+	written = pcm;
+	while (pcm)
+	{
+		AudioVideoOut_t avOut;
+		memset(&avOut, 0, sizeof(avOut));
+		avOut.data       = pcm->data;
+		avOut.len        = pcm->len;
+		avOut.pts        = pcm->pts;
+		avOut.extradata  = (unsigned char *) &pcm->extradata;
+		avOut.extralen   = sizeof(pcm->extradata);
+		avOut.type       = "audio";
+		if (!context->playback->BackWard && context->output->audio->Write(context, &avOut) < 0)
+		{
+			ffmpeg_err("writing data to audio device failed\n");
+		}
+		pcm = pcm->next;
+	}
+	pthread_mutex_lock(&audioDecoderMutex);
+	while (written)
+	{
+		pcm = written;
+		written = pcm->next;
+		audio_pcm_release(pcm);
+	}
+	pthread_mutex_unlock(&audioDecoderMutex);
+}
+
+/* hands a packet to the decoder, blocks while its queue is full and
+ * writes the pcm that is ready meanwhile */
+static void audio_decoder_put(Context_t *context, AVPacket *packet, Track_t *track, uint32_t cAVIdx, pcmPrivateData_t *extradata, uint8_t restart)
+{
+	AudioPacket_t *item;
+	pthread_mutex_lock(&audioDecoderMutex);
+	item = audioPacketFree;
+	if (item)
+	{
+		audioPacketFree = item->next;
+		audioPacketFreeCount -= 1;
+	}
+	pthread_mutex_unlock(&audioDecoderMutex);
+	if (item == NULL)
+	{
+		item = malloc(sizeof(AudioPacket_t));
+		if (item == NULL)
+		{
+			ffmpeg_err("out of memory\n");
+			return;
+		}
+	}
+	memset(item, 0, sizeof(AudioPacket_t));
+	av_init_packet(&item->packet);
+	// the payload is only referenced, av_read_frame() allocated it already
+	if (wrapped_packet_ref(&item->packet, packet) < 0)
+	{
+		ffmpeg_err("can not reference the audio packet\n");
+		free(item);
+		return;
+	}
+	item->c = track->avCodecCtx;
+	item->stream = track->stream;
+	item->cAVIdx = cAVIdx;
+	item->restart = restart;
+	item->extradata = *extradata;
+	if (!audioDecoderRunning)
+	{
+		item->generation = audioDecoderGeneration;
+		audio_decode_packet(item);
+		pthread_mutex_lock(&audioDecoderMutex);
+		audio_packet_release(item);
+		pthread_mutex_unlock(&audioDecoderMutex);
+		audio_decoder_write(context);
+		return;
+	}
+	pthread_mutex_lock(&audioDecoderMutex);
+	while (audioPacketCount >= AUDIO_PACKETS_MAX)
+	{
+		if (audioPcmHead)
+		{
+			pthread_mutex_unlock(&audioDecoderMutex);
+			audio_decoder_write(context);
+			pthread_mutex_lock(&audioDecoderMutex);
+		}
+		else
+		{
+			pthread_cond_wait(&audioDecoderCond, &audioDecoderMutex);
+		}
+	}
+	item->generation = audioDecoderGeneration;
+	if (audioPacketTail)
+	{
+		audioPacketTail->next = item;
+	}
+	else
+	{
+		audioPacketHead = item;
+	}
+	audioPacketTail = item;
+	audioPacketCount += 1;
+	pthread_cond_broadcast(&audioDecoderCond);
+	pthread_mutex_unlock(&audioDecoderMutex);
+}
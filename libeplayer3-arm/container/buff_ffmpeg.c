@@ -23,25 +23,58 @@
 #define FILLBUFDIFF 1048576
 #define FILLBUFPAKET 5120
 #define FILLBUFSEEKTIME 3 //sec
+#define FILLBUFMAX (32 * 1024 * 1024) //the ring grows up to this after repeated stalls
+/* watermarks, in ms of stream */
+#define FILLBUFHIGH 2000 //buffered before playback starts or resumes
+#define FILLBUFHIGHSTEP 2000 //more for every stall
+#define FILLBUFHIGHMAX 20000 //the stall steps stop here
+#define FILLBUFHIGHDECAY 60000 //one step less after this long without a stall
+#define FILLBUFLOW 500 //playback pauses below this
+#define FILLBUFDEFICIT 30000 //playback time to cover if the input is slower than the stream
+#define FILLBUFREBUFFERTIME 20 //sec, max. wait for the high watermark
+#define FILLBUFRATE (256 * 1024) //bytes/s until the stream rate is known
 #define TIMEOUT_MAX_ITERS 10
 
-static int ffmpeg_buf_size = FILLBUFSIZE + FILLBUFDIFF;
+static int ffmpeg_buf_size = FILLBUFSIZE + FILLBUFDIFF; //current ring, grows after stalls
+static int ffmpeg_buf_config_size = FILLBUFSIZE + FILLBUFDIFF; //set by the user, every stream starts with it
 static int ffmpeg_buf_seek_time = FILLBUFSEEKTIME;
 static int(*ffmpeg_read_org)(void *opaque, uint8_t *buf, int buf_size) = NULL;
 static int(*ffmpeg_real_read_org)(void *opaque, uint8_t *buf, int buf_size) = NULL;
 
 static int64_t(*ffmpeg_seek_org)(void *opaque, int64_t offset, int whence) = NULL;
-static unsigned char *ffmpeg_buf_read = NULL;
-static unsigned char *ffmpeg_buf_write = NULL;
+/* The buffer is a single producer / single consumer ring: the filler thread
+ * reads straight into it and only moves ffmpeg_buf_wpos, the demuxer reads
+ * from it and only moves ffmpeg_buf_rpos. A position is published with a
+ * release store after the data resp. the free space behind it is final, so
+ * neither side takes a lock. The filler never writes into the FILLBUFDIFF
+ * bytes behind the read position, the demuxer may seek back into them.
+ */
 static unsigned char *ffmpeg_buf = NULL;
+static int32_t ffmpeg_buf_rpos = 0;
+static int32_t ffmpeg_buf_wpos = 0;
 static pthread_t fillerThread;
 static int hasfillerThreadStarted[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 int hasfillerThreadStartedID = 0;
-static pthread_mutex_t fillermutex;
+/* only for sleeping, the reader waits here for data or a finished seek */
+static pthread_mutex_t fillermutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fillercond = PTHREAD_COND_INITIALIZER;
+static int32_t ffmpeg_buf_waiting = 0;
 static int ffmpeg_buf_valid_size = 0;
 static int ffmpeg_do_seek_ret = 0;
-static int ffmpeg_do_seek = 0;
+static int32_t ffmpeg_do_seek = 0;
+static int32_t ffmpeg_buf_resize = 0; //new ring size, the reader requests, the filler does it
 static int ffmpeg_buf_stop = 0;
+static int32_t ffmpeg_buf_eof = 0; //the input had no more data
+static int32_t ffmpeg_buf_stalls = 0;
+static int64_t ffmpeg_buf_stall_time = 0; //end of the last stall or decay step
+/* input rate while reading (the link), filler side */
+static int32_t ffmpeg_buf_in_rate = 0;
+static int64_t ffmpeg_buf_in_bytes = 0;
+static int64_t ffmpeg_buf_in_time = 0;
+/* consumed by the demuxer, that is the stream rate if it is not starving */
+static int32_t ffmpeg_buf_out_rate = 0;
+static int64_t ffmpeg_buf_out_bytes = 0;
+static int64_t ffmpeg_buf_out_start = 0;
 
 static Context_t *g_context = 0;
 static int64_t playPts = -1;
@@ -170,17 +203,271 @@ static int32_t ffmpeg_read_wrapper2(void *opaque, uint8_t *buf, int32_t buf_size
 }
 #endif
 //for buffered io
-void getfillerMutex(const char *filename __attribute__((unused)), const char *function __attribute__((unused)), int line __attribute__((unused)))
+static inline int32_t ffmpeg_buf_get(int32_t *pos)
 {
-	ffmpeg_printf(100, "::%d requesting mutex\n", line);
-	pthread_mutex_lock(&fillermutex);
-	ffmpeg_printf(100, "::%d received mutex\n", line);
+	return __atomic_load_n(pos, __ATOMIC_ACQUIRE);
+}
+
+static inline void ffmpeg_buf_set(int32_t *pos, int32_t val)
+{
+	__atomic_store_n(pos, val, __ATOMIC_RELEASE);
+}
+
+static inline int32_t ffmpeg_buf_fill(int32_t rpos, int32_t wpos)
+{
+	return (wpos >= rpos) ? wpos - rpos : ffmpeg_buf_size - rpos + wpos;
 }
 
-void releasefillerMutex(const char *filename __attribute__((unused)), const const char *function __attribute__((unused)), int line __attribute__((unused)))
+/* filler side, after publishing data or finishing a seek */
+static void ffmpeg_buf_wakeup()
 {
+	/* pairs with the fence in ffmpeg_buf_wait(): either the reader sees the
+	 * new value or we see it waiting */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ffmpeg_buf_waiting, __ATOMIC_RELAXED))
+	{
+		pthread_mutex_lock(&fillermutex);
+		pthread_cond_broadcast(&fillercond);
+		pthread_mutex_unlock(&fillermutex);
+	}
+}
+
+/* reader side, sleeps while *val == old, at most ms */
+static void ffmpeg_buf_wait(int32_t *val, int32_t old, int32_t ms)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += (ms % 1000) * 1000000;
+	ts.tv_sec += ms / 1000 + ts.tv_nsec / 1000000000;
+	ts.tv_nsec %= 1000000000;
+	pthread_mutex_lock(&fillermutex);
+	__atomic_store_n(&ffmpeg_buf_waiting, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	while (ffmpeg_buf_get(val) == old)
+	{
+		if (pthread_cond_timedwait(&fillercond, &fillermutex, &ts) != 0)
+			break;
+	}
+	__atomic_store_n(&ffmpeg_buf_waiting, 0, __ATOMIC_RELAXED);
 	pthread_mutex_unlock(&fillermutex);
-	ffmpeg_printf(100, "::%d released mutex\n", line);
+}
+
+/* bytes/s, the container bitrate or what the demuxer consumed so far */
+static int64_t ffmpeg_buf_stream_rate()
+{
+	if (avContextTab[0] != NULL && avContextTab[0]->bit_rate > 0)
+	{
+		return avContextTab[0]->bit_rate / 8;
+	}
+	if (ffmpeg_buf_out_rate > 0)
+	{
+		return ffmpeg_buf_out_rate;
+	}
+	return FILLBUFRATE;
+}
+
+/* bytes to buffer before playing, not limited to the ring size */
+static int64_t ffmpeg_buf_high_water()
+{
+	int64_t rate = ffmpeg_buf_stream_rate();
+	int32_t in_rate = ffmpeg_buf_get(&ffmpeg_buf_in_rate);
+	int64_t high = FILLBUFHIGH + ffmpeg_buf_stalls * FILLBUFHIGHSTEP;
+	if (high > FILLBUFHIGHMAX)
+	{
+		high = FILLBUFHIGHMAX;
+	}
+	high = rate * high / 1000;
+	if (in_rate > 0 && in_rate < rate)
+	{
+		/* the ring drains with rate - in_rate, buffer for some playback time */
+		high += (rate - in_rate) * FILLBUFDEFICIT / 1000;
+	}
+	return high;
+}
+
+static int32_t ffmpeg_buf_limit(int64_t bytes)
+{
+	int32_t usable = ffmpeg_buf_size - FILLBUFDIFF;
+	if (bytes > usable)
+	{
+		return usable;
+	}
+	if (bytes < FILLBUFPAKET)
+	{
+		return FILLBUFPAKET;
+	}
+	return bytes;
+}
+
+static int32_t ffmpeg_buf_low_water()
+{
+	int32_t low = ffmpeg_buf_limit(ffmpeg_buf_stream_rate() * FILLBUFLOW / 1000);
+	int32_t high = ffmpeg_buf_limit(ffmpeg_buf_high_water());
+	return (low > high / 2) ? high / 2 : low;
+}
+
+/* ms until the ring runs empty, -1 if it is not draining */
+static int32_t ffmpeg_buf_time_to_empty(int32_t fill)
+{
+	int64_t rate = ffmpeg_buf_stream_rate();
+	int32_t in_rate = ffmpeg_buf_get(&ffmpeg_buf_in_rate);
+	if (!ffmpeg_buf_get(&ffmpeg_buf_eof))
+	{
+		if (in_rate <= 0 || in_rate >= rate)
+		{
+			return -1;
+		}
+		rate -= in_rate;
+	}
+	return (int64_t)fill * 1000 / rate;
+}
+
+/* filler side, rate of the input while reading */
+static void ffmpeg_buf_in_account(int32_t len, int64_t usec)
+{
+	ffmpeg_buf_in_bytes += len;
+	ffmpeg_buf_in_time += usec;
+	if (ffmpeg_buf_in_time >= 1000000 || ffmpeg_buf_in_bytes >= 4 * FILLBUFDIFF)
+	{
+		int32_t rate = ffmpeg_buf_in_bytes * 1000000 / (ffmpeg_buf_in_time ? ffmpeg_buf_in_time : 1);
+		int32_t old = ffmpeg_buf_get(&ffmpeg_buf_in_rate);
+		ffmpeg_buf_set(&ffmpeg_buf_in_rate, old ? (3 * old + rate) / 4 : rate);
+		ffmpeg_buf_in_bytes = 0;
+		ffmpeg_buf_in_time = 0;
+	}
+}
+
+/* reader side, rate of the demuxer, restarted after waiting for data */
+static void ffmpeg_buf_out_account(int32_t len)
+{
+	int64_t now = av_gettime_relative();
+	if (len < 0 || ffmpeg_buf_out_start == 0)
+	{
+		ffmpeg_buf_out_start = now;
+		ffmpeg_buf_out_bytes = 0;
+		return;
+	}
+	ffmpeg_buf_out_bytes += len;
+	if (now - ffmpeg_buf_out_start >= 2000000)
+	{
+		int32_t rate = ffmpeg_buf_out_bytes * 1000000 / (now - ffmpeg_buf_out_start);
+		ffmpeg_buf_out_rate = ffmpeg_buf_out_rate ? (3 * ffmpeg_buf_out_rate + rate) / 4 : rate;
+		ffmpeg_buf_out_start = now;
+		ffmpeg_buf_out_bytes = 0;
+	}
+}
+
+/* filler side, copies history and data to the start of a bigger ring.
+ * The reader waits for it, so its position and valid size hold still */
+static void ffmpeg_buf_grow(int32_t size)
+{
+	unsigned char *buf = av_malloc(size);
+	int32_t rpos = ffmpeg_buf_get(&ffmpeg_buf_rpos);
+	int32_t fill = ffmpeg_buf_fill(rpos, ffmpeg_buf_wpos);
+	int32_t keep = ffmpeg_buf_valid_size;
+	int32_t start = rpos - keep;
+	int32_t part;
+	if (buf == NULL)
+	{
+		ffmpeg_err("can not grow the buffer to %d\n", size);
+		return;
+	}
+	if (start < 0)
+	{
+		start += ffmpeg_buf_size;
+	}
+	part = ffmpeg_buf_size - start;
+	if (part > keep + fill)
+	{
+		part = keep + fill;
+	}
+	memcpy(buf, ffmpeg_buf + start, part);
+	memcpy(buf + part, ffmpeg_buf, keep + fill - part);
+	av_free(ffmpeg_buf);
+	ffmpeg_buf = buf;
+	ffmpeg_buf_size = size;
+	ffmpeg_buf_set(&ffmpeg_buf_rpos, keep);
+	ffmpeg_buf_set(&ffmpeg_buf_wpos, keep + fill);
+	ffmpeg_printf(10, "buffer size=%d\n", size);
+}
+
+/* reader side, waits until the ring reached the high watermark, at most sec.
+ * Also waits for a pending resize, the ring must not be read meanwhile */
+static void ffmpeg_buf_prebuffer(int32_t sec)
+{
+	int64_t end = av_gettime_relative() + sec * 1000000LL;
+	for (;;)
+	{
+		int32_t wpos = ffmpeg_buf_get(&ffmpeg_buf_wpos);
+		if (ffmpeg_buf_get(&ffmpeg_buf_resize) == 0)
+		{
+			int32_t fill = ffmpeg_buf_fill(ffmpeg_buf_get(&ffmpeg_buf_rpos), wpos);
+			if (fill >= ffmpeg_buf_limit(ffmpeg_buf_high_water()) || ffmpeg_buf_get(&ffmpeg_buf_eof) || av_gettime_relative() >= end)
+			{
+				break;
+			}
+		}
+		if (PlaybackDieNow(0))
+		{
+			break;
+		}
+		ffmpeg_buf_wait(&ffmpeg_buf_wpos, wpos, 100);
+	}
+	ffmpeg_buf_out_account(-1);
+}
+
+/* reader side, takes back one stall step of the high watermark after
+ * FILLBUFHIGHDECAY ms without a stall */
+static void ffmpeg_buf_decay()
+{
+	int64_t now;
+	if (ffmpeg_buf_stalls == 0)
+	{
+		return;
+	}
+	now = av_gettime_relative();
+	if (now - ffmpeg_buf_stall_time >= FILLBUFHIGHDECAY * 1000LL)
+	{
+		ffmpeg_buf_stalls -= 1;
+		ffmpeg_buf_stall_time = now;
+		ffmpeg_printf(10, "no stall for %d ms, high watermark %lld\n", FILLBUFHIGHDECAY, ffmpeg_buf_high_water());
+	}
+}
+
+/* reader side, the ring ran low: pause the output until the high watermark
+ * is back. A ring too small for it grows after repeated stalls */
+static void ffmpeg_buf_rebuffer()
+{
+	Context_t *context = g_context;
+	int64_t high;
+	int8_t paused = 0;
+	ffmpeg_buf_stalls += 1;
+	high = ffmpeg_buf_high_water();
+	ffmpeg_printf(10, "rebuffering, stall %d, high watermark %lld\n", ffmpeg_buf_stalls, high);
+	if (ffmpeg_buf_stalls > 1 && high > ffmpeg_buf_size - FILLBUFDIFF && ffmpeg_buf_size < FILLBUFMAX)
+	{
+		int64_t size = ffmpeg_buf_size * 2;
+		if (size < high + FILLBUFDIFF)
+		{
+			size = high + FILLBUFDIFF;
+		}
+		if (size > FILLBUFMAX)
+		{
+			size = FILLBUFMAX;
+		}
+		ffmpeg_buf_set(&ffmpeg_buf_resize, size);
+	}
+	if (context && context->playback && context->output)
+	{
+		paused = PlaybackRebuffer(context, 1);
+	}
+	ffmpeg_buf_prebuffer(FILLBUFREBUFFERTIME);
+	if (paused)
+	{
+		/* no continue if the user paused meanwhile */
+		PlaybackRebuffer(context, 0);
+	}
+	ffmpeg_buf_stall_time = av_gettime_relative();
 }
 //for buffered io (end)encoding
 #if 0
@@ -196,12 +483,13 @@ static int32_t container_set_ffmpeg_buf_size(int32_t *size)
 	{
 		if (*size == 0)
 		{
-			ffmpeg_buf_size = 0;
+			ffmpeg_buf_config_size = 0;
 		}
 		else
 		{
-			ffmpeg_buf_size = (*size) + FILLBUFDIFF;
+			ffmpeg_buf_config_size = (*size) + FILLBUFDIFF;
 		}
+		ffmpeg_buf_size = ffmpeg_buf_config_size;
 	}
 	ffmpeg_printf(10, "size=%d, buffer size=%d\n", (*size), ffmpeg_buf_size);
 	return cERR_CONTAINER_FFMPEG_NO_ERROR;
@@ -209,23 +497,23 @@ static int32_t container_set_ffmpeg_buf_size(int32_t *size)
 
 static int32_t container_get_ffmpeg_buf_size(int32_t *size)
 {
-	*size = ffmpeg_buf_size - FILLBUFDIFF;
+	*size = ffmpeg_buf_config_size - FILLBUFDIFF;
 	return cERR_CONTAINER_FFMPEG_NO_ERROR;
 }
 
-static int32_t container_get_fillbufstatus(int32_t *size)
+/* fill level in bytes and, if not NULL, ms until the buffer runs empty
+ * (-1 if it is not draining) */
+static int32_t container_get_fillbufstatus(int32_t *size, int32_t *msToEmpty)
 {
-	int32_t rwdiff = 0;
-	if (ffmpeg_buf != NULL && ffmpeg_buf_read != NULL && ffmpeg_buf_write != NULL)
+	int32_t fill = 0;
+	if (ffmpeg_buf != NULL)
 	{
-		if (ffmpeg_buf_read < ffmpeg_buf_write)
-			rwdiff = ffmpeg_buf_write - ffmpeg_buf_read;
-		if (ffmpeg_buf_read > ffmpeg_buf_write)
-		{
-			rwdiff = (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_read;
-			rwdiff += ffmpeg_buf_write - ffmpeg_buf;
-		}
-		*size = rwdiff;
+		fill = ffmpeg_buf_fill(ffmpeg_buf_get(&ffmpeg_buf_rpos), ffmpeg_buf_get(&ffmpeg_buf_wpos));
+		*size = fill;
+	}
+	if (msToEmpty)
+	{
+		*msToEmpty = (ffmpeg_buf != NULL) ? ffmpeg_buf_time_to_empty(fill) : -1;
 	}
 	return cERR_CONTAINER_FFMPEG_NO_ERROR;
 }
@@ -242,7 +530,7 @@ static void ffmpeg_filler(Context_t *context, int32_t id, int32_t *inpause, int3
 {
 	int32_t len = 0;
 	int32_t rwdiff = ffmpeg_buf_size;
-	uint8_t buf[FILLBUFPAKET];
+	int32_t wpos = ffmpeg_buf_wpos;
 	if (ffmpeg_read_org == NULL || ffmpeg_seek_org == NULL)
 	{
 		ffmpeg_err("ffmpeg_read_org or ffmpeg_seek_org is NULL\n");
@@ -251,7 +539,7 @@ static void ffmpeg_filler(Context_t *context, int32_t id, int32_t *inpause, int3
 	while ((flag == 0 && avContextTab[0] != NULL && avContextTab[0]->pb != NULL && rwdiff > FILLBUFDIFF) ||
 	       (flag == 1 && hasfillerThreadStarted[id] == 1 && avContextTab[0] != NULL && avContextTab[0]->pb != NULL && rwdiff > FILLBUFDIFF))
 	{
-		if (0 == PlaybackDieNow(0))
+		if (PlaybackDieNow(0))
 		{
 			break;
 		}
@@ -260,65 +548,64 @@ static void ffmpeg_filler(Context_t *context, int32_t id, int32_t *inpause, int3
 			ffmpeg_buf_stop = 0;
 			break;
 		}
-		getfillerMutex(__FILE__, __FUNCTION__, __LINE__);
-		//do a seek
-		if (ffmpeg_do_seek != 0)
+		//do a seek, the reader waits for it and does not touch its position meanwhile
+		if (ffmpeg_buf_get(&ffmpeg_do_seek) != 0)
 		{
 			ffmpeg_do_seek_ret = ffmpeg_seek_org(avContextTab[0]->pb->opaque, avContextTab[0]->pb->pos + ffmpeg_do_seek, SEEK_SET);
 			if (ffmpeg_do_seek_ret >= 0)
 			{
-				ffmpeg_buf_write = ffmpeg_buf;
-				ffmpeg_buf_read = ffmpeg_buf;
+				wpos = 0;
+				ffmpeg_buf_set(&ffmpeg_buf_wpos, 0);
+				ffmpeg_buf_set(&ffmpeg_buf_rpos, 0);
+				ffmpeg_buf_set(&ffmpeg_buf_eof, 0);
 			}
-			ffmpeg_do_seek = 0;
+			ffmpeg_buf_set(&ffmpeg_do_seek, 0);
+			ffmpeg_buf_wakeup();
 		}
-		if (ffmpeg_buf_read == ffmpeg_buf_write)
+		//grow the ring, the reader waits for it too
+		if (ffmpeg_buf_get(&ffmpeg_buf_resize) != 0)
 		{
-			ffmpeg_buf_valid_size = 0;
-			rwdiff = ffmpeg_buf_size;
-		}
-		if (ffmpeg_buf_read < ffmpeg_buf_write)
-		{
-			rwdiff = (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_write;
-			rwdiff += ffmpeg_buf_read - ffmpeg_buf;
-		}
-		if (ffmpeg_buf_read > ffmpeg_buf_write)
-		{
-			rwdiff = ffmpeg_buf_read - ffmpeg_buf_write;
+			ffmpeg_buf_grow(ffmpeg_buf_resize);
+			wpos = ffmpeg_buf_wpos;
+			ffmpeg_buf_set(&ffmpeg_buf_resize, 0);
+			ffmpeg_buf_wakeup();
 		}
+		rwdiff = ffmpeg_buf_size - ffmpeg_buf_fill(ffmpeg_buf_get(&ffmpeg_buf_rpos), wpos);
 		int32_t size = FILLBUFPAKET;
 		if (rwdiff - FILLBUFDIFF < size)
 		{
 			size = (rwdiff - FILLBUFDIFF);
 		}
-		if (ffmpeg_buf_write + size > ffmpeg_buf + ffmpeg_buf_size)
-		{
-			size = (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_write;
-		}
-		if (ffmpeg_buf_write == ffmpeg_buf + ffmpeg_buf_size)
+		if (wpos + size > ffmpeg_buf_size)
 		{
-			ffmpeg_buf_write = ffmpeg_buf;
+			size = ffmpeg_buf_size - wpos;
 		}
-		releasefillerMutex(__FILE__, __FUNCTION__, __LINE__);
 		if (size > 0)
 		{
+			int64_t start = av_gettime_relative();
 			if (flag == 1 && hasfillerThreadStarted[id] == 2) break;
-			len = ffmpeg_read_org(avContextTab[0]->pb->opaque, buf, size);
+			len = ffmpeg_read_org(avContextTab[0]->pb->opaque, ffmpeg_buf + wpos, size);
 			if (flag == 1 && hasfillerThreadStarted[id] == 2) break;
 			ffmpeg_printf(20, "buffer-status (free buffer=%d)\n", rwdiff - FILLBUFDIFF - len);
-			getfillerMutex(__FILE__, __FUNCTION__, __LINE__);
 			if (len > 0)
 			{
-				memcpy(ffmpeg_buf_write, buf, len);
-				ffmpeg_buf_write += len;
+				ffmpeg_buf_in_account(len, av_gettime_relative() - start);
+				ffmpeg_buf_set(&ffmpeg_buf_eof, 0);
+				wpos += len;
+				if (wpos == ffmpeg_buf_size)
+				{
+					wpos = 0;
+				}
+				ffmpeg_buf_set(&ffmpeg_buf_wpos, wpos);
+				ffmpeg_buf_wakeup();
 			}
 			else
 			{
-				releasefillerMutex(__FILE__, __FUNCTION__, __LINE__);
 				ffmpeg_err("read not ok ret=%d\n", len);
+				ffmpeg_buf_set(&ffmpeg_buf_eof, 1);
+				ffmpeg_buf_wakeup();
 				break;
 			}
-			releasefillerMutex(__FILE__, __FUNCTION__, __LINE__);
 		}
 		else
 		{
@@ -331,20 +618,9 @@ static void ffmpeg_filler(Context_t *context, int32_t id, int32_t *inpause, int3
 				}
 				else if ((*inpause) == 1 && !context->playback->isPaused)
 				{
-					int32_t buflen = 0;
+					int32_t buflen = ffmpeg_buf_fill(ffmpeg_buf_get(&ffmpeg_buf_rpos), wpos);
 					(*inpause) = 0;
-					getfillerMutex(__FILE__, __FUNCTION__, __LINE__);
-					if (ffmpeg_buf_read < ffmpeg_buf_write)
-					{
-						buflen = ffmpeg_buf_write - ffmpeg_buf_read;
-					}
-					if (ffmpeg_buf_read > ffmpeg_buf_write)
-					{
-						buflen = (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_read;
-						buflen += ffmpeg_buf_write - ffmpeg_buf;
-					}
 					ffmpeg_seek_org(avContextTab[0]->pb->opaque, avContextTab[0]->pb->pos + buflen, SEEK_SET);
-					releasefillerMutex(__FILE__, __FUNCTION__, __LINE__);
 				}
 			}
 		}
@@ -414,55 +690,48 @@ static int32_t ffmpeg_start_fillerTHREAD(Context_t *context)
 	return ret;
 }
 
-static int32_t ffmpeg_read_real(void *opaque __attribute__((unused)), uint8_t *buf, int32_t buf_size)
+/* bytes behind the read position that can still be seeked back to */
+static void ffmpeg_buf_add_valid(int32_t len)
 {
-	int32_t len = buf_size;
-	int32_t rwdiff = 0;
-	if (buf_size > 0)
+	ffmpeg_buf_valid_size += len;
+	if (ffmpeg_buf_valid_size > FILLBUFDIFF)
 	{
-		getfillerMutex(__FILE__, __FUNCTION__, __LINE__);
-		if (ffmpeg_buf_read < ffmpeg_buf_write)
-			rwdiff = ffmpeg_buf_write - ffmpeg_buf_read;
-		if (ffmpeg_buf_read > ffmpeg_buf_write)
-		{
-			rwdiff = (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_read;
-			rwdiff += ffmpeg_buf_write - ffmpeg_buf;
-		}
-		rwdiff--;
-		if (len > rwdiff)
-		{
-			len = rwdiff;
-		}
-		if (ffmpeg_buf_read + len > ffmpeg_buf + ffmpeg_buf_size)
-		{
-			len = (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_read;
-		}
-		if (len > 0)
-		{
-			memcpy(buf, ffmpeg_buf_read, len);
-			ffmpeg_buf_read += len;
-			if (ffmpeg_buf_valid_size < FILLBUFDIFF)
-			{
-				if (ffmpeg_buf_valid_size + len > FILLBUFDIFF)
-				{
-					ffmpeg_buf_valid_size = FILLBUFDIFF;
-				}
-				else
-				{
-					ffmpeg_buf_valid_size += len;
-				}
-			}
-			if (ffmpeg_buf_read == ffmpeg_buf + ffmpeg_buf_size)
-			{
-				ffmpeg_buf_read = ffmpeg_buf;
-			}
-		}
-		else
-		{
-			len = 0;
-		}
-		releasefillerMutex(__FILE__, __FUNCTION__, __LINE__);
+		ffmpeg_buf_valid_size = FILLBUFDIFF;
 	}
+}
+
+static int32_t ffmpeg_read_real(void *opaque __attribute__((unused)), uint8_t *buf, int32_t buf_size, int32_t wpos)
+{
+	int32_t rpos = ffmpeg_buf_rpos;
+	int32_t len = ffmpeg_buf_fill(rpos, wpos);
+	int32_t part;
+	if (len > buf_size)
+	{
+		len = buf_size;
+	}
+	if (len <= 0)
+	{
+		return 0;
+	}
+	/* up to the end of the ring, the rest from its start */
+	part = ffmpeg_buf_size - rpos;
+	if (part > len)
+	{
+		part = len;
+	}
+	memcpy(buf, ffmpeg_buf + rpos, part);
+	if (part < len)
+	{
+		memcpy(buf + part, ffmpeg_buf, len - part);
+	}
+	rpos += len;
+	if (rpos >= ffmpeg_buf_size)
+	{
+		rpos -= ffmpeg_buf_size;
+	}
+	ffmpeg_buf_add_valid(len);
+	ffmpeg_buf_set(&ffmpeg_buf_rpos, rpos);
+	ffmpeg_buf_out_account(len);
 	return len;
 }
 
@@ -471,14 +740,21 @@ static int32_t ffmpeg_read(void *opaque, uint8_t *buf, int32_t buf_size)
 	int32_t sumlen = 0;
 	int32_t len = 0;
 	int32_t count = 2000;
+	ffmpeg_buf_decay();
+	if (!ffmpeg_buf_get(&ffmpeg_buf_eof) &&
+	    ffmpeg_buf_fill(ffmpeg_buf_rpos, ffmpeg_buf_get(&ffmpeg_buf_wpos)) < ffmpeg_buf_low_water())
+	{
+		ffmpeg_buf_rebuffer();
+	}
 	while (sumlen < buf_size && (--count) > 0 && 0 == PlaybackDieNow(0))
 	{
-		len = ffmpeg_read_real(opaque, buf, buf_size - sumlen);
+		int32_t wpos = ffmpeg_buf_get(&ffmpeg_buf_wpos);
+		len = ffmpeg_read_real(opaque, buf, buf_size - sumlen, wpos);
 		sumlen += len;
 		buf += len;
 		if (len == 0)
 		{
-			usleep(10000);
+			ffmpeg_buf_wait(&ffmpeg_buf_wpos, wpos, 10);
 		}
 	}
 	if (count == 0)
@@ -499,6 +775,7 @@ static int64_t ffmpeg_seek(void *opaque __attribute__((unused)), int64_t offset,
 {
 	int64_t diff;
 	int32_t rwdiff = 0;
+	int32_t rpos = ffmpeg_buf_rpos;
 	whence &= ~AVSEEK_FORCE;
 	if (whence != SEEK_CUR && whence != SEEK_SET)
 	{
@@ -516,85 +793,107 @@ static int64_t ffmpeg_seek(void *opaque __attribute__((unused)), int64_t offset,
 	{
 		return avContextTab[0]->pb->pos;
 	}
-	getfillerMutex(__FILE__, __FUNCTION__, __LINE__);
-	if (ffmpeg_buf_read < ffmpeg_buf_write)
-	{
-		rwdiff = ffmpeg_buf_write - ffmpeg_buf_read;
-	}
-	if (ffmpeg_buf_read > ffmpeg_buf_write)
-	{
-		rwdiff = (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_read;
-		rwdiff += ffmpeg_buf_write - ffmpeg_buf;
-	}
+	rwdiff = ffmpeg_buf_fill(rpos, ffmpeg_buf_get(&ffmpeg_buf_wpos));
 	if (diff > 0 && diff < rwdiff)
 	{
 		/* can do the seek inside the buffer */
 		ffmpeg_printf(20, "buffer-seek diff=%lld\n", diff);
-		if (diff > (ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_read)
+		rpos += diff;
+		if (rpos >= ffmpeg_buf_size)
 		{
-			ffmpeg_buf_read = ffmpeg_buf + (diff - ((ffmpeg_buf + ffmpeg_buf_size) - ffmpeg_buf_read));
-		}
-		else
-		{
-			ffmpeg_buf_read = ffmpeg_buf_read + diff;
+			rpos -= ffmpeg_buf_size;
 		}
+		ffmpeg_buf_add_valid(diff);
+		ffmpeg_buf_set(&ffmpeg_buf_rpos, rpos);
 	}
 	else if (diff < 0 && diff * -1 < ffmpeg_buf_valid_size)
 	{
 		/* can do the seek inside the buffer */
 		ffmpeg_printf(20, "buffer-seek diff=%lld\n", diff);
 		int32_t tmpdiff = diff * -1;
-		if (tmpdiff > ffmpeg_buf_read - ffmpeg_buf)
-		{
-			ffmpeg_buf_read = (ffmpeg_buf + ffmpeg_buf_size) - (tmpdiff - (ffmpeg_buf_read - ffmpeg_buf));
-		}
-		else
+		rpos -= tmpdiff;
+		if (rpos < 0)
 		{
-			ffmpeg_buf_read = ffmpeg_buf_read - tmpdiff;
+			rpos += ffmpeg_buf_size;
 		}
+		/* the filler may already use the space freed beyond the old reserve */
+		ffmpeg_buf_valid_size -= tmpdiff;
+		ffmpeg_buf_set(&ffmpeg_buf_rpos, rpos);
 	}
 	else
 	{
-		releasefillerMutex(__FILE__, __FUNCTION__, __LINE__);
+		int32_t do_seek = diff;
 		ffmpeg_printf(20, "real-seek diff=%lld\n", diff);
 		ffmpeg_do_seek_ret = 0;
-		ffmpeg_do_seek = diff;
-		while (ffmpeg_do_seek != 0)
+		ffmpeg_buf_set(&ffmpeg_do_seek, do_seek);
+		while (ffmpeg_buf_get(&ffmpeg_do_seek) != 0)
 		{
-			usleep(100000);
+			ffmpeg_buf_wait(&ffmpeg_do_seek, do_seek, 100);
 		}
-		ffmpeg_do_seek = 0;
+		ffmpeg_buf_valid_size = 0;
 		if (ffmpeg_do_seek_ret < 0)
 		{
 			ffmpeg_err("seek not ok ret=%d\n", ffmpeg_do_seek_ret);
 			return ffmpeg_do_seek_ret;
 		}
 		//fill buffer
-		int32_t count = ffmpeg_buf_seek_time * 10;
-		int32_t size = 0;
-		container_get_fillbufstatus(&size);
-		while (size < ffmpeg_buf_size - FILLBUFDIFF && (--count) > 0)
-		{
-			usleep(100000);
-			container_get_fillbufstatus(&size);
-		}
+		ffmpeg_buf_prebuffer(ffmpeg_buf_seek_time);
 		return avContextTab[0]->pb->pos + diff;
 	}
-	releasefillerMutex(__FILE__, __FUNCTION__, __LINE__);
 	return avContextTab[0]->pb->pos + diff;
 }
 
+/* the filler reads straight into the ring, so it has to be gone before
+ * the input is closed and the ring freed */
+static void ffmpeg_stop_fillerTHREAD()
+{
+	int32_t id = hasfillerThreadStartedID;
+	int32_t wait_time = 50;
+	if (hasfillerThreadStarted[id] != 1)
+	{
+		return;
+	}
+	hasfillerThreadStarted[id] = 2;
+	while (hasfillerThreadStarted[id] != 0 && (--wait_time) > 0)
+	{
+		usleep(100000);
+	}
+	if (wait_time == 0)
+	{
+		ffmpeg_err("Timeout waiting for filler thread ID=%d!\n", id);
+	}
+}
+
 static void ffmpeg_buf_free()
 {
 	ffmpeg_read_org = NULL;
 	ffmpeg_seek_org = NULL;
-	ffmpeg_buf_read = NULL;
-	ffmpeg_buf_write = NULL;
-	free(ffmpeg_buf);
+	ffmpeg_buf_rpos = 0;
+	ffmpeg_buf_wpos = 0;
+	if (hasfillerThreadStarted[hasfillerThreadStartedID] == 0)
+	{
+		av_free(ffmpeg_buf);
+	}
+	else
+	{
+		/* still blocked in a read into the ring, rather leak it */
+		ffmpeg_err("filler thread ID=%d still running, not freeing the buffer\n", hasfillerThreadStartedID);
+	}
 	ffmpeg_buf = NULL;
+	ffmpeg_buf_size = ffmpeg_buf_config_size; //undo the growth of this stream
 	ffmpeg_buf_valid_size = 0;
 	ffmpeg_do_seek_ret = 0;
 	ffmpeg_do_seek = 0;
+	ffmpeg_buf_resize = 0;
 	ffmpeg_buf_stop = 0;
+	ffmpeg_buf_eof = 0;
+	ffmpeg_buf_stalls = 0;
+	ffmpeg_buf_stall_time = 0;
+	ffmpeg_buf_in_rate = 0;
+	ffmpeg_buf_in_bytes = 0;
+	ffmpeg_buf_in_time = 0;
+	ffmpeg_buf_out_rate = 0;
+	ffmpeg_buf_out_bytes = 0;
+	ffmpeg_buf_out_start = 0;
 	hasfillerThreadStartedID = 0;
 }
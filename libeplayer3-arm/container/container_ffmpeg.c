@@ -52,6 +52,7 @@
 
 #include "common.h"
 #include "misc.h"
+#include "stats.h"
 #include "debug.h"
 #include "aac.h"
 #include "pcm.h"
@@ -198,6 +199,8 @@ static int32_t flv2mpeg4_converter = 1;
 static int32_t flv2mpeg4_converter = 0;
 #endif
 
+#include "audio_ffmpeg.c"
+
 /* ***************************** */
 /* MISC Functions                */
 /* ***************************** */
@@ -536,16 +539,10 @@ static void FFMPEGThread(Context_t *context)
 	//int32_t err = 0;
 	AudioVideoOut_t avOut;
 	g_context = context;
-	SwrContext *swr = NULL;
-	AVFrame *decoded_frame = NULL;
-	int32_t out_sample_rate = 44100;
-	int32_t out_channels = 2;
-	uint64_t out_channel_layout = AV_CH_LAYOUT_STEREO;
 	uint32_t cAVIdx = 0;
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(56, 34, 100)
 	Mpeg4P2Context mpeg4p2_context;
 	memset(&mpeg4p2_context, 0, sizeof(Mpeg4P2Context));
-	AVBitStreamFilterContext *mpeg4p2_bsf_context = av_bitstream_filter_init("mpeg4_unpack_bframes");
 #endif
 #ifdef HAVE_FLV2MPEG4_CONVERTER
 	Flv2Mpeg4Context flv2mpeg4_context;
@@ -558,6 +555,7 @@ static void FFMPEGThread(Context_t *context)
 		usleep(1000);
 	}
 	ffmpeg_printf(10, "Running!\n");
+	audio_decoder_start();
 	int8_t isWaitingForFinish = 0;
 	while (context && context->playback && context->playback->isPlaying)
 	{
@@ -586,6 +584,7 @@ static void FFMPEGThread(Context_t *context)
 			}
 			continue;
 		}
+		audio_decoder_write(context);
 		if (context->playback->BackWard && av_gettime() >= showtime) {
 			context->output->Command(context, OUTPUT_CLEAR, "video");
 
@@ -663,10 +662,12 @@ static void FFMPEGThread(Context_t *context)
 			do_seek_target_seconds = 0;
 			do_seek_target_bytes = 0;
 			restart_audio_resampling = 1;
+			audio_decoder_flush();
 			currentVideoPts = -1;
 			currentAudioPts = -1;
 			latestPts = 0;
 			seek_target_flag = 0;
+			stats_seek_flushed();
 			// flush streams
 			uint32_t i = 0;
 			for (i = 0; i < IPTV_AV_CONTEXT_MAX_NUM; i += 1)
@@ -685,11 +686,6 @@ static void FFMPEGThread(Context_t *context)
 			}
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(56, 34, 100)
 			mpeg4p2_context_reset(&mpeg4p2_context);
-			if (NULL != mpeg4p2_bsf_context)
-			{
-				av_bitstream_filter_close(mpeg4p2_bsf_context);
-				mpeg4p2_bsf_context = av_bitstream_filter_init("mpeg4_unpack_bframes");
-			}
 #endif
 #ifdef HAVE_FLV2MPEG4_CONVERTER
 			flv2mpeg4_context_reset(&flv2mpeg4_context);
@@ -722,6 +718,7 @@ static void FFMPEGThread(Context_t *context)
 			Track_t *subtitleTrack = NULL;
 			int32_t pid = avContextTab[cAVIdx]->streams[packet.stream_index]->id;
 			reset_finish_timeout();
+			stats_read(packet.size);
 			if (context->manager->video->Command(context, MANAGER_GET_TRACK, &videoTrack) < 0)
 			{
 				ffmpeg_err("error getting video track\n");
@@ -739,15 +736,16 @@ static void FFMPEGThread(Context_t *context)
 			{
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(56, 34, 100)
 				AVCodecContext *codec_context = videoTrack->avCodecCtx;
-				if (codec_context && codec_context->codec_id == AV_CODEC_ID_MPEG4 && NULL != mpeg4p2_bsf_context)
+				if (codec_context && codec_context->codec_id == AV_CODEC_ID_MPEG4 && mpeg4p2_filter_open(&mpeg4p2_context, codec_context))
 				{
 					// should never happen, if it does print error and exit immediately, so we can easily spot it
-					if (filter_packet(mpeg4p2_bsf_context, codec_context, &packet) < 0)
+					int filtered = filter_packet(&mpeg4p2_context, codec_context, &packet);
+					if (filtered < 0)
 					{
 						ffmpeg_err("cannot filter mpegp2 packet\n");
 						exit(1);
 					}
-					if (mpeg4p2_write_packet(context, &mpeg4p2_context, videoTrack, cAVIdx, &currentVideoPts, &latestPts, &packet) < 0)
+					if (filtered == 0 && mpeg4p2_write_packet(context, &mpeg4p2_context, videoTrack, cAVIdx, &currentVideoPts, &latestPts, &packet) < 0)
 					{
 						ffmpeg_err("cannot write mpeg4p2 packet\n");
 						exit(1);
@@ -893,181 +891,8 @@ static void FFMPEGThread(Context_t *context)
 				}
 				else if (audioTrack->inject_as_pcm == 1 && audioTrack->avCodecCtx)
 				{
-					AVCodecContext *c = audioTrack->avCodecCtx;
-					if (restart_audio_resampling)
-					{
-						restart_audio_resampling = 0;
-						if (swr)
-						{
-							swr_free(&swr);
-							swr = NULL;
-						}
-						if (decoded_frame)
-						{
-							wrapped_frame_free(&decoded_frame);
-							decoded_frame = NULL;
-						}
-					}
-#if (LIBAVFORMAT_VERSION_MAJOR > 57) || ((LIBAVFORMAT_VERSION_MAJOR == 57) && (LIBAVFORMAT_VERSION_MINOR > 32))
-					while (packet.size > 0 || (!packet.size && !packet.data))
-#else
-					while (packet.size > 0)
-#endif
-					{
-						if (do_seek_target_seconds || do_seek_target_bytes)
-						{
-							break;
-						}
-						if (!decoded_frame)
-						{
-							decoded_frame = wrapped_frame_alloc();
-							if (!decoded_frame)
-							{
-								ffmpeg_err("out of memory\n");
-								exit(1);
-							}
-						}
-						else
-						{
-							wrapped_frame_unref(decoded_frame);
-						}
-#if (LIBAVFORMAT_VERSION_MAJOR > 57) || ((LIBAVFORMAT_VERSION_MAJOR == 57) && (LIBAVFORMAT_VERSION_MINOR > 32))
-						int ret = avcodec_send_packet(c, &packet);
-						if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
-						{
-							restart_audio_resampling = 1;
-							break;
-						}
-						if (ret >= 0)
-						{
-							packet.size = 0;
-						}
-						ret = avcodec_receive_frame(c, decoded_frame);
-						if (ret < 0)
-						{
-							if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
-							{
-								restart_audio_resampling = 1;
-								break;
-							}
-							else
-							{
-								continue;
-							}
-						}
-#else
-						int32_t got_frame = 0;
-						int32_t len = avcodec_decode_audio4(c, decoded_frame, &got_frame, &packet);
-						if (len < 0)
-						{
-							ffmpeg_err("avcodec_decode_audio4: %d\n", len);
-							break;
-						}
-						packet.data += len;
-						packet.size -= len;
-						if (!got_frame)
-						{
-							continue;
-						}
-#endif
-						int32_t e = 0;
-						if (!swr)
-						{
-							if (insert_pcm_as_lpcm)
-							{
-								out_sample_rate = 48000;
-							}
-							else
-							{
-								int32_t rates[] = { 48000, 96000, 192000, 44100, 88200, 176400, 0 };
-								int32_t *rate = rates;
-								int32_t in_rate = c->sample_rate;
-								while (*rate && ((*rate / in_rate) * in_rate != *rate) && (in_rate / *rate) * *rate != in_rate)
-								{
-									rate++;
-								}
-								out_sample_rate = *rate ? *rate : 44100;
-							}
-							swr = swr_alloc();
-							out_channels = c->channels;
-							if (c->channel_layout == 0)
-							{
-								c->channel_layout = av_get_default_channel_layout(c->channels);
-							}
-							out_channel_layout = c->channel_layout;
-							uint8_t downmix = stereo_software_decoder && out_channels > 2 ? 1 : 0;
-#ifdef __sh__
-							// player2 won't play mono
-							if (out_channel_layout == AV_CH_LAYOUT_MONO)
-							{
-								downmix = 1;
-							}
-#endif
-							if (downmix)
-							{
-								out_channel_layout = AV_CH_LAYOUT_STEREO_DOWNMIX;
-								out_channels = 2;
-							}
-							av_opt_set_int(swr, "in_channel_layout",    c->channel_layout,  0);
-							av_opt_set_int(swr, "out_channel_layout",   out_channel_layout, 0);
-							av_opt_set_int(swr, "in_sample_rate",       c->sample_rate,     0);
-							av_opt_set_int(swr, "out_sample_rate",      out_sample_rate,    0);
-							av_opt_set_int(swr, "in_sample_fmt",        c->sample_fmt,      0);
-							av_opt_set_int(swr, "out_sample_fmt",       AV_SAMPLE_FMT_S16,  0);
-							e = swr_init(swr);
-							if (e < 0)
-							{
-								ffmpeg_err("swr_init: %d (icl=%d ocl=%d isr=%d osr=%d isf=%d osf=%d\n",
-								           -e, (int32_t)c->channel_layout, (int32_t)out_channel_layout, c->sample_rate, out_sample_rate, c->sample_fmt, AV_SAMPLE_FMT_S16);
-								swr_free(&swr);
-								swr = NULL;
-							}
-						}
-						uint8_t *output[8] = {NULL};
-						int32_t in_samples = decoded_frame->nb_samples;
-						int32_t out_samples = av_rescale_rnd(swr_get_delay(swr, c->sample_rate) + in_samples, out_sample_rate, c->sample_rate, AV_ROUND_UP);
-						e = av_samples_alloc(&output[0], NULL, out_channels, out_samples, AV_SAMPLE_FMT_S16, 1);
-						if (e < 0)
-						{
-							ffmpeg_err("av_samples_alloc: %d\n", -e);
-							continue;
-						}
-						int64_t next_in_pts = av_rescale(av_frame_get_best_effort_timestamp(decoded_frame),
-						                                 ((AVStream *) audioTrack->stream)->time_base.num * (int64_t)out_sample_rate * c->sample_rate,
-						                                 ((AVStream *) audioTrack->stream)->time_base.den);
-						int64_t next_out_pts = av_rescale(swr_next_pts(swr, next_in_pts),
-						                                  ((AVStream *) audioTrack->stream)->time_base.den,
-						                                  ((AVStream *) audioTrack->stream)->time_base.num * (int64_t)out_sample_rate * c->sample_rate);
-						currentAudioPts = audioTrack->pts = pts = calcPts(cAVIdx, audioTrack->stream, next_out_pts);
-						out_samples = swr_convert(swr, &output[0], out_samples, (const uint8_t **) &decoded_frame->data[0], in_samples);
-						//////////////////////////////////////////////////////////////////////
-						// Update pcmExtradata according to decode parameters
-						pcmExtradata.channels              = av_get_channel_layout_nb_channels(out_channel_layout);
-						pcmExtradata.bits_per_coded_sample = 16;
-						pcmExtradata.sample_rate           = out_sample_rate;
-						// The data described by the sample format is always in native-endian order
-#ifdef WORDS_BIGENDIAN
-						pcmExtradata.ffmpeg_codec_id       = AV_CODEC_ID_PCM_S16BE;
-#else
-						pcmExtradata.ffmpeg_codec_id       = AV_CODEC_ID_PCM_S16LE;
-#endif
-						//////////////////////////////////////////////////////////////////////
-						avOut.data       = output[0];
-						avOut.len        = out_samples * sizeof(int16_t) * out_channels;
-						avOut.pts        = pts;
-						avOut.extradata  = (unsigned char *) &pcmExtradata;
-						avOut.extralen   = sizeof(pcmExtradata);
-						avOut.frameRate  = 0;
-						avOut.timeScale  = 0;
-						avOut.width      = 0;
-						avOut.height     = 0;
-						avOut.type       = "audio";
-						if (!context->playback->BackWard && context->output->audio->Write(context, &avOut) < 0)
-						{
-							ffmpeg_err("writing data to audio device failed\n");
-						}
-						av_freep(&output[0]);
-					}
+					audio_decoder_put(context, &packet, audioTrack, cAVIdx, &pcmExtradata, restart_audio_resampling);
+					restart_audio_resampling = 0;
 				}
 				else if (audioTrack->have_aacheader == 1)
 				{
@@ -1156,6 +981,8 @@ static void FFMPEGThread(Context_t *context)
 			}
 			if (!is_finish_timeout() && !context->playback->isTSLiveMode)
 			{
+				// nothing more to read, let the decoders have the rest
+				context->output->Command(context, OUTPUT_DRAIN, NULL);
 				isWaitingForFinish = 1;
 				update_finish_timeout();
 				releaseMutex(__FILE__, __FUNCTION__, __LINE__);
@@ -1211,20 +1038,9 @@ static void FFMPEGThread(Context_t *context)
 		wrapped_packet_unref(&packet);
 		releaseMutex(__FILE__, __FUNCTION__, __LINE__);
 	} /* while */
-	if (swr)
-	{
-		swr_free(&swr);
-	}
-	if (decoded_frame)
-	{
-		wrapped_frame_free(&decoded_frame);
-	}
+	audio_decoder_stop();
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(56, 34, 100)
-	mpeg4p2_context_reset(&mpeg4p2_context);
-	if (NULL != mpeg4p2_bsf_context)
-	{
-		av_bitstream_filter_close(mpeg4p2_bsf_context);
-	}
+	mpeg4p2_context_free(&mpeg4p2_context);
 #endif
 	hasPlayThreadStarted = 0;
 	context->playback->isPlaying = 0;
@@ -1582,11 +1398,17 @@ int32_t container_ffmpeg_init_av_context(Context_t *context, char *filename, int
 						avContextTab[AVIdx]->pb->read_packet = ffmpeg_read;
 						ffmpeg_seek_org = avContextTab[AVIdx]->pb->seek;
 						avContextTab[AVIdx]->pb->seek = ffmpeg_seek;
-						ffmpeg_buf_read = ffmpeg_buf;
-						ffmpeg_buf_write = ffmpeg_buf;
-						//fill buffer
-						ffmpeg_filler(context, -1, NULL, 0);
-						ffmpeg_start_fillerTHREAD(context);
+						ffmpeg_buf_rpos = 0;
+						ffmpeg_buf_wpos = 0;
+						//fill buffer up to the high watermark
+						if (ffmpeg_start_fillerTHREAD(context) == 0)
+						{
+							ffmpeg_buf_prebuffer(FILLBUFREBUFFERTIME);
+						}
+						else
+						{
+							ffmpeg_filler(context, -1, NULL, 0);
+						}
 					}
 				}
 			}
@@ -2253,6 +2075,7 @@ static int32_t container_ffmpeg_stop(Context_t *context)
 	}
 	hasPlayThreadStarted = 0;
 	terminating = 1;
+	ffmpeg_stop_fillerTHREAD();
 	getMutex(__FILE__, __FUNCTION__, __LINE__);
 	free_all_stored_avcodec_context();
 	uint32_t i = 0;
@@ -2687,6 +2510,7 @@ static int32_t Command(void *_context, ContainerCmd_t command, void *argument)
 	    command != CONTAINER_SET_BUFFER_SIZE &&
 	    command != CONTAINER_GET_BUFFER_SIZE &&
 	    command != CONTAINER_GET_BUFFER_STATUS &&
+	    command != CONTAINER_GET_BUFFER_EMPTY_TIME &&
 	    command != CONTAINER_STOP_BUFFER &&
 	    command != CONTAINER_INIT && !avContextTab[0])
 	{
@@ -2764,6 +2588,19 @@ static int32_t Command(void *_context, ContainerCmd_t command, void *argument)
 			*((int32_t *)argument) = size;
 			break;
 		}
+		case CONTAINER_GET_BUFFER_STATUS:
+		{
+			int32_t size = 0;
+			ret = container_get_fillbufstatus(&size, NULL);
+			*((int32_t *)argument) = size;
+			break;
+		}
+		case CONTAINER_GET_BUFFER_EMPTY_TIME:
+		{
+			int32_t size = 0;
+			ret = container_get_fillbufstatus(&size, (int32_t *)argument);
+			break;
+		}
 		case CONTAINER_GET_METADATA:
 		{
 			ret = container_ffmpeg_get_metadata(context, (char ***) argument);
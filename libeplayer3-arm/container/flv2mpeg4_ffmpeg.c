@@ -3,6 +3,7 @@
 // http://forum.doom9.org/archive/index.php/t-157998.html
 //
 
+#include <time.h>
 #include "flv2mpeg4/flv2mpeg4.h"
 
 typedef struct
@@ -13,8 +14,27 @@ typedef struct
 
 	Context_t *out_ctx;
 	Track_t   *track;
+
+	int64_t write_us; // spent in the video output during the current packet
 } Flv2Mpeg4Context;
 
+// converted frames and the cpu time it took, device writes excluded
+static uint64_t flv2mpeg4_frames = 0;
+static int64_t flv2mpeg4_cpu_us = 0;
+
+static int64_t flv2mpeg4_cpu_time_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void flv2mpeg4_converter_stats(uint64_t *frames, int64_t *cpu_us)
+{
+	*frames = flv2mpeg4_frames;
+	*cpu_us = flv2mpeg4_cpu_us;
+}
+
 static int flv2mpeg4_context_write_packet_cb(void *usr_data, int keyframe, int pts, const uint8_t *buf, int size)
 {
 	Flv2Mpeg4Context *ctx = usr_data;
@@ -34,10 +54,12 @@ static int flv2mpeg4_context_write_packet_cb(void *usr_data, int keyframe, int p
 	avOut.width      = ctx->track->width;
 	avOut.height     = ctx->track->height;
 	avOut.type       = "video";
+	int64_t start = flv2mpeg4_cpu_time_us();
 	if (ctx->out_ctx->output->video->Write(ctx->out_ctx, &avOut) < 0)
 	{
 		ffmpeg_err("writing data to video device failed\n");
 	}
+	ctx->write_us += flv2mpeg4_cpu_time_us() - start;
 	return 0;
 }
 
@@ -78,5 +100,10 @@ static int flv2mpeg4_write_packet(Context_t *out_ctx, Flv2Mpeg4Context *mpeg4p2_
 	mpeg4p2_ctx->out_ctx = out_ctx;
 	mpeg4p2_ctx->track = track;
 	uint32_t time_ms = (uint32_t)(track->pts / 90);
-	return flv2mpeg4_process_flv_packet(mpeg4p2_ctx->ctx, 0, pkt->data, pkt->size, time_ms);
+	int64_t start = flv2mpeg4_cpu_time_us();
+	mpeg4p2_ctx->write_us = 0;
+	int ret = flv2mpeg4_process_flv_packet(mpeg4p2_ctx->ctx, 0, pkt->data, pkt->size, time_ms);
+	flv2mpeg4_cpu_us += flv2mpeg4_cpu_time_us() - start - mpeg4p2_ctx->write_us;
+	flv2mpeg4_frames++;
+	return ret;
 }
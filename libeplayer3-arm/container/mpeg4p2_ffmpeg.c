@@ -5,6 +5,12 @@
 
 #define MPEG4P2_MAX_B_FRAMES_COUNT 5
 
+/* av_bsf_flush() resets the filter in place, older versions have to
+ * create it again */
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 35, 100)
+#define MPEG4P2_BSF_API
+#endif
+
 typedef struct
 {
 	int b_frames_count;
@@ -12,24 +18,113 @@ typedef struct
 	int64_t packet_duration;
 	AVPacket *b_frames[MPEG4P2_MAX_B_FRAMES_COUNT];
 	AVPacket *second_ip_frame;
+	PacketPool_t pool;
+#ifdef MPEG4P2_BSF_API
+	AVBSFContext *bsf_ctx;
+#else
+	AVBitStreamFilterContext *bsf_ctx;
+#endif
+	int bsf_failed; // mpeg4_unpack_bframes is not available, don't try again
+	int bsf_used; // packets went through the filter since the last reset
 } Mpeg4P2Context;
 
-static void set_packet(AVPacket **pkt_dest, AVPacket *pkt_src)
+/* on error *pkt_dest is NULL afterwards */
+static int set_packet(PacketPool_t *pool, AVPacket **pkt_dest, AVPacket *pkt_src)
 {
 	if (pkt_dest == NULL)
-		return;
+		return -1;
 	if (*pkt_dest != NULL)
 	{
 		wrapped_packet_unref(*pkt_dest);
-		av_free(*pkt_dest);
 	}
-	*pkt_dest = av_malloc(sizeof(AVPacket));
-	av_copy_packet(*pkt_dest, pkt_src);
+	else
+	{
+		*pkt_dest = packet_pool_get(pool);
+		if (*pkt_dest == NULL)
+		{
+			ffmpeg_err("out of memory\n");
+			return -1;
+		}
+	}
+	if (wrapped_packet_ref(*pkt_dest, pkt_src) < 0)
+	{
+		ffmpeg_err("cannot reference the packet\n");
+		packet_pool_put(pool, *pkt_dest);
+		*pkt_dest = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static void mpeg4p2_filter_close(Mpeg4P2Context *context)
+{
+	if (context->bsf_ctx != NULL)
+	{
+#ifdef MPEG4P2_BSF_API
+		av_bsf_free(&context->bsf_ctx);
+#else
+		av_bitstream_filter_close(context->bsf_ctx);
+#endif
+	}
+	context->bsf_ctx = NULL;
+	context->bsf_used = 0;
+}
+
+/* the filter is created with the first mpeg4 packet and kept until the
+ * end of playback, returns 0 if it is not available */
+static int mpeg4p2_filter_open(Mpeg4P2Context *context, AVCodecContext *enc_ctx)
+{
+	if (context->bsf_ctx != NULL)
+		return 1;
+	if (context->bsf_failed)
+		return 0;
+#ifdef MPEG4P2_BSF_API
+	const AVBitStreamFilter *filter = av_bsf_get_by_name("mpeg4_unpack_bframes");
+	if (filter == NULL || av_bsf_alloc(filter, &context->bsf_ctx) < 0)
+	{
+		context->bsf_ctx = NULL;
+	}
+	else if (avcodec_parameters_from_context(context->bsf_ctx->par_in, enc_ctx) < 0 || av_bsf_init(context->bsf_ctx) < 0)
+	{
+		av_bsf_free(&context->bsf_ctx);
+	}
+#else
+	(void)enc_ctx;
+	context->bsf_ctx = av_bitstream_filter_init("mpeg4_unpack_bframes");
+#endif
+	if (context->bsf_ctx == NULL)
+	{
+		ffmpeg_err("mpeg4_unpack_bframes not available\n");
+		context->bsf_failed = 1;
+		return 0;
+	}
+	return 1;
 }
 
-static int filter_packet(AVBitStreamFilterContext *bsf_ctx, AVCodecContext *enc_ctx, AVPacket *pkt)
+/* returns 1 if the filter kept the packet, nothing to write then */
+static int filter_packet(Mpeg4P2Context *context, AVCodecContext *enc_ctx, AVPacket *pkt)
 {
 	int ret;
+	context->bsf_used = 1;
+#ifdef MPEG4P2_BSF_API
+	ret = av_bsf_send_packet(context->bsf_ctx, pkt);
+	if (ret >= 0)
+	{
+		// mpeg4_unpack_bframes returns at most one packet for each one it gets
+		ret = av_bsf_receive_packet(context->bsf_ctx, pkt);
+		if (ret == AVERROR(EAGAIN))
+			return 1;
+	}
+	if (ret < 0)
+	{
+		ffmpeg_err("Failed to filter bitstream with filter %s for stream %d with codec %s\n",
+		           context->bsf_ctx->filter->name, pkt->stream_index,
+		           avcodec_get_name(enc_ctx->codec_id));
+		return -1;
+	}
+	return 0;
+#else
+	AVBitStreamFilterContext *bsf_ctx = context->bsf_ctx;
 	AVPacket new_pkt = *pkt;
 	ret = av_bitstream_filter_filter(bsf_ctx, enc_ctx, NULL,
 	                                 &new_pkt.data, &new_pkt.size,
@@ -60,8 +155,10 @@ static int filter_packet(AVBitStreamFilterContext *bsf_ctx, AVCodecContext *enc_
 	}
 	*pkt = new_pkt;
 	return 0;
+#endif
 }
 
+/* on discontinuity, drops the held back frames and the filter state */
 static void mpeg4p2_context_reset(Mpeg4P2Context *context)
 {
 	if (context == NULL)
@@ -69,22 +166,30 @@ static void mpeg4p2_context_reset(Mpeg4P2Context *context)
 	int i;
 	for (i = 0; i < MPEG4P2_MAX_B_FRAMES_COUNT; i++)
 	{
-		if (context->b_frames[i] != NULL)
-		{
-			wrapped_packet_unref(context->b_frames[i]);
-			av_free(context->b_frames[i]);
-		}
+		packet_pool_put(&context->pool, context->b_frames[i]);
 		context->b_frames[i] = NULL;
 	}
-	if (context->second_ip_frame != NULL)
-	{
-		wrapped_packet_unref(context->second_ip_frame);
-		av_free(context->second_ip_frame);
-	}
+	packet_pool_put(&context->pool, context->second_ip_frame);
 	context->second_ip_frame = NULL;
 	context->b_frames_count = 0;
 	context->first_ip_frame_written = 0;
 	context->packet_duration = 0;
+	if (context->bsf_used)
+	{
+#ifdef MPEG4P2_BSF_API
+		av_bsf_flush(context->bsf_ctx);
+		context->bsf_used = 0;
+#else
+		mpeg4p2_filter_close(context);
+#endif
+	}
+}
+
+static void mpeg4p2_context_free(Mpeg4P2Context *context)
+{
+	mpeg4p2_context_reset(context);
+	mpeg4p2_filter_close(context);
+	packet_pool_free(&context->pool);
 }
 
 static void mpeg4p2_write(Context_t *ctx, Track_t *track, int avContextIdx, int64_t *pts_current, int64_t *pts_latest, AVPacket *pkt)
@@ -144,8 +249,7 @@ static int mpeg4p2_write_packet(Context_t *ctx, Mpeg4P2Context *mpeg4p2_ctx, Tra
 				}
 				else if (!mpeg4p2_ctx->second_ip_frame)
 				{
-					set_packet(&mpeg4p2_ctx->second_ip_frame, pkt);
-					return 0;
+					return set_packet(&mpeg4p2_ctx->pool, &mpeg4p2_ctx->second_ip_frame, pkt);
 				}
 				else
 				{
@@ -154,8 +258,7 @@ static int mpeg4p2_write_packet(Context_t *ctx, Mpeg4P2Context *mpeg4p2_ctx, Tra
 						mpeg4p2_ctx->second_ip_frame->pts = mpeg4p2_ctx->second_ip_frame->dts + mpeg4p2_ctx->packet_duration;
 						ffmpeg_printf(100, "Writing second I/P packet(1)\n");
 						mpeg4p2_write(ctx, track, cAVIdx, pts_current, pts_latest, mpeg4p2_ctx->second_ip_frame);
-						set_packet(&mpeg4p2_ctx->second_ip_frame, pkt);
-						return 0;
+						return set_packet(&mpeg4p2_ctx->pool, &mpeg4p2_ctx->second_ip_frame, pkt);
 					}
 					else
 					{
@@ -168,7 +271,10 @@ static int mpeg4p2_write_packet(Context_t *ctx, Mpeg4P2Context *mpeg4p2_ctx, Tra
 						}
 						ffmpeg_printf(100, "Writing second I/P packet(2)\n");
 						mpeg4p2_write(ctx, track, cAVIdx, pts_current, pts_latest, mpeg4p2_ctx->second_ip_frame);
-						set_packet(&mpeg4p2_ctx->second_ip_frame, pkt);
+						if (set_packet(&mpeg4p2_ctx->pool, &mpeg4p2_ctx->second_ip_frame, pkt) < 0)
+						{
+							return -1;
+						}
 						for (i = 0; i < mpeg4p2_ctx->b_frames_count; i++)
 						{
 							ffmpeg_printf(100, "Writing B-frame[%d]\n", i);
@@ -196,7 +302,11 @@ static int mpeg4p2_write_packet(Context_t *ctx, Mpeg4P2Context *mpeg4p2_ctx, Tra
 				else
 				{
 					ffmpeg_printf(100, "Storing B-Frame\n");
-					set_packet(&mpeg4p2_ctx->b_frames[mpeg4p2_ctx->b_frames_count++], pkt);
+					if (set_packet(&mpeg4p2_ctx->pool, &mpeg4p2_ctx->b_frames[mpeg4p2_ctx->b_frames_count], pkt) < 0)
+					{
+						return -1;
+					}
+					mpeg4p2_ctx->b_frames_count++;
 					return 0;
 				}
 			case 4:
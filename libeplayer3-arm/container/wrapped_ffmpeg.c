@@ -39,6 +39,68 @@ static void wrapped_packet_unref(void *param)
 #endif
 }
 
+static int wrapped_packet_ref(AVPacket *dst, AVPacket *src)
+{
+#if (LIBAVCODEC_VERSION_MAJOR > 55)
+	return av_packet_ref(dst, src);
+#else
+	return av_copy_packet(dst, src);
+#endif
+}
+
+/* Recycles the AVPacket structs of one stream. The payload is only
+ * referenced, so taking a packet over from av_read_frame() copies nothing.
+ */
+#define PACKET_POOL_MAX 16
+
+typedef struct
+{
+	AVPacket *free[PACKET_POOL_MAX];
+	int32_t count;
+} PacketPool_t;
+
+static AVPacket *packet_pool_get(PacketPool_t *pool)
+{
+	AVPacket *pkt;
+	if (pool->count > 0)
+	{
+		return pool->free[--pool->count];
+	}
+	pkt = av_malloc(sizeof(AVPacket));
+	if (pkt)
+	{
+		av_init_packet(pkt);
+		pkt->data = NULL;
+		pkt->size = 0;
+	}
+	return pkt;
+}
+
+static void packet_pool_put(PacketPool_t *pool, AVPacket *pkt)
+{
+	if (pkt == NULL)
+	{
+		return;
+	}
+	wrapped_packet_unref(pkt);
+	if (pool->count < PACKET_POOL_MAX)
+	{
+		pool->free[pool->count++] = pkt;
+	}
+	else
+	{
+		av_free(pkt);
+	}
+}
+
+static void packet_pool_free(PacketPool_t *pool)
+{
+	while (pool->count > 0)
+	{
+		av_free(pool->free[--pool->count]);
+	}
+}
+
 static void wrapped_set_max_analyze_duration(void *param, int val __attribute__((unused)))
 {
 #if (LIBAVFORMAT_VERSION_MAJOR > 55) && (LIBAVFORMAT_VERSION_MAJOR < 56)
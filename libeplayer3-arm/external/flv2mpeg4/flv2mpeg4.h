@@ -38,6 +38,8 @@ typedef struct
 
 flv2mpeg4_CTX *flv2mpeg4_init_ctx(void *priv_data, int width, int height, flv2mpeg4_write_packet_cb wp_cb, flv2mpeg4_write_extradata_cb we_cb);
 void flv2mpeg4_set_frame(flv2mpeg4_CTX *ctx, int frame, int icounter);
+/* buf must be readable for at least 4 bytes past size, the bit reader
+ * loads whole words. AVPacket data has AV_INPUT_BUFFER_PADDING_SIZE */
 int flv2mpeg4_process_flv_packet(flv2mpeg4_CTX *ctx, uint8_t picture_type, const uint8_t *buf, uint32_t size, uint32_t time);
 int flv2mpeg4_prepare_extra_data(flv2mpeg4_CTX *ctx);
 void flv2mpeg4_release_ctx(flv2mpeg4_CTX **pub_ctx);
@@ -78,46 +78,40 @@ static void skip(BR *p, uint32 skip)
 	p->read += skip;
 }
 
-static uint32 show_bits(BR *p, uint32 bits)
+// one unaligned word load, bits + bitoffset must not exceed 32.
+// Near the end it reads up to 4 bytes past the data, like the byte
+// wise load did before: the input needs that much padding, see
+// flv2mpeg4_process_flv_packet()
+static uint32 __inline show_bits(BR *p, uint32 bits)
 {
-	const uint8 *pp;
-	uint32 tmp;
-	pp = p->buf + p->read;
-	tmp = (pp[0] << 24) | (pp[1] << 16) | (pp[2] << 8) | (pp[3]);
+	uint32 tmp = load_be32(p->buf + p->read);
 	tmp <<= p->bitoffset;
 	tmp >>= 32 - bits;
 	return tmp;
 }
 
-static int32 show_sbits(BR *p, uint32 bits)
+static int32 __inline show_sbits(BR *p, uint32 bits)
 {
-	const uint8 *pp;
-	int32 tmp;
-	pp = p->buf + p->read;
-	tmp = (pp[0] << 24) | (pp[1] << 16) | (pp[2] << 8) | (pp[3]);
-	tmp <<= p->bitoffset;
+	int32 tmp = (int32)(load_be32(p->buf + p->read) << p->bitoffset);
 	tmp >>= 32 - bits;
 	return tmp;
 }
 
-static void flash_bits(BR *p, uint32 bits)
+static void __inline flash_bits(BR *p, uint32 bits)
 {
-	if (bits > 0)
-	{
-		bits = bits + p->bitoffset;
-		p->read += bits >> 3;
-		p->bitoffset = bits & 7;
-	}
+	bits += p->bitoffset;
+	p->read += bits >> 3;
+	p->bitoffset = bits & 7;
 }
 
-static uint32 get_bits(BR *p, uint32 bits)
+static uint32 __inline get_bits(BR *p, uint32 bits)
 {
 	uint32 tmp = show_bits(p, bits);
 	flash_bits(p, bits);
 	return tmp;
 }
 
-static int32 get_sbits(BR *p, uint32 bits)
+static int32 __inline get_sbits(BR *p, uint32 bits)
 {
 	int32 tmp = show_sbits(p, bits);
 	flash_bits(p, bits);
@@ -34,8 +34,8 @@ typedef struct _BW
 	uint8 *buf;
 	uint32 size;
 	uint32 pos;
-	uint32 bitoffset;
-	uint32 tmp;
+	uint32 bitoffset; // bits pending in tmp, always < 32 between calls
+	uint64 tmp;
 
 } BW;
 
@@ -54,35 +54,16 @@ static void __inline init_bw(BW *p, uint8 *buf, uint32 size)
 	clear_bw(p);
 }
 
-static void __inline forword_bits(BW *p, uint32 bits)
+// bits <= 32, value must fit into bits
+static void __inline put_bits(BW *p, uint32 bits, uint32 value)
 {
+	p->tmp = (p->tmp << bits) | value;
 	p->bitoffset += bits;
 	if (p->bitoffset >= 32)
 	{
-		p->buf[p->pos++] = (p->tmp >> 24) & 0xff;
-		p->buf[p->pos++] = (p->tmp >> 16) & 0xff;
-		p->buf[p->pos++] = (p->tmp >> 8) & 0xff;
-		p->buf[p->pos++] = (p->tmp >> 0) & 0xff;
-		p->tmp = 0;
 		p->bitoffset -= 32;
-	}
-}
-
-static void __inline put_bits(BW *p, uint32 bits, uint32 value)
-{
-	uint32 shift = 32 - p->bitoffset - bits;
-	if (shift <= 32)
-	{
-		p->tmp |= value << shift;
-		forword_bits(p, bits);
-	}
-	else
-	{
-		shift = bits - (32 - p->bitoffset);
-		p->tmp |= value >> shift;
-		forword_bits(p, bits - shift);
-		p->tmp |= value << (32 - shift);
-		forword_bits(p, shift);
+		store_be32(p->buf + p->pos, (uint32)(p->tmp >> p->bitoffset));
+		p->pos += 4;
 	}
 }
 
@@ -98,28 +79,12 @@ static void __inline pad_to_boundary(BW *p)
 static void __inline flash_bw(BW *p)
 {
 	pad_to_boundary(p);
-	switch (p->bitoffset)
+	while (p->bitoffset)
 	{
-		case 0: // nothing to do
-			break;
-		case 8:
-			p->buf[p->pos++] = (p->tmp >> 24) & 0xff;
-			break;
-		case 16:
-			p->buf[p->pos++] = (p->tmp >> 24) & 0xff;
-			p->buf[p->pos++] = (p->tmp >> 16) & 0xff;
-			break;
-		case 24:
-			p->buf[p->pos++] = (p->tmp >> 24) & 0xff;
-			p->buf[p->pos++] = (p->tmp >> 16) & 0xff;
-			p->buf[p->pos++] = (p->tmp >> 8) & 0xff;
-			break;
-		default:
-//		fprintf(stderr, "flash_bw error!(%d)\n", p->bitoffset);
-			break;
+		p->bitoffset -= 8;
+		p->buf[p->pos++] = (p->tmp >> p->bitoffset) & 0xff;
 	}
 	p->tmp = 0;
-	p->bitoffset = 0;
 }
 
 static uint32 __inline get_bw_pos(BW *p)
@@ -39,7 +39,19 @@ static const uint8 mpeg4_c_dc_scale_table[32] =
 	0, 8, 8, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15, 16, 16, 17, 17, 18, 18, 19, 20, 21, 22, 23, 24, 25
 };
 
-static int __inline get_pred(int *dc_cur, int stride, int scale)
+// M4V ADDED, (1 << 20) / scale + 1, 0 for scale 0
+static const uint32 mpeg4_y_dc_scale_inv_table[32] =
+{
+	0, 131073, 131073, 131073, 131073, 104858, 87382, 74899, 65537, 61681, 58255, 55189, 52429, 49933, 47663, 45591, 43691, 41944, 40330, 38837, 37450, 36158, 34953, 33826, 32769, 30841, 29128, 27595, 26215, 24967, 23832, 22796
+};
+
+// M4V ADDED
+static const uint32 mpeg4_c_dc_scale_inv_table[32] =
+{
+	0, 131073, 131073, 131073, 131073, 116509, 116509, 104858, 104858, 95326, 95326, 87382, 87382, 80660, 80660, 74899, 74899, 69906, 69906, 65537, 65537, 61681, 61681, 58255, 58255, 55189, 52429, 49933, 47663, 45591, 43691, 41944
+};
+
+static int __inline get_pred(int *dc_cur, int stride, int scale, uint32 scale_inv)
 {
 	/* B C
 	   A X */
@@ -55,7 +67,7 @@ static int __inline get_pred(int *dc_cur, int stride, int scale)
 	{
 		pred = A;
 	}
-	return (pred + (scale >> 1)) / scale;
+	return DC_SCALE_DIV(pred + (scale >> 1), scale_inv);
 }
 
 static void __inline set_dc_to_dc_cur(int *dc_cur, int level, int scale)
@@ -95,6 +107,18 @@ static int __inline get_scale(M4V_DCPRED *pred, int n)
 	}
 }
 
+static uint32 __inline get_scale_inv(M4V_DCPRED *pred, int n)
+{
+	if (n < 4)
+	{
+		return pred->y_dc_scale_inv;
+	}
+	else
+	{
+		return pred->c_dc_scale_inv;
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void dcpred_set_qscale(M4V_DCPRED *pred, int qscale)
 {
@@ -102,6 +126,8 @@ void dcpred_set_qscale(M4V_DCPRED *pred, int qscale)
 	if (qscale > 31) qscale = 31;
 	pred->y_dc_scale = mpeg4_y_dc_scale_table[qscale];
 	pred->c_dc_scale = mpeg4_c_dc_scale_table[qscale];
+	pred->y_dc_scale_inv = mpeg4_y_dc_scale_inv_table[qscale];
+	pred->c_dc_scale_inv = mpeg4_c_dc_scale_inv_table[qscale];
 }
 
 void dcpred_set_pos(M4V_DCPRED *pred, int mb_x, int mb_y)
@@ -117,7 +143,7 @@ int dcpred_for_enc(M4V_DCPRED *p, int n, int level)
 {
 	int *dc_cur = p->dc_cur[n];
 	int scale = get_scale(p, n);
-	int pred = get_pred(dc_cur, p->stride[n], scale);
+	int pred = get_pred(dc_cur, p->stride[n], scale, get_scale_inv(p, n));
 	set_dc_to_dc_cur(dc_cur, level, scale);
 	return level - pred;
 }
@@ -126,7 +152,7 @@ int dcpred_for_dec(M4V_DCPRED *p, int n, int level)
 {
 	int *dc_cur = p->dc_cur[n];
 	int scale = get_scale(p, n);
-	int pred = get_pred(dc_cur, p->stride[n], scale);
+	int pred = get_pred(dc_cur, p->stride[n], scale, get_scale_inv(p, n));
 	level += pred;
 	set_dc_to_dc_cur(dc_cur, level, scale);
 	return level;
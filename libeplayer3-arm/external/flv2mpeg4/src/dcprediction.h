@@ -39,9 +39,14 @@ typedef struct _M4V_DCPRED
 
 	int y_dc_scale;
 	int c_dc_scale;
+	uint32 y_dc_scale_inv;
+	uint32 c_dc_scale_inv;
 
 } M4V_DCPRED;
 
+// x / scale for 0 <= x < 4096 without a division, inv = (1 << 20) / scale + 1
+#define DC_SCALE_DIV(x, inv) ((int)(((uint32)(x) * (inv)) >> 20))
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void dcpred_set_qscale(M4V_DCPRED *pred, int qscale);
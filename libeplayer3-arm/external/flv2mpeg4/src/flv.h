@@ -36,10 +36,11 @@
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 typedef struct _BLOCK
 {
-	int block[64];
+	int block[64]; // zigzag scan order, only written up to last_index
 
 	int index;
 	int last_index;
+	uint64 nz; // non-zero coefficients, bit n for block[n]
 
 } BLOCK;
 
@@ -52,16 +52,16 @@ typedef struct
 #define PACKETBUFFER_SIZE   (256*1024*4)
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-static const uint8 ff_mpeg4_y_dc_scale_table[32] =
+// (1 << 20) / ff_mpeg4_y_dc_scale_table[qscale] + 1, see DC_SCALE_DIV()
+static const uint32 ff_mpeg4_y_dc_scale_inv_table[32] =
 {
-//  0  1  2  3  4  5  6  7  8  9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 31
-	0, 8, 8, 8, 8, 10, 12, 14, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 34, 36, 38, 40, 42, 44, 46
+	0, 131073, 131073, 131073, 131073, 104858, 87382, 74899, 65537, 61681, 58255, 55189, 52429, 49933, 47663, 45591, 43691, 41944, 40330, 38837, 37450, 36158, 34953, 33826, 32769, 30841, 29128, 27595, 26215, 24967, 23832, 22796
 };
 
-static const uint8 ff_mpeg4_c_dc_scale_table[32] =
+// (1 << 20) / ff_mpeg4_c_dc_scale_table[qscale] + 1
+static const uint32 ff_mpeg4_c_dc_scale_inv_table[32] =
 {
-//  0  1  2  3  4  5  6  7  8  9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 31
-	0, 8, 8, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15, 16, 16, 17, 17, 18, 18, 19, 20, 21, 22, 23, 24, 25
+	0, 131073, 131073, 131073, 131073, 116509, 116509, 104858, 104858, 95326, 95326, 87382, 87382, 80660, 80660, 74899, 74899, 69906, 69906, 65537, 65537, 61681, 61681, 58255, 58255, 55189, 52429, 49933, 47663, 45591, 43691, 41944
 };
 
 static void copy_vol(PICTURE *flv_pic, M4V_VOL *vol)
@@ -88,28 +88,56 @@ static void copy_vop(PICTURE *flv_pic, M4V_VOP *vop, CONVCTX *c)
 	}
 }
 
+static void __inline clear_microblock(MICROBLOCK *mb)
+{
+	int i;
+	mb->dquant = 0;
+	mb->intra = 0;
+	mb->skip = 0;
+	mb->mv_type = MV_TYPE_16X16;
+	// no motion vectors of the previous macroblock in a skipped or intra one
+	memset(mb->mv_x, 0, sizeof(mb->mv_x));
+	memset(mb->mv_y, 0, sizeof(mb->mv_y));
+	for (i = 0; i < 6; i++)
+	{
+		mb->block[i].block[0] = 0;
+		mb->block[i].last_index = -1;
+		mb->block[i].nz = 0;
+	}
+}
+
 static void copy_microblock(MICROBLOCK *flv_mb, M4V_MICROBLOCK *m4v_mb)
 {
 	int i;
 	m4v_mb->dquant = flv_mb->dquant;
-	memcpy(m4v_mb->block, flv_mb->block, sizeof(m4v_mb->block)); // !!!!!!!
 	m4v_mb->intra = flv_mb->intra;
 	m4v_mb->skip = flv_mb->skip;
 	m4v_mb->mv_type = flv_mb->mv_type;
 	memcpy(m4v_mb->mv_x, flv_mb->mv_x, sizeof(m4v_mb->mv_x)); // !!!!!!
 	memcpy(m4v_mb->mv_y, flv_mb->mv_y, sizeof(m4v_mb->mv_y)); // !!!!!!
+	// only the coded part of the blocks, the rest is never read
+	for (i = 0; i < 6; i++)
+	{
+		M4V_BLOCK *dst = &m4v_mb->block[i];
+		const BLOCK *src = &flv_mb->block[i];
+		dst->last_index = src->last_index;
+		dst->nz = src->nz;
+		dst->block[0] = src->block[0];
+		if (src->last_index > 0)
+		{
+			memcpy(dst->block + 1, src->block + 1, src->last_index * sizeof(int));
+		}
+	}
 	// dc rescale
 	if (m4v_mb->intra)
 	{
 		for (i = 0; i < 4; i++)
 		{
-			m4v_mb->block[i].block[0] *= 8;
-			m4v_mb->block[i].block[0] /= ff_mpeg4_y_dc_scale_table[m4v_mb->qscale];
+			m4v_mb->block[i].block[0] = DC_SCALE_DIV(m4v_mb->block[i].block[0] * 8, ff_mpeg4_y_dc_scale_inv_table[m4v_mb->qscale]);
 		}
 		for (i = 4; i < 6; i++)
 		{
-			m4v_mb->block[i].block[0] *= 8;
-			m4v_mb->block[i].block[0] /= ff_mpeg4_c_dc_scale_table[m4v_mb->qscale];
+			m4v_mb->block[i].block[0] = DC_SCALE_DIV(m4v_mb->block[i].block[0] * 8, ff_mpeg4_c_dc_scale_inv_table[m4v_mb->qscale]);
 		}
 	}
 }
@@ -151,6 +179,9 @@ static int write_m4v_picture_frame(flv2mpeg4_CTX *pub_ctx, CONVCTX *c, BR *br, B
 	int x, y;
 	int mb_width = (flvpic->width + 15) / 16;
 	int mb_height = (flvpic->height + 15) / 16;
+	// cleared once, per macroblock only the fields the decoder does not always set
+	memset(&mb, 0, sizeof(mb));
+	memset(&m4v_mb, 0, sizeof(m4v_mb));
 	memset(&vop, 0, sizeof(vop));
 	copy_vop(flvpic, &vop, c);
 	m4v_encode_vop_header(bw, &vop, VOL_TIME_BITS, 0);
@@ -159,8 +190,7 @@ static int write_m4v_picture_frame(flv2mpeg4_CTX *pub_ctx, CONVCTX *c, BR *br, B
 	{
 		for (x = 0; x < mb_width; x++)
 		{
-			memset(&mb, 0, sizeof(mb));
-			memset(&m4v_mb, 0, sizeof(m4v_mb));
+			clear_microblock(&mb);
 			if (vop.picture_type == M4V_I_TYPE)
 			{
 				mb.intra = 1;
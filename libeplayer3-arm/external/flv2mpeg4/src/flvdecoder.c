@@ -30,14 +30,6 @@
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-static const uint8 zig_zag_scan[64] =
-{
-	0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
-	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
-	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
-	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
-};
-
 static const VLCtab vlc_table_intra_MCBPC[] = //: table_size=72 table_allocated=128 bits=6
 {
 	{64, -3},
@@ -236,7 +228,9 @@ static int __inline decode_AC(BR *p, BLOCK *block, int escape_type, int i)
 			printf("run overflow..\n");
 			return -1;
 		}
-		block->block[zig_zag_scan[i]] = level;
+		// kept in scan order, the encoder uses the same zigzag scan
+		block->block[i] = level;
+		if (level) block->nz |= (uint64)1 << i;
 		if (last) break;
 		i++;
 	}
@@ -254,6 +248,7 @@ static int __inline decode_intra_block(BR *p, BLOCK *block, int escape_type, int
 	}
 	block->block[0] = level;
 	block->last_index = 0;
+	block->nz = 0;
 	if (!coded)
 	{
 		return 0;
@@ -265,6 +260,7 @@ static int __inline decode_intra_block(BR *p, BLOCK *block, int escape_type, int
 static int __inline decode_inter_block(BR *p, BLOCK *block, int escape_type, int coded)
 {
 	block->last_index = -1;
+	block->nz = 0;
 	if (!coded)
 	{
 		return 0;
@@ -43,10 +43,11 @@
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 typedef struct _M4V_BLOCK
 {
-	int block[64];
+	int block[64]; // zigzag scan order, only valid up to last_index
 
 	int index;
 	int last_index;
+	uint64 nz; // non-zero coefficients, bit n for block[n]
 
 } M4V_BLOCK;
 
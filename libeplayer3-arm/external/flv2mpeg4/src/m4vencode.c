@@ -107,32 +107,26 @@ static void __inline encode_DC(BW *p, int level, int n)
 
 static void __inline encode_escape_3(BW *p, int last, int run, int level)
 {
-#if 0
+	// escape, escape3, last, run, marker, level, marker in one go (30 bits)
 	put_bits(p,
-	         7 + 2 + 1 + 6 + 1 + 12 + 1, //30bit
+	         7 + 2 + 1 + 6 + 1 + 12 + 1,
 	         (3 << 23) + (3 << 21) + (last << 20) + (run << 14) + (1 << 13) + (((level - 64) & 0xfff) << 1) + 1);
-#else
-	put_bits(p, 7, 3); // escape
-	put_bits(p, 2, 3); // escape3
-	put_bits(p, 1, last);
-	put_bits(p, 6, run);
-	put_bits(p, 1, 1); // marker
-	put_bits(p, 12, ((level - 64) & 0xfff));
-	put_bits(p, 1, 1); // marker
-#endif
 }
 
 #define UNI_MPEG4_ENC_INDEX(last, run, level) ((last)*128*64 + (run)*128 + (level))
 
 static void __inline encode_AC(BW *p, M4V_BLOCK *block, int intra)
 {
-	int i = intra;
 	int last_index = block->last_index;
-	int last_non_zero = i - 1;
-	const uint8  *scan_table = zig_zag_scan; // !!!
-#if 1
+	int last_non_zero = intra - 1;
+	uint64 nz;
 	const uint8  *len_tab;
 	const uint32 *bits_tab;
+	if (last_index < intra)
+	{
+		// nothing coded
+		return;
+	}
 	if (intra)
 	{
 		len_tab  = uni_mpeg4_intra_rl_len;
@@ -143,29 +137,28 @@ static void __inline encode_AC(BW *p, M4V_BLOCK *block, int intra)
 		len_tab  = uni_mpeg4_inter_rl_len;
 		bits_tab = uni_mpeg4_inter_rl_bits;
 	}
-	for (; i < last_index; i++)
+	// coefficients are in scan order, walk the non-zero ones before the last
+	nz = block->nz & (((uint64)1 << last_index) - 1);
+	while (nz)
 	{
-		int level = block->block[scan_table[i]];
-		if (level)
+		int i = __builtin_ctzll(nz);
+		int level = block->block[i] + 64;
+		int run = i - last_non_zero - 1;
+		if ((level & (~127)) == 0)
 		{
-			int run = i - last_non_zero - 1;
-			level += 64;
-			if ((level & (~127)) == 0)
-			{
-				const int index = UNI_MPEG4_ENC_INDEX(0, run, level);
-				put_bits(p, len_tab[index], bits_tab[index]);
-			}
-			else
-			{
-				encode_escape_3(p, 0, run, level);
-			}
-			last_non_zero = i;
+			const int index = UNI_MPEG4_ENC_INDEX(0, run, level);
+			put_bits(p, len_tab[index], bits_tab[index]);
 		}
+		else
+		{
+			encode_escape_3(p, 0, run, level);
+		}
+		last_non_zero = i;
+		nz &= nz - 1;
 	}
 	{
-		int level = block->block[scan_table[i]];
-		int run = i - last_non_zero - 1;
-		level += 64;
+		int level = block->block[last_index] + 64;
+		int run = last_index - last_non_zero - 1;
 		if ((level & (~127)) == 0)
 		{
 			const int index = UNI_MPEG4_ENC_INDEX(1, run, level);
@@ -176,86 +169,6 @@ static void __inline encode_AC(BW *p, M4V_BLOCK *block, int intra)
 			encode_escape_3(p, 1, run, level);
 		}
 	}
-#else
-	const RL *rl;
-	int last, sign, code;
-	if (intra)
-	{
-		rl = &rl_intra;
-	}
-	else
-	{
-		rl = &rl_inter;
-	}
-	for (; i <= last_index; i++)
-	{
-		const int slevel = block->block[scan_table[i]];
-		if (slevel)
-		{
-			int level;
-			int run = i - last_non_zero - 1;
-			last = (i == last_index);
-			sign = 0;
-			level = slevel;
-			if (level < 0)
-			{
-				sign = 1;
-				level = -level;
-			}
-			code = get_rl_index(rl, last, run, level);
-			put_bits(p, rl->table_vlc[code][1], rl->table_vlc[code][0]);
-			if (code == rl->n)
-			{
-				int level1, run1;
-				level1 = level - rl->max_level[run][last];
-				if (level1 < 1)
-					goto esc2;
-				code = get_rl_index(rl, last, run, level1);
-				if (code == rl->n)
-				{
-esc2:
-					put_bits(p, 1, 1);
-					if (level > 64)
-						goto esc3;
-					run1 = run - rl->max_run[level][last] - 1;
-					if (run1 < 0)
-						goto esc3;
-					code = get_rl_index(rl, last, run1, level);
-					if (code == rl->n)
-					{
-esc3:
-						/* third escape */
-						put_bits(p, 1, 1);
-						put_bits(p, 1, last);
-						put_bits(p, 6, run);
-						put_bits(p, 1, 1);
-						put_bits(p, 12, slevel & 0xfff);
-						put_bits(p, 1, 1);
-					}
-					else
-					{
-						/* second escape */
-						put_bits(p, 1, 0);
-						put_bits(p, rl->table_vlc[code][1], rl->table_vlc[code][0]);
-						put_bits(p, 1, sign);
-					}
-				}
-				else
-				{
-					/* first escape */
-					put_bits(p, 1, 0);
-					put_bits(p, rl->table_vlc[code][1], rl->table_vlc[code][0]);
-					put_bits(p, 1, sign);
-				}
-			}
-			else
-			{
-				put_bits(p, 1, sign);
-			}
-			last_non_zero = i;
-		}
-	}
-#endif
 }
 
 static void __inline encode_intra_block(BW *bw, M4V_BLOCK *block, int n)
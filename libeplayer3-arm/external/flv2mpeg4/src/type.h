@@ -23,15 +23,38 @@
 #ifndef TYPE_H
 #define TYPE_H
 
+#include <string.h>
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 typedef unsigned char   uint8;
 typedef unsigned short  uint16;
 typedef unsigned int    uint32;
+typedef unsigned long long uint64;
 
 typedef signed char     int8;
 typedef signed short    int16;
 typedef signed int      int32;
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// big endian word access, unaligned
+static uint32 __inline load_be32(const uint8 *p)
+{
+	uint32 v;
+	memcpy(&v, p, 4);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static void __inline store_be32(uint8 *p, uint32 v)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	memcpy(p, &v, 4);
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 typedef struct _VLCDEC
 {
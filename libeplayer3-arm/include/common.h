@@ -26,5 +26,7 @@ typedef struct Context_s
 } Context_t;
 
 int container_ffmpeg_update_tracks(Context_t *context, char *filename, int initial);
+/* output pause / continue of the buffering, 1 if it was sent */
+int8_t PlaybackRebuffer(Context_t *context, int8_t pause);
 
 #endif
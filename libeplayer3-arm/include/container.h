@@ -25,7 +25,8 @@ typedef enum
 	CONTAINER_GET_BUFFER_SIZE,
 	CONTAINER_GET_BUFFER_STATUS,
 	CONTAINER_STOP_BUFFER,
-	CONTAINER_GET_METADATA
+	CONTAINER_GET_METADATA,
+	CONTAINER_GET_BUFFER_EMPTY_TIME
 } ContainerCmd_t;
 
 typedef struct Container_s
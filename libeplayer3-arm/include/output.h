@@ -28,6 +28,7 @@ typedef enum
 	OUTPUT_DISCONTINUITY_REVERSE,
 	OUTPUT_GET_FRAME_COUNT,
 	OUTPUT_GET_PROGRESSIVE,
+	OUTPUT_DRAIN, /* write out what the output still holds back */
 } OutputCmd_t;
 
 typedef struct
@@ -74,6 +75,7 @@ typedef struct Output_s
 
 extern Output_t LinuxDvbOutput;
 extern Output_t SubtitleOutput;
+extern Output_t NullOutput;
 
 typedef struct OutputHandler_s
 {
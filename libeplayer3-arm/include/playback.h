@@ -23,7 +23,8 @@ typedef enum {
 	PLAYBACK_SLOWMOTION,
 	PLAYBACK_FASTBACKWARD,
 	PLAYBACK_GET_FRAME_COUNT,
-	PLAYBACK_METADATA
+	PLAYBACK_METADATA,
+	PLAYBACK_STATS
 } PlaybackCmd_t;
 
 typedef struct PlaybackHandler_s
@@ -0,0 +1,20 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdint.h>
+#include <playback_stats.h>
+
+/* input and device write statistics, see playback_stats.h */
+
+void stats_reset(void);
+void stats_read(uint32_t bytes);
+/* stream: PLAYBACK_STATS_VIDEO / _AUDIO, usec: duration of the device write */
+void stats_write(int32_t stream, uint32_t bytes, int64_t pts, int64_t usec, int32_t ok);
+/* usec: waited for the device to have room */
+void stats_blocked(int32_t stream, int64_t usec);
+void stats_seek_start(void);
+void stats_seek_flushed(void);
+void stats_get(playback_stats_t *stats);
+int64_t stats_time_us(void);
+
+#endif
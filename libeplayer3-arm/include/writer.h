@@ -87,4 +87,13 @@ Writer_t *getDefaultAudioWriter();
 ssize_t write_with_retry(int fd, const void *buf, size_t size);
 ssize_t writev_with_retry(int fd, const struct iovec *iov, size_t ic);
 
+/* staging of non-blocking devices, see writer.c */
+void writer_stage_open(int fd);
+void writer_stage_close(int fd);
+void writer_stage_clear(int fd);
+void writer_stage_drain(void);
+uint64_t writer_stage_blocked_us(int fd);
+void writer_sink_open(int fd);
+uint64_t writer_sink_bytes(int fd);
+
 #endif
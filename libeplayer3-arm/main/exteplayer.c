@@ -17,6 +17,7 @@
  *
  */
 #include <stdlib.h>
+#include <malloc.h>
 #include <stdio.h>
 #include <string.h>
 #include <fcntl.h>
@@ -39,6 +40,7 @@
 
 #include "common.h"
 #include "misc.h"
+#include "stats.h"
 
 #define DUMP_BOOL(x) 0 == x ? "false"  : "true"
 #define IPTV_MAX_FILE_PATH 1024
@@ -53,12 +55,17 @@ extern void eac3_software_decoder_set(const int32_t val);
 extern void mp3_software_decoder_set(const int32_t val);
 extern void rtmp_proto_impl_set(const int32_t val);
 extern void flv2mpeg4_converter_set(const int32_t val);
+#ifdef HAVE_FLV2MPEG4_CONVERTER
+extern void flv2mpeg4_converter_stats(uint64_t *frames, int64_t *cpu_us);
+#endif
 extern void sel_program_id_set(const int32_t val);
 
 extern void pcm_resampling_set(int32_t val);
 extern void stereo_software_decoder_set(int32_t val);
 extern void insert_pcm_as_lpcm_set(int32_t val);
 extern void progressive_playback_set(int32_t val);
+extern void null_output_realtime_set(int32_t val);
+extern void null_output_print_stats(void);
 
 extern OutputHandler_t         OutputHandler;
 extern PlaybackHandler_t       PlaybackHandler;
@@ -66,6 +73,22 @@ extern ContainerHandler_t      ContainerHandler;
 extern ManagerHandler_t        ManagerHandler;
 
 static Context_t *g_player = NULL;
+static int g_benchmark = 0;
+
+/* heap in use, for the benchmark report; -1 when the libc can't tell */
+static long long GetHeapInUse(void)
+{
+#if defined(__GLIBC__) && !defined(__UCLIBC__)
+#if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33)
+	struct mallinfo2 mi = mallinfo2();
+#else
+	struct mallinfo mi = mallinfo();
+#endif
+	return (long long)mi.uordblks + (long long)mi.hblkhd;
+#else
+	return -1;
+#endif
+}
 
 static void TerminateAllSockets(void)
 {
@@ -480,6 +503,41 @@ static void UpdateVideoTrack()
 	HandleTracks(g_player->manager->video, (PlaybackCmd_t) - 1, "vc");
 }
 
+static void BenchmarkReport(int64_t startUs, long long heapStart)
+{
+	playback_stats_t st;
+	int64_t us = stats_time_us() - startUs;
+	int i;
+	memset(&st, 0, sizeof(st));
+	g_player->playback->Command(g_player, PLAYBACK_STATS, &st);
+	if (us <= 0)
+	{
+		us = 1;
+	}
+	fprintf(stderr, "{\"BENCHMARK\":{\"ms\":%lld, \"read_bytes\":%llu, \"read_kBps\":%lld, \"heap_delta\":%lld, \"seeks\":%u, \"seek_latency_last\":%u, \"seek_latency_max\":%u}}\n",
+	        (long long)(us / 1000), (unsigned long long)st.read_bytes, (long long)(st.read_bytes * 1000 / us),
+	        heapStart >= 0 ? GetHeapInUse() - heapStart : -1LL, st.seeks, st.seek_latency_last, st.seek_latency_max);
+	for (i = 0; i < PLAYBACK_STATS_STREAMS; i++)
+	{
+		fprintf(stderr, "{\"BENCHMARK_STREAM\":{\"stream\":\"%s\", \"packets\":%llu, \"bytes\":%llu, \"write_errors\":%llu, \"write_latency_max\":%u}}\n",
+		        i == PLAYBACK_STATS_VIDEO ? "video" : "audio", (unsigned long long)st.stream[i].packets, (unsigned long long)st.stream[i].bytes,
+		        (unsigned long long)st.stream[i].write_errors, st.stream[i].write_latency_max);
+	}
+#ifdef HAVE_FLV2MPEG4_CONVERTER
+	{
+		uint64_t frames;
+		int64_t cpuUs;
+		flv2mpeg4_converter_stats(&frames, &cpuUs);
+		if (frames)
+		{
+			fprintf(stderr, "{\"BENCHMARK_FLV2MPEG4\":{\"frames\":%llu, \"cpu_ms\":%lld, \"us_per_frame\":%lld}}\n",
+			        (unsigned long long)frames, (long long)(cpuUs / 1000), (long long)(cpuUs / (int64_t)frames));
+		}
+	}
+#endif
+	null_output_print_stats();
+}
+
 static int ParseParams(int argc, char *argv[], char *file, char *audioFile, int *pAudioTrackIdx, int *subtitleTrackIdx)
 {
 	int ret = 0;
@@ -487,7 +545,7 @@ static int ParseParams(int argc, char *argv[], char *file, char *audioFile, int
 	//int digit_optind = 0;
 	//int aopt = 0, bopt = 0;
 	//char *copt = 0, *dopt = 0;
-	while ((c = getopt(argc, argv, "we3dlsrimva:n:x:u:c:h:o:p:P:t:9:0:1:4:f:")) != -1)
+	while ((c = getopt(argc, argv, "we3dlsrimva:b:n:x:u:c:h:o:p:P:t:9:0:1:4:f:")) != -1)
 	{
 		switch (c)
 		{
@@ -499,6 +557,11 @@ static int ParseParams(int argc, char *argv[], char *file, char *audioFile, int
 				aac_latm_software_decoder_set(flag & 0x02);
 				break;
 			}
+			case 'b':
+				printf("Benchmark, null output%s\n", atoi(optarg) ? " at real-time pace" : "");
+				g_benchmark = 1;
+				null_output_realtime_set(atoi(optarg));
+				break;
 			case 'e':
 				printf("Software decoder will be used for EAC3 codec\n");
 				eac3_software_decoder_set(1);
@@ -640,6 +703,7 @@ int main(int argc, char *argv[])
 	{
 		printf("Usage: exteplayer3 filePath [-u user-agent] [-c cookies] [-h headers] [-p prio] [-a] [-d] [-w] [-l] [-s] [-i] [-t audioTrackId] [-9 subtitleTrackId] [-x separateAudioUri] plabackUri\n");
 		printf("[-a 0|1|2|3] AAC software decoding - 1 bit - AAC ADTS, 2 - bit AAC LATM\n");
+		printf("[-b 0|1] benchmark: no decoder devices, PES to memory, as fast as possible(0) or at real-time pace(1)\n");
 		printf("[-e] EAC3 software decoding\n");
 		printf("[-3] AC3 software decoding\n");
 		printf("[-d] DTS software decoding\n");
@@ -707,6 +771,11 @@ int main(int argc, char *argv[])
 	g_player->output->Command(g_player, OUTPUT_ADD, "audio");
 	g_player->output->Command(g_player, OUTPUT_ADD, "video");
 	g_player->output->Command(g_player, OUTPUT_ADD, "subtitle");
+	if (g_benchmark)
+	{
+		g_player->output->audio = &NullOutput;
+		g_player->output->video = &NullOutput;
+	}
 	g_player->manager->video->Command(g_player, MANAGER_REGISTER_UPDATED_TRACK_INFO, UpdateVideoTrack);
 	if (strncmp(file, "rtmp", 4) && strncmp(file, "ffrtmp", 4))
 	{
@@ -733,6 +802,8 @@ int main(int argc, char *argv[])
 		pthread_mutex_unlock(&playbackStartMtx);
 		commandRetVal = g_player->output->Command(g_player, OUTPUT_OPEN, NULL);
 		fprintf(stderr, "{\"OUTPUT_OPEN\":{\"sts\":%d}}\n", commandRetVal);
+		int64_t benchmarkStart = stats_time_us();
+		long long benchmarkHeap = GetHeapInUse();
 		commandRetVal = g_player->playback->Command(g_player, PLAYBACK_PLAY, NULL);
 		fprintf(stderr, "{\"PLAYBACK_PLAY\":{\"sts\":%d}}\n", commandRetVal);
 		if (g_player->playback->isPlaying)
@@ -959,6 +1030,10 @@ int main(int argc, char *argv[])
 				}
 			}
 		}
+		if (g_benchmark)
+		{
+			BenchmarkReport(benchmarkStart, benchmarkHeap);
+		}
 		g_player->output->Command(g_player, OUTPUT_CLOSE, NULL);
 	}
 	if (NULL != g_player)
@@ -44,6 +44,7 @@
 #include "writer.h"
 #include "misc.h"
 #include "pes.h"
+#include "stats.h"
 
 /* ***************************** */
 /* Makros/Constants              */
@@ -135,13 +136,14 @@ int LinuxDvbOpen(Context_t *context __attribute__((unused)), char *type)
 	linuxdvb_printf(10, "v%d a%d\n", video, audio);
 	if (video && videofd < 0)
 	{
-		videofd = open(VIDEODEV, O_RDWR | O_CLOEXEC);
+		videofd = open(VIDEODEV, O_RDWR | O_CLOEXEC | O_NONBLOCK);
 		if (videofd < 0)
 		{
 			linuxdvb_err("failed to open %s - errno %d\n", VIDEODEV, errno);
 			linuxdvb_err("%s\n", strerror(errno));
 			return cERR_LINUXDVB_ERROR;
 		}
+		writer_stage_open(videofd);
 		if (ioctl(videofd, VIDEO_CLEAR_BUFFER) == -1)
 		{
 			linuxdvb_err("ioctl failed with errno %d\n", errno);
@@ -160,13 +162,14 @@ int LinuxDvbOpen(Context_t *context __attribute__((unused)), char *type)
 	}
 	if (audio && audiofd < 0)
 	{
-		audiofd = open(AUDIODEV, O_RDWR | O_CLOEXEC);
+		audiofd = open(AUDIODEV, O_RDWR | O_CLOEXEC | O_NONBLOCK);
 		if (audiofd < 0)
 		{
 			linuxdvb_err("failed to open %s - errno %d\n", AUDIODEV, errno);
 			linuxdvb_err("%s\n", strerror(errno));
 			return cERR_LINUXDVB_ERROR;
 		}
+		writer_stage_open(audiofd);
 		if (ioctl(audiofd, AUDIO_CLEAR_BUFFER) == -1)
 		{
 			linuxdvb_err("ioctl failed with errno %d\n", errno);
@@ -199,11 +202,13 @@ int LinuxDvbClose(Context_t *context, char *type)
 	getLinuxDVBMutex(FILENAME, __FUNCTION__, __LINE__);
 	if (video && videofd != -1)
 	{
+		writer_stage_close(videofd);
 		close(videofd);
 		videofd = -1;
 	}
 	if (audio && audiofd != -1)
 	{
+		writer_stage_close(audiofd);
 		close(audiofd);
 		audiofd = -1;
 	}
@@ -260,6 +265,7 @@ int LinuxDvbPlay(Context_t *context, char *type)
 			linuxdvb_err("ioctl failed with errno %d\n", errno);
 			linuxdvb_err("VIDEO_CONTINUE: %s\n", strerror(errno));
 		}
+		writer_stage_clear(videofd);
 		if (ioctl(videofd, VIDEO_CLEAR_BUFFER) == -1)
 		{
 			linuxdvb_err("ioctl failed with errno %d\n", errno);
@@ -324,6 +330,7 @@ int LinuxDvbStop(Context_t *context __attribute__((unused)), char *type)
 	getLinuxDVBMutex(FILENAME, __FUNCTION__, __LINE__);
 	if (video && videofd != -1)
 	{
+		writer_stage_clear(videofd);
 		if (ioctl(videofd, VIDEO_CLEAR_BUFFER) == -1)
 		{
 			linuxdvb_err("ioctl failed with errno %d\n", errno);
@@ -341,6 +348,7 @@ int LinuxDvbStop(Context_t *context __attribute__((unused)), char *type)
 	}
 	if (audio && audiofd != -1)
 	{
+		writer_stage_clear(audiofd);
 		if (ioctl(audiofd, AUDIO_CLEAR_BUFFER) == -1)
 		{
 			linuxdvb_err("ioctl failed with errno %d\n", errno);
@@ -476,6 +484,8 @@ int LinuxDvbAudioMute(Context_t *context __attribute__((unused)), char *flag)
 
 int LinuxDvbFlush(Context_t *context __attribute__((unused)), char *type __attribute__((unused)))
 {
+	// hand what is still staged to the decoders
+	writer_stage_drain();
 	// unsigned char video = !strcmp("video", type);
 	// unsigned char audio = !strcmp("audio", type);
 	// linuxdvb_printf(10, "v%d a%d\n", video, audio);
@@ -636,6 +646,7 @@ int LinuxDvbClear(Context_t *context __attribute__((unused)), char *type)
 		getLinuxDVBMutex(FILENAME, __FUNCTION__, __LINE__);
 		if (video && videofd != -1)
 		{
+			writer_stage_clear(videofd);
 			if (ioctl(videofd, VIDEO_CLEAR_BUFFER) == -1)
 			{
 				linuxdvb_err("ioctl failed with errno %d\n", errno);
@@ -645,6 +656,7 @@ int LinuxDvbClear(Context_t *context __attribute__((unused)), char *type)
 		}
 		else if (audio && audiofd != -1)
 		{
+			writer_stage_clear(audiofd);
 			if (ioctl(audiofd, AUDIO_CLEAR_BUFFER) == -1)
 			{
 				linuxdvb_err("ioctl failed with errno %d\n", errno);
@@ -720,6 +732,7 @@ int LinuxDvbSwitch(Context_t *context, char *type)
 					linuxdvb_err("ioctl failed with errno %d\n", errno);
 					linuxdvb_err("AUDIO_STOP: %s\n", strerror(errno));
 				}
+				writer_stage_clear(audiofd);
 				if (ioctl(audiofd, AUDIO_CLEAR_BUFFER) == -1)
 				{
 					linuxdvb_err("ioctl failed with errno %d\n", errno);
@@ -766,6 +779,7 @@ int LinuxDvbSwitch(Context_t *context, char *type)
 					linuxdvb_err("ioctl failed with errno %d\n", errno);
 					linuxdvb_err("VIDEO_STOP: %s\n", strerror(errno));
 				}
+				writer_stage_clear(videofd);
 				if (ioctl(videofd, VIDEO_CLEAR_BUFFER) == -1)
 				{
 					linuxdvb_err("ioctl failed with errno %d\n", errno);
@@ -908,7 +922,11 @@ static int Write(void *_context, void *_out)
 			call.Version      = 0; // is unsingned char
 			if (writer->writeData)
 			{
+				int64_t start = stats_time_us();
+				uint64_t blocked = writer_stage_blocked_us(videofd);
 				res = writer->writeData(&call);
+				stats_write(PLAYBACK_STATS_VIDEO, out->len, out->pts, stats_time_us() - start, res >= 0);
+				stats_blocked(PLAYBACK_STATS_VIDEO, writer_stage_blocked_us(videofd) - blocked);
 			}
 			if (res < 0)
 			{
@@ -950,7 +968,11 @@ static int Write(void *_context, void *_out)
 			call.Version        = 0; /* -1; unsigned char cannot be negative */
 			if (writer->writeData)
 			{
+				int64_t start = stats_time_us();
+				uint64_t blocked = writer_stage_blocked_us(audiofd);
 				res = writer->writeData(&call);
+				stats_write(PLAYBACK_STATS_AUDIO, out->len, out->pts, stats_time_us() - start, res >= 0);
+				stats_blocked(PLAYBACK_STATS_AUDIO, writer_stage_blocked_us(audiofd) - blocked);
 			}
 			if (res < 0)
 			{
@@ -1107,6 +1129,12 @@ static int Command(void *_context, OutputCmd_t command, void *argument)
 			*((int *)argument) = videoInfo.progressive;
 			break;
 		}
+		case OUTPUT_DRAIN:
+		{
+			writer_stage_drain();
+			ret = cERR_LINUXDVB_NO_ERROR;
+			break;
+		}
 		default:
 			linuxdvb_err("ContainerCmd %d not supported!\n", command);
 			ret = cERR_LINUXDVB_ERROR;
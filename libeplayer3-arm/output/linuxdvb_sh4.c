@@ -1105,6 +1105,12 @@ static int Command(void *_context, OutputCmd_t command, void *argument)
 			*((int *)argument) = videoInfo.progressive;
 			break;
 		}
+		case OUTPUT_DRAIN:
+		{
+			// the sh4 writers write blocking, nothing is held back
+			ret = cERR_LINUXDVB_NO_ERROR;
+			break;
+		}
 		default:
 			linuxdvb_err("ContainerCmd %d not supported!\n", command);
 			ret = cERR_LINUXDVB_ERROR;
@@ -0,0 +1,441 @@
+/*
+ * Null output, for benchmarking without decoder devices.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+/* The packets run through the same writers as with the LinuxDvb output,
+ * the PES they build goes to a memory sink instead of the decoders. The
+ * clock is either the last pts written (as fast as possible) or runs in
+ * real time from the first pts, writes wait for it then.
+ */
+
+/* ***************************** */
+/* Includes                      */
+/* ***************************** */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <errno.h>
+
+#include "common.h"
+#include "output.h"
+#include "writer.h"
+#include "misc.h"
+#include "pes.h"
+#include "stats.h"
+
+/* ***************************** */
+/* Makros/Constants              */
+/* ***************************** */
+
+#define NULL_SILENT
+
+#ifdef NULL_DEBUG
+static unsigned short debug_level = 20;
+#define null_printf(level, fmt, x...) do { \
+if (debug_level >= level) printf("[%s:%s] " fmt, __FILE__, __FUNCTION__, ## x ); } while (0)
+#else
+#define null_printf(level, fmt, x...)
+#endif
+
+#ifndef NULL_SILENT
+#define null_err(fmt, x...) do { printf("[%s:%s] " fmt, __FILE__, __FUNCTION__, ## x); } while (0)
+#else
+#define null_err(fmt, x...)
+#endif
+
+#define cERR_NULL_NO_ERROR      0
+#define cERR_NULL_ERROR        -1
+
+#define NULL_MAX_WRITERS 8
+#define NULL_MAX_SLEEP_US 1000000 //pts jumps further are not waited for
+#define NULL_REANCHOR_MS 10000 //and this far the clock starts again
+
+/* ***************************** */
+/* Types                         */
+/* ***************************** */
+
+typedef struct
+{
+	const char *name;
+	uint64_t packets;
+	uint64_t bytes; //PES built from them
+	int64_t cpu_us;
+} NullWriterStats_t;
+
+/* ***************************** */
+/* Variables                     */
+/* ***************************** */
+
+static int videofd = -1;
+static int audiofd = -1;
+static int32_t realtime = 0;
+static pthread_mutex_t nullMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* the clock */
+static int64_t anchorUs = -1; //wall time of anchorPts
+static int64_t anchorPts = 0;
+static int64_t pausedUs = -1; //wall time the pause started, -1 if running
+static int64_t lastPts = 0;
+static uint64_t frameCount = 0;
+
+static NullWriterStats_t writerStats[NULL_MAX_WRITERS];
+static int32_t writerCount = 0;
+
+/* ***************************** */
+/* Functions                     */
+/* ***************************** */
+
+void null_output_realtime_set(int32_t val)
+{
+	realtime = val;
+}
+
+static int64_t cpu_time_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* nullMutex held */
+static NullWriterStats_t *writer_stats(Writer_t *writer)
+{
+	int32_t i;
+	for (i = 0; i < writerCount; i++)
+	{
+		if (writerStats[i].name == writer->caps->name)
+		{
+			return &writerStats[i];
+		}
+	}
+	if (writerCount == NULL_MAX_WRITERS)
+	{
+		return NULL;
+	}
+	memset(&writerStats[writerCount], 0, sizeof(NullWriterStats_t));
+	writerStats[writerCount].name = writer->caps->name;
+	return &writerStats[writerCount++];
+}
+
+void null_output_print_stats(void)
+{
+	int32_t i;
+	pthread_mutex_lock(&nullMutex);
+	for (i = 0; i < writerCount; i++)
+	{
+		fprintf(stderr, "{\"BENCHMARK_WRITER\":{\"name\":\"%s\", \"packets\":%llu, \"bytes\":%llu, \"cpu_ms\":%lld}}\n",
+		        writerStats[i].name, (unsigned long long)writerStats[i].packets,
+		        (unsigned long long)writerStats[i].bytes, (long long)(writerStats[i].cpu_us / 1000));
+	}
+	pthread_mutex_unlock(&nullMutex);
+}
+
+/* nullMutex held */
+static int64_t clock_pts(void)
+{
+	if (!realtime || anchorUs < 0)
+	{
+		return lastPts;
+	}
+	int64_t now = pausedUs >= 0 ? pausedUs : stats_time_us();
+	return anchorPts + (now - anchorUs) * 90 / 1000;
+}
+
+/* real time pace, waits until the clock reaches pts */
+static void pace(int64_t pts)
+{
+	int64_t wait;
+	pthread_mutex_lock(&nullMutex);
+	if (pts == INVALID_PTS_VALUE)
+	{
+		pthread_mutex_unlock(&nullMutex);
+		return;
+	}
+	if (anchorUs < 0 || llabs(pts - clock_pts()) > NULL_REANCHOR_MS * 90)
+	{
+		anchorUs = stats_time_us();
+		anchorPts = pts;
+	}
+	wait = (pts - clock_pts()) * 1000 / 90;
+	pthread_mutex_unlock(&nullMutex);
+	if (wait > 0)
+	{
+		usleep(wait > NULL_MAX_SLEEP_US ? NULL_MAX_SLEEP_US : wait);
+	}
+}
+
+static void clock_reset(void)
+{
+	pthread_mutex_lock(&nullMutex);
+	anchorUs = -1;
+	lastPts = 0;
+	if (pausedUs >= 0)
+	{
+		pausedUs = stats_time_us();
+	}
+	pthread_mutex_unlock(&nullMutex);
+}
+
+static int NullOpen(char *type)
+{
+	unsigned char video = !strcmp("video", type);
+	unsigned char audio = !strcmp("audio", type);
+	null_printf(10, "v%d a%d\n", video, audio);
+	// the writers want a valid fd, nothing is written to it
+	if (video && videofd < 0)
+	{
+		videofd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+		if (videofd < 0)
+		{
+			null_err("failed to open /dev/null - errno %d\n", errno);
+			return cERR_NULL_ERROR;
+		}
+		writer_sink_open(videofd);
+	}
+	if (audio && audiofd < 0)
+	{
+		audiofd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+		if (audiofd < 0)
+		{
+			null_err("failed to open /dev/null - errno %d\n", errno);
+			return cERR_NULL_ERROR;
+		}
+		writer_sink_open(audiofd);
+	}
+	return cERR_NULL_NO_ERROR;
+}
+
+static int NullClose(char *type)
+{
+	unsigned char video = !strcmp("video", type);
+	unsigned char audio = !strcmp("audio", type);
+	if (video && videofd != -1)
+	{
+		writer_stage_close(videofd);
+		close(videofd);
+		videofd = -1;
+	}
+	if (audio && audiofd != -1)
+	{
+		writer_stage_close(audiofd);
+		close(audiofd);
+		audiofd = -1;
+	}
+	return cERR_NULL_NO_ERROR;
+}
+
+static void reset(Context_t *context)
+{
+	Writer_t *writer;
+	char *Encoding = NULL;
+	context->manager->video->Command(context, MANAGER_GETENCODING, &Encoding);
+	writer = getWriter(Encoding);
+	if (writer != NULL)
+	{
+		writer->reset();
+	}
+	free(Encoding);
+	Encoding = NULL;
+	context->manager->audio->Command(context, MANAGER_GETENCODING, &Encoding);
+	writer = getWriter(Encoding);
+	if (writer != NULL)
+	{
+		writer->reset();
+	}
+	free(Encoding);
+}
+
+static int Write(void *_context, void *_out)
+{
+	Context_t          *context  = (Context_t *) _context;
+	AudioVideoOut_t    *out      = (AudioVideoOut_t *) _out;
+	unsigned char      video     = 0;
+	char               *Encoding = NULL;
+	Writer_t           *writer;
+	WriterAVCallData_t call;
+	int                res = 0;
+	if (out == NULL)
+	{
+		null_err("null pointer passed\n");
+		return cERR_NULL_ERROR;
+	}
+	video = !strcmp("video", out->type);
+	if (!video && strcmp("audio", out->type))
+	{
+		return cERR_NULL_ERROR;
+	}
+	if (video)
+	{
+		context->manager->video->Command(context, MANAGER_GETENCODING, &Encoding);
+		writer = getWriter(Encoding);
+		if (writer == NULL)
+		{
+			writer = getDefaultVideoWriter();
+		}
+	}
+	else
+	{
+		context->manager->audio->Command(context, MANAGER_GETENCODING, &Encoding);
+		writer = getWriter(Encoding);
+		if (writer == NULL)
+		{
+			writer = getDefaultAudioWriter();
+		}
+	}
+	free(Encoding);
+	if (writer == NULL || writer->writeData == NULL)
+	{
+		null_err("no writer\n");
+		return cERR_NULL_ERROR;
+	}
+	if (realtime)
+	{
+		pace(out->pts);
+	}
+	memset(&call, 0, sizeof(call));
+	call.fd           = video ? videofd : audiofd;
+	call.data         = out->data;
+	call.len          = out->len;
+	call.Pts          = out->pts;
+	call.Dts          = out->dts;
+	call.private_data = out->extradata;
+	call.private_size = out->extralen;
+	call.FrameRate    = out->frameRate;
+	call.FrameScale   = out->timeScale;
+	call.Width        = out->width;
+	call.Height       = out->height;
+	call.InfoFlags    = out->infoFlags;
+	call.Version      = 0;
+	uint64_t sunk = writer_sink_bytes(call.fd);
+	int64_t start = stats_time_us();
+	int64_t cpu = cpu_time_us();
+	res = writer->writeData(&call);
+	cpu = cpu_time_us() - cpu;
+	stats_write(video ? PLAYBACK_STATS_VIDEO : PLAYBACK_STATS_AUDIO, out->len, out->pts, stats_time_us() - start, res >= 0);
+	pthread_mutex_lock(&nullMutex);
+	NullWriterStats_t *ws = writer_stats(writer);
+	if (ws)
+	{
+		ws->packets++;
+		ws->bytes += writer_sink_bytes(call.fd) - sunk;
+		ws->cpu_us += cpu;
+	}
+	if (out->pts != INVALID_PTS_VALUE && (int64_t)out->pts > lastPts)
+	{
+		lastPts = out->pts;
+	}
+	if (video)
+	{
+		frameCount++;
+	}
+	pthread_mutex_unlock(&nullMutex);
+	return res < 0 ? cERR_NULL_ERROR : cERR_NULL_NO_ERROR;
+}
+
+static int Command(void *_context, OutputCmd_t command, void *argument)
+{
+	Context_t *context = (Context_t *) _context;
+	int ret = cERR_NULL_NO_ERROR;
+	null_printf(50, "Command %d\n", command);
+	switch (command)
+	{
+		case OUTPUT_OPEN:
+			ret = NullOpen((char *)argument);
+			break;
+		case OUTPUT_CLOSE:
+			ret = NullClose((char *)argument);
+			reset(context);
+			clock_reset();
+			break;
+		case OUTPUT_PLAY:
+			pthread_mutex_lock(&nullMutex);
+			pausedUs = -1;
+			frameCount = 0;
+			pthread_mutex_unlock(&nullMutex);
+			clock_reset();
+			break;
+		case OUTPUT_STOP:
+		case OUTPUT_FLUSH:
+		case OUTPUT_CLEAR:
+			reset(context);
+			clock_reset();
+			break;
+		case OUTPUT_PAUSE:
+			pthread_mutex_lock(&nullMutex);
+			if (pausedUs < 0)
+			{
+				pausedUs = stats_time_us();
+			}
+			pthread_mutex_unlock(&nullMutex);
+			break;
+		case OUTPUT_CONTINUE:
+			pthread_mutex_lock(&nullMutex);
+			if (pausedUs >= 0)
+			{
+				if (anchorUs >= 0)
+				{
+					anchorUs += stats_time_us() - pausedUs;
+				}
+				pausedUs = -1;
+			}
+			pthread_mutex_unlock(&nullMutex);
+			break;
+		case OUTPUT_PTS:
+			pthread_mutex_lock(&nullMutex);
+			*((unsigned long long int *)argument) = clock_pts();
+			pthread_mutex_unlock(&nullMutex);
+			break;
+		case OUTPUT_GET_FRAME_COUNT:
+			pthread_mutex_lock(&nullMutex);
+			*((unsigned long long int *)argument) = frameCount;
+			pthread_mutex_unlock(&nullMutex);
+			break;
+		case OUTPUT_GET_PROGRESSIVE:
+			*((int *)argument) = 0;
+			break;
+		case OUTPUT_FASTFORWARD:
+		case OUTPUT_REVERSE:
+		case OUTPUT_AVSYNC:
+		case OUTPUT_SWITCH:
+		case OUTPUT_SLOWMOTION:
+		case OUTPUT_AUDIOMUTE:
+		case OUTPUT_DISCONTINUITY_REVERSE:
+		case OUTPUT_DRAIN:
+			break;
+		default:
+			null_err("OutputCmd %d not supported!\n", command);
+			ret = cERR_NULL_ERROR;
+			break;
+	}
+	return ret;
+}
+
+static char *NullCapabilities[] = { "audio", "video", NULL };
+
+struct Output_s NullOutput =
+{
+	"Null",
+	&Command,
+	&Write,
+	NullCapabilities
+};
@@ -505,6 +505,26 @@ static int Command(void *_context, OutputCmd_t command, void *argument)
 			}
 			break;
 		}
+		case OUTPUT_DRAIN:
+		{
+			if (context && context->playback)
+			{
+				// audio and video share the device output
+				if (context->playback->isVideo)
+				{
+					ret = context->output->video->Command(context, OUTPUT_DRAIN, "video");
+				}
+				else if (context->playback->isAudio)
+				{
+					ret = context->output->audio->Command(context, OUTPUT_DRAIN, "audio");
+				}
+			}
+			else
+			{
+				ret = cERR_OUTPUT_INTERNAL_ERROR;
+			}
+			break;
+		}
 		case OUTPUT_GET_FRAME_COUNT:
 		{
 			if (context && context->playback)
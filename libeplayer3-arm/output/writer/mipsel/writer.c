@@ -26,6 +26,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/time.h>
 
 #include "misc.h"
 #include "writer.h"
@@ -52,10 +55,32 @@ if (debug_level >= level) printf(x); } while (0)
 #define writer_err(x...)
 #endif
 
+/* The decoder devices are opened non-blocking. What a device does not
+ * take right away is kept in a staging buffer of its own and written as
+ * soon as poll() reports room, so a full video decoder does not hold up
+ * the audio one and the other way round. A write only waits when the
+ * staging buffer of its device is full; the other devices are served
+ * meanwhile and the time spent waiting is counted per device.
+ */
+#define WRITER_STAGES      2
+#define WRITER_STAGE_SIZE  (256 * 1024)
+#define WRITER_POLL_MS     100 //check PlaybackDieNow that often while waiting
+
 /* ***************************** */
 /* Types                         */
 /* ***************************** */
 
+typedef struct
+{
+	int fd;
+	uint8_t *buf;
+	size_t pos; //first pending byte
+	size_t len; //end of the pending bytes
+	uint64_t blocked_us;
+	int sink; //memory sink of the null output, nothing reaches fd
+	uint64_t sink_bytes;
+} WriterStage_t;
+
 /* ***************************** */
 /* Variables                     */
 /* ***************************** */
@@ -92,6 +117,13 @@ static Writer_t *AvailableWriter[] =
 	NULL
 };
 
+static WriterStage_t stages[WRITER_STAGES] =
+{
+	{ -1, NULL, 0, 0, 0, 0, 0 },
+	{ -1, NULL, 0, 0, 0, 0, 0 }
+};
+static pthread_mutex_t stageMutex = PTHREAD_MUTEX_INITIALIZER;
+
 /* ***************************** */
 /* Prototypes                    */
 /* ***************************** */
@@ -100,8 +132,322 @@ static Writer_t *AvailableWriter[] =
 /*  Functions                    */
 /* ***************************** */
 
+static int64_t stage_time_us(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* stageMutex held */
+static WriterStage_t *stage_find(int fd)
+{
+	int i;
+	for (i = 0; fd >= 0 && i < WRITER_STAGES; i++)
+	{
+		if (stages[i].fd == fd)
+		{
+			return &stages[i];
+		}
+	}
+	return NULL;
+}
+
+/* stageMutex held, writes what the device takes without waiting,
+ * returns -1 on a device error */
+static int stage_flush(WriterStage_t *stage)
+{
+	while (stage->pos < stage->len)
+	{
+		ssize_t ret = write(stage->fd, stage->buf + stage->pos, stage->len - stage->pos);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			if (errno == EAGAIN)
+			{
+				return 0;
+			}
+			writer_err("write to fd %d failed: %s\n", stage->fd, strerror(errno));
+			stage->pos = stage->len = 0;
+			return -1;
+		}
+		stage->pos += ret;
+	}
+	stage->pos = stage->len = 0;
+	return 0;
+}
+
+/* waits until a device has room or the timeout passed, writing the
+ * pending data of every device that gets room meanwhile. The time is
+ * counted for stage, unless it is NULL */
+static void stage_wait(WriterStage_t *stage)
+{
+	struct pollfd pfd[WRITER_STAGES];
+	WriterStage_t *polled[WRITER_STAGES];
+	int n = 0;
+	int i;
+	int64_t start = stage_time_us();
+	pthread_mutex_lock(&stageMutex);
+	for (i = 0; i < WRITER_STAGES; i++)
+	{
+		if (stages[i].fd >= 0 && stages[i].pos < stages[i].len)
+		{
+			pfd[n].fd = stages[i].fd;
+			pfd[n].events = POLLOUT;
+			pfd[n].revents = 0;
+			polled[n++] = &stages[i];
+		}
+	}
+	pthread_mutex_unlock(&stageMutex);
+	if (n == 0)
+	{
+		return;
+	}
+	if (poll(pfd, n, WRITER_POLL_MS) > 0)
+	{
+		pthread_mutex_lock(&stageMutex);
+		for (i = 0; i < n; i++)
+		{
+			// a clear or close may have happened meanwhile
+			if (pfd[i].revents && polled[i]->fd == pfd[i].fd)
+			{
+				stage_flush(polled[i]);
+			}
+		}
+		pthread_mutex_unlock(&stageMutex);
+	}
+	if (stage)
+	{
+		pthread_mutex_lock(&stageMutex);
+		stage->blocked_us += stage_time_us() - start;
+		pthread_mutex_unlock(&stageMutex);
+	}
+}
+
+static void stage_open(int fd, int sink)
+{
+	int i;
+	pthread_mutex_lock(&stageMutex);
+	for (i = 0; i < WRITER_STAGES; i++)
+	{
+		if (stages[i].fd < 0)
+		{
+			if (stages[i].buf == NULL)
+			{
+				stages[i].buf = malloc(WRITER_STAGE_SIZE);
+			}
+			if (stages[i].buf != NULL)
+			{
+				stages[i].fd = fd;
+				stages[i].pos = stages[i].len = 0;
+				stages[i].blocked_us = 0;
+				stages[i].sink = sink;
+				stages[i].sink_bytes = 0;
+			}
+			break;
+		}
+	}
+	pthread_mutex_unlock(&stageMutex);
+}
+
+void writer_stage_open(int fd)
+{
+	stage_open(fd, 0);
+}
+
+/* the data written to fd is copied to memory and dropped, the copy
+ * stands in for the one into the decoder */
+void writer_sink_open(int fd)
+{
+	stage_open(fd, 1);
+}
+
+uint64_t writer_sink_bytes(int fd)
+{
+	WriterStage_t *stage;
+	uint64_t bytes = 0;
+	pthread_mutex_lock(&stageMutex);
+	stage = stage_find(fd);
+	if (stage)
+	{
+		bytes = stage->sink_bytes;
+	}
+	pthread_mutex_unlock(&stageMutex);
+	return bytes;
+}
+
+void writer_stage_close(int fd)
+{
+	WriterStage_t *stage;
+	pthread_mutex_lock(&stageMutex);
+	stage = stage_find(fd);
+	if (stage)
+	{
+		stage->fd = -1;
+		stage->pos = stage->len = 0;
+	}
+	pthread_mutex_unlock(&stageMutex);
+}
+
+void writer_stage_clear(int fd)
+{
+	WriterStage_t *stage;
+	pthread_mutex_lock(&stageMutex);
+	stage = stage_find(fd);
+	if (stage)
+	{
+		stage->pos = stage->len = 0;
+	}
+	pthread_mutex_unlock(&stageMutex);
+}
+
+void writer_stage_drain(void)
+{
+	int pending = 1;
+	while (pending && 0 == PlaybackDieNow(0))
+	{
+		int i;
+		pending = 0;
+		pthread_mutex_lock(&stageMutex);
+		for (i = 0; i < WRITER_STAGES; i++)
+		{
+			if (stages[i].fd >= 0)
+			{
+				stage_flush(&stages[i]);
+				pending |= stages[i].pos < stages[i].len;
+			}
+		}
+		pthread_mutex_unlock(&stageMutex);
+		if (pending)
+		{
+			stage_wait(NULL);
+		}
+	}
+}
+
+uint64_t writer_stage_blocked_us(int fd)
+{
+	WriterStage_t *stage;
+	uint64_t us = 0;
+	pthread_mutex_lock(&stageMutex);
+	stage = stage_find(fd);
+	if (stage)
+	{
+		us = stage->blocked_us;
+	}
+	pthread_mutex_unlock(&stageMutex);
+	return us;
+}
+
+/* keeps the order of the data of the device, the staged bytes go first */
+static ssize_t stage_write(WriterStage_t *stage, const uint8_t *buf, size_t size)
+{
+	pthread_mutex_lock(&stageMutex);
+	if (stage->sink)
+	{
+		stage->sink_bytes += size;
+		while (size > 0)
+		{
+			size_t room = WRITER_STAGE_SIZE - stage->len;
+			if (room == 0)
+			{
+				stage->len = 0;
+				continue;
+			}
+			if (room > size)
+			{
+				room = size;
+			}
+			memcpy(stage->buf + stage->len, buf, room);
+			stage->len += room;
+			size -= room;
+			buf += room;
+		}
+		stage->pos = stage->len;
+		pthread_mutex_unlock(&stageMutex);
+		return 0;
+	}
+	if (stage_flush(stage) < 0)
+	{
+		pthread_mutex_unlock(&stageMutex);
+		return -3;
+	}
+	while (size > 0 && stage->pos == stage->len)
+	{
+		ssize_t ret = write(stage->fd, buf, size);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			if (errno == EAGAIN)
+			{
+				break;
+			}
+			pthread_mutex_unlock(&stageMutex);
+			return -3;
+		}
+		size -= ret;
+		buf += ret;
+	}
+	while (size > 0)
+	{
+		size_t room;
+		if (stage->pos > 0)
+		{
+			memmove(stage->buf, stage->buf + stage->pos, stage->len - stage->pos);
+			stage->len -= stage->pos;
+			stage->pos = 0;
+		}
+		room = WRITER_STAGE_SIZE - stage->len;
+		if (room > 0)
+		{
+			if (room > size)
+			{
+				room = size;
+			}
+			memcpy(stage->buf + stage->len, buf, room);
+			stage->len += room;
+			size -= room;
+			buf += room;
+			continue;
+		}
+		pthread_mutex_unlock(&stageMutex);
+		if (PlaybackDieNow(0))
+		{
+			return -1;
+		}
+		stage_wait(stage);
+		pthread_mutex_lock(&stageMutex);
+		if (stage->fd < 0)
+		{
+			// closed meanwhile
+			break;
+		}
+		if (stage_flush(stage) < 0)
+		{
+			pthread_mutex_unlock(&stageMutex);
+			return -3;
+		}
+	}
+	pthread_mutex_unlock(&stageMutex);
+	return 0;
+}
+
 ssize_t write_with_retry(int fd, const void *buf, size_t size)
 {
+	WriterStage_t *stage;
+	pthread_mutex_lock(&stageMutex);
+	stage = stage_find(fd);
+	pthread_mutex_unlock(&stageMutex);
+	if (stage)
+	{
+		return stage_write(stage, buf, size);
+	}
 	ssize_t ret;
 	int retval = 0;
 	while (size > 0 && 0 == PlaybackDieNow(0))
@@ -23,6 +23,7 @@
 #include "playback.h"
 #include "common.h"
 #include "misc.h"
+#include "stats.h"
 
 /* ***************************** */
 /* Makros/Constants              */
@@ -62,6 +63,9 @@ if (debug_level >= level) printf("[%s:%s] " fmt, __FILE__, __FUNCTION__, ## x);
 
 static pthread_t supervisorThread;
 static int hasThreadStarted = 0;
+/* serializes the output pause / continue of the user and of the buffering */
+static pthread_mutex_t pauseMutex = PTHREAD_MUTEX_INITIALIZER;
+static int8_t rebufferPaused = 0; //the buffering holds the output paused
 
 /* ***************************** */
 /* Prototypes                    */
@@ -85,6 +89,34 @@ int8_t PlaybackDieNow(int8_t val)
 	return dieNow;
 }
 
+/* the buffering pauses the output while the ring fills up again.
+ * A pause by the user meanwhile wins, the buffering does not continue then */
+int8_t PlaybackRebuffer(Context_t *context, int8_t pause)
+{
+	int8_t ret = 0;
+	pthread_mutex_lock(&pauseMutex);
+	if (pause)
+	{
+		if (context->playback->isPlaying && !context->playback->isPaused && !rebufferPaused)
+		{
+			context->output->Command(context, OUTPUT_PAUSE, NULL);
+			rebufferPaused = 1;
+			ret = 1;
+		}
+	}
+	else if (rebufferPaused)
+	{
+		rebufferPaused = 0;
+		if (context->playback->isPlaying && !context->playback->isPaused)
+		{
+			context->output->Command(context, OUTPUT_CONTINUE, NULL);
+			ret = 1;
+		}
+	}
+	pthread_mutex_unlock(&pauseMutex);
+	return ret;
+}
+
 /* **************************** */
 /* Supervisor Thread            */
 /* **************************** */
@@ -245,6 +277,7 @@ static int PlaybackPlay(Context_t *context)
 			context->playback->BackWard     = 0;
 			context->playback->SlowMotion   = 0;
 			context->playback->Speed        = 1;
+			stats_reset();
 			if (hasThreadStarted == 0)
 			{
 				int error;
@@ -282,6 +315,7 @@ static int PlaybackPause(Context_t *context)
 {
 	int ret = cERR_PLAYBACK_NO_ERROR;
 	playback_printf(10, "\n");
+	pthread_mutex_lock(&pauseMutex);
 	if (context->playback->isPlaying && !context->playback->isPaused)
 	{
 		if (context->playback->SlowMotion)
@@ -299,6 +333,7 @@ static int PlaybackPause(Context_t *context)
 		playback_err("playback not playing or already in pause mode\n");
 		ret = cERR_PLAYBACK_ERROR;
 	}
+	pthread_mutex_unlock(&pauseMutex);
 	playback_printf(10, "exiting with value %d\n", ret);
 	return ret;
 }
@@ -306,7 +341,12 @@ static int PlaybackPause(Context_t *context)
 static int32_t PlaybackContinue(Context_t *context)
 {
 	int32_t ret = cERR_PLAYBACK_NO_ERROR;
+	int8_t rebuffering;
 	playback_printf(10, "\n");
+	pthread_mutex_lock(&pauseMutex);
+	/* a plain pause ends, but the buffering still holds the output, it continues */
+	rebuffering = rebufferPaused && context->playback->isPaused && !context->playback->isForwarding &&
+		      !context->playback->BackWard && !context->playback->SlowMotion;
 	if (context->playback->isPlaying &&
 	   (context->playback->isPaused || context->playback->isForwarding ||
 	    context->playback->BackWard || context->playback->SlowMotion))
@@ -321,13 +361,15 @@ static int32_t PlaybackContinue(Context_t *context)
 		context->playback->BackWard     = 0;
 		context->playback->SlowMotion   = 0;
 		context->playback->Speed        = 1;
-		context->output->Command(context, OUTPUT_CONTINUE, NULL);
+		if (!rebuffering)
+			context->output->Command(context, OUTPUT_CONTINUE, NULL);
 	}
 	else
 	{
 		playback_err("continue not possible\n");
 		ret = cERR_PLAYBACK_ERROR;
 	}
+	pthread_mutex_unlock(&pauseMutex);
 	playback_printf(10, "exiting with value %d\n", ret);
 	return ret;
 }
@@ -526,6 +568,7 @@ static int32_t PlaybackSeek(Context_t *context, int64_t *pos, uint8_t absolute)
 	if (context->playback->isPlaying && !context->playback->isForwarding && !context->playback->BackWard && !context->playback->SlowMotion && !context->playback->isPaused)
 	{
 		context->playback->isSeeking = 1;
+		stats_seek_start();
 		context->output->Command(context, OUTPUT_CLEAR, NULL);
 		if (absolute)
 		{
@@ -711,6 +754,32 @@ static int PlaybackMetadata(Context_t *context, char ***metadata)
 	return ret;
 }
 
+static int32_t PlaybackStats(Context_t *context, playback_stats_t *stats)
+{
+	int32_t size = 0;
+	int32_t status = 0;
+	int32_t emptyTime = -1;
+	playback_printf(20, "\n");
+	stats_get(stats);
+	stats->buffered_bytes = -1;
+	stats->buffer_size = -1;
+	stats->buffer_empty_ms = -1;
+	if (context->playback->isPlaying && context->container && context->container->selectedContainer)
+	{
+		context->container->selectedContainer->Command(context, CONTAINER_GET_BUFFER_SIZE, &size);
+		if (size > 0)
+		{
+			context->container->selectedContainer->Command(context, CONTAINER_GET_BUFFER_STATUS, &status);
+			context->container->selectedContainer->Command(context, CONTAINER_GET_BUFFER_EMPTY_TIME, &emptyTime);
+			stats->buffered_bytes = status;
+			stats->buffer_size = size;
+			stats->buffer_empty_ms = emptyTime;
+		}
+	}
+	/* the packets go straight from the demuxer to the device, there are no queues */
+	return cERR_PLAYBACK_NO_ERROR;
+}
+
 static int32_t Command(void *_context, PlaybackCmd_t command, void *argument)
 {
 	Context_t *context = (Context_t *) _context; /* to satisfy compiler */
@@ -813,6 +882,11 @@ static int32_t Command(void *_context, PlaybackCmd_t command, void *argument)
 			ret = PlaybackMetadata(context, (char ***) argument);
 			break;
 		}
+		case PLAYBACK_STATS:
+		{
+			ret = PlaybackStats(context, (playback_stats_t *)argument);
+			break;
+		}
 		default:
 			playback_err("PlaybackCmd %d not supported!\n", command);
 			ret = cERR_PLAYBACK_ERROR;
@@ -0,0 +1,133 @@
+/*
+ * GPL
+ * playback statistics
+ *
+ * Input bitrate is kept in one second slots, so the 1 / 10 / 60 second
+ * averages cost nothing per packet. Seeks are timed from the request
+ * to the first device write after the seek was done.
+ */
+
+/* ***************************** */
+/* Includes                      */
+/* ***************************** */
+
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "stats.h"
+#include "misc.h"
+
+/* ***************************** */
+/* Varaibles                     */
+/* ***************************** */
+
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+static playback_stats_t stats;
+static playback_stats_window_t window;
+static int64_t lastPts[PLAYBACK_STATS_STREAMS];
+static int64_t seekStart = 0;         /* of the pending seek, 0 if none */
+static int32_t seekFlushed = 0;       /* the next write completes it */
+
+/* ***************************** */
+/* Functions                     */
+/* ***************************** */
+
+int64_t stats_time_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void stats_reset(void)
+{
+	int32_t i;
+	pthread_mutex_lock(&statsMutex);
+	memset(&stats, 0, sizeof(stats));
+	playback_stats_window_reset(&window, stats_time_us() / 1000000);
+	for (i = 0; i < PLAYBACK_STATS_STREAMS; i++)
+		lastPts[i] = INVALID_PTS_VALUE;
+	seekStart = 0;
+	seekFlushed = 0;
+	pthread_mutex_unlock(&statsMutex);
+}
+
+void stats_read(uint32_t bytes)
+{
+	int64_t sec = stats_time_us() / 1000000;
+	pthread_mutex_lock(&statsMutex);
+	playback_stats_window_add(&window, sec, bytes);
+	stats.read_bytes += bytes;
+	pthread_mutex_unlock(&statsMutex);
+}
+
+void stats_write(int32_t stream, uint32_t bytes, int64_t pts, int64_t usec, int32_t ok)
+{
+	playback_stream_stats_t *st;
+	if (stream < 0 || stream >= PLAYBACK_STATS_STREAMS)
+		return;
+	pthread_mutex_lock(&statsMutex);
+	st = &stats.stream[stream];
+	if (!ok)
+	{
+		st->write_errors++;
+		pthread_mutex_unlock(&statsMutex);
+		return;
+	}
+	playback_stats_count_write(st, &lastPts[stream], INVALID_PTS_VALUE, bytes, pts, usec);
+
+	if (seekFlushed)
+	{
+		uint32_t ms = (stats_time_us() - seekStart) / 1000;
+		stats.seeks++;
+		stats.seek_latency_last = ms;
+		if (ms > stats.seek_latency_max)
+			stats.seek_latency_max = ms;
+		seekStart = 0;
+		seekFlushed = 0;
+	}
+	pthread_mutex_unlock(&statsMutex);
+}
+
+void stats_blocked(int32_t stream, int64_t usec)
+{
+	if (stream < 0 || stream >= PLAYBACK_STATS_STREAMS || usec <= 0)
+		return;
+	pthread_mutex_lock(&statsMutex);
+	stats.stream[stream].blocked_us += usec;
+	stats.stream[stream].blocked++;
+	pthread_mutex_unlock(&statsMutex);
+}
+
+void stats_seek_start(void)
+{
+	pthread_mutex_lock(&statsMutex);
+	/* a seek requested while another one is pending is timed from the first */
+	if (!seekStart)
+		seekStart = stats_time_us();
+	pthread_mutex_unlock(&statsMutex);
+}
+
+void stats_seek_flushed(void)
+{
+	int32_t i;
+	pthread_mutex_lock(&statsMutex);
+	for (i = 0; i < PLAYBACK_STATS_STREAMS; i++)
+		lastPts[i] = INVALID_PTS_VALUE;
+	if (seekStart)
+		seekFlushed = 1;
+	pthread_mutex_unlock(&statsMutex);
+}
+
+void stats_get(playback_stats_t *s)
+{
+	int64_t sec = stats_time_us() / 1000000;
+	pthread_mutex_lock(&statsMutex);
+	playback_stats_window_advance(&window, sec);
+	*s = stats;
+	s->bitrate_1s = playback_stats_window_bitrate(&window, sec, 1);
+	s->bitrate_10s = playback_stats_window_bitrate(&window, sec, 10);
+	s->bitrate_60s = playback_stats_window_bitrate(&window, sec, 60);
+	pthread_mutex_unlock(&statsMutex);
+}
@@ -0,0 +1,135 @@
+/*
+ * gathers small PES packets into fewer device writes
+ *
+ * Compressed audio comes in frames of a few hundred bytes every 20-30 ms,
+ * each one written to the player2 device with a syscall of its own.
+ * The coalescer copies consecutive PES packets into a buffer and writes
+ * them with a single write() once a byte or duration budget is used up.
+ * The packets keep their PES headers, and with them their pts.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "coalescer.h"
+#include "misc.h"
+
+Coalescer::Coalescer()
+{
+	used = 0;
+	maxBytes = 0;
+	maxDuration = 0;
+	firstPts = INVALID_PTS_VALUE;
+	fd = -1;
+	pesCount = 0;
+	writeCount = 0;
+}
+
+void Coalescer::SetLimits(size_t bytes, int ms)
+{
+	Flush();
+	maxBytes = bytes;
+	maxDuration = (int64_t) ms * 90;
+	buf.resize(bytes);
+}
+
+/* pts from the PES header in front of the data, INVALID_PTS_VALUE if there is none */
+int64_t Coalescer::GetPts(const struct iovec *iov, int iovcnt)
+{
+	if (iovcnt < 1 || iov[0].iov_len < 14)
+		return INVALID_PTS_VALUE;
+	const uint8_t *h = (const uint8_t *) iov[0].iov_base;
+	if (h[0] || h[1] || h[2] != 1 || !(h[7] & 0x80))
+		return INVALID_PTS_VALUE;
+	return ((int64_t) (h[9] & 0x0e) << 29) | (h[10] << 22) | ((h[11] & 0xfe) << 14) | (h[12] << 7) | (h[13] >> 1);
+}
+
+ssize_t Coalescer::Write(int _fd, const struct iovec *iov, int iovcnt)
+{
+	size_t len = 0;
+	for (int i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+	pesCount++;
+
+	if (_fd != fd) {
+		Flush();
+		fd = _fd;
+	}
+	if (!maxBytes) {
+		writeCount++;
+		return writev(fd, iov, iovcnt);
+	}
+
+	int64_t pts = GetPts(iov, iovcnt);
+	if (used) {
+		bool full = used + len > maxBytes;
+		if (pts != INVALID_PTS_VALUE && firstPts != INVALID_PTS_VALUE)
+			full |= pts - firstPts >= maxDuration || pts < firstPts;
+		if (full && !Flush())
+			return -1;
+	}
+	if (len > maxBytes) {
+		writeCount++;
+		return writev(fd, iov, iovcnt);
+	}
+
+	if (!used || firstPts == INVALID_PTS_VALUE)
+		firstPts = pts;
+	for (int i = 0; i < iovcnt; i++) {
+		memcpy(&buf[used], iov[i].iov_base, iov[i].iov_len);
+		used += iov[i].iov_len;
+	}
+	return len;
+}
+
+bool Coalescer::Flush()
+{
+	size_t pos = 0;
+	if (used)
+		writeCount++;
+	while (pos < used) {
+		ssize_t l = write(fd, &buf[pos], used - pos);
+		if (l < 0) {
+			if (errno == EINTR)
+				continue;
+			used = 0;
+			return false;
+		}
+		pos += l;
+	}
+	used = 0;
+	firstPts = INVALID_PTS_VALUE;
+	return true;
+}
+
+bool Coalescer::FlushDue(int64_t pts)
+{
+	if (!used)
+		return true;
+	/* with interleaved streams the next video frame mostly is within the
+	 * budget, the buffer then fills up and goes out in one write */
+	if (pts != INVALID_PTS_VALUE && firstPts != INVALID_PTS_VALUE && pts - firstPts < maxDuration)
+		return true;
+	return Flush();
+}
+
+void Coalescer::Clear()
+{
+	used = 0;
+	firstPts = INVALID_PTS_VALUE;
+}
@@ -0,0 +1,61 @@
+/*
+ * gathers small PES packets into fewer device writes
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __COALESCER_H__
+#define __COALESCER_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+/* not thread safe, the caller holds the device mutex */
+class Coalescer
+{
+	private:
+		std::vector<uint8_t> buf;
+		size_t used;
+		size_t maxBytes;	/* 0: write through */
+		int64_t maxDuration;	/* 90kHz */
+		int64_t firstPts;	/* of the buffered data */
+		int fd;
+		uint64_t pesCount;
+		uint64_t writeCount;
+
+		static int64_t GetPts(const struct iovec *iov, int iovcnt);
+	public:
+		Coalescer();
+
+		/* byte and duration budget of a device write, 0 bytes disables */
+		void SetLimits(size_t bytes, int ms);
+		/* takes one complete PES, writes the buffered ones first if the
+		 * budget is exhausted. Returns the PES size or -1 */
+		ssize_t Write(int fd, const struct iovec *iov, int iovcnt);
+		bool Flush();		/* write out what is buffered */
+		/* before a possibly blocking write of other data due at pts:
+		 * writes the buffer only if it is needed by then, i.e. pts is
+		 * a duration budget or more past the buffered data, or unknown */
+		bool FlushDue(int64_t pts);
+		void Clear();		/* drop it */
+
+		/* PES packets taken, device writes done */
+		void GetStats(uint64_t &pes, uint64_t &writes) { pes = pesCount; writes = writeCount; }
+		void ResetStats() { pesCount = writeCount = 0; }
+};
+
+#endif
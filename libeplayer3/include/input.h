@@ -26,6 +26,7 @@
 #include <vector>
 #include <map>
 
+#include <pthread.h>
 #include <scoped_lock.h>
 
 extern "C" {
@@ -36,8 +37,19 @@ extern "C" {
 #include <libavutil/opt.h>
 }
 
+#include "packetqueue.h"
+
 class Player;
 class Track;
+class ReadAhead;
+class TsIndex;
+
+#define READAHEAD_SIZE_HTTP (16 * 1024 * 1024)
+
+/* fast forward from this speed on, and rewind, show keyframes only */
+#define TRICK_MIN_SPEED	8
+#define TRICK_FRAME_US	80000	/* min. time a keyframe is shown */
+#define TRICK_GUESS_TRIES	8	/* max. doublings of a rewind step guessed from the bitrate */
 
 class Input
 {
@@ -64,6 +76,23 @@ class Input
 		uint64_t readCount;
 		int64_t calcPts(AVStream * stream, int64_t pts);
 
+		/* Play() demuxes into the queue, the write thread feeds the device */
+		PacketQueue queue;
+		pthread_t writeThread;
+		static void *writethread(void *arg);
+		void WriteLoop();
+
+		ReadAhead *readAhead;	/* NULL if libavformat reads from the protocol directly */
+		TsIndex *tsIndex;	/* keyframe index of local TS files */
+		bool IndexSeek(int64_t avts, bool absolute, int64_t &offset);
+		int64_t MediaTime(int64_t pts, int64_t pos);
+		int TrickSeek(int64_t cur, int64_t target, int64_t &pos);
+		/* rewind guessed from the bitrate: where it started, INT64_MIN if
+		 * none is pending, and how far back it went */
+		int64_t trickGuessFrom;
+		int64_t trickGuessBack;
+		int trickGuessTries;
+
 	public:
 		Input();
 		~Input();
@@ -82,6 +111,8 @@ class Input
 		bool SwitchVideo(Track *track);
 		bool GetMetadata(std::vector<std::string> &keys, std::vector<std::string> &values);
 		bool GetReadCount(uint64_t &readcount);
+		bool GetQueueDepth(PacketQueue::Depth &video, PacketQueue::Depth &audio);
+		bool GetBufferFill(int64_t &fill, int64_t &size);
 		AVFormatContext *GetAVFormatContext();
 		void ReleaseAVFormatContext();
 };
@@ -37,6 +37,11 @@ extern "C" {
 }
 
 #include "writer.h"
+#include "coalescer.h"
+
+/* default budget for gathering audio PES into one device write */
+#define AUDIO_COALESCE_BYTES	16384
+#define AUDIO_COALESCE_MS	100
 
 class Player;
 
@@ -51,6 +56,7 @@ class Output
 		Mutex audioMutex, videoMutex;
 		Track *audioTrack, *videoTrack;
 		Player *player;
+		Coalescer audioBuffer;
 	public:
 		Output();
 		~Output();
@@ -73,6 +79,10 @@ class Output
 		bool SwitchAudio(Track *track);
 		bool SwitchVideo(Track *track);
 		bool Write(AVStream *stream, AVPacket *packet, int64_t Pts);
+		/* 0 bytes writes every audio PES on its own */
+		void SetAudioCoalescing(size_t bytes, int ms);
+		/* audio PES packets written, and the syscalls it took */
+		void GetAudioWriteStats(uint64_t &pes, uint64_t &writes);
 };
 
 #endif
@@ -0,0 +1,86 @@
+/*
+ * bounded packet queues between the demux and the writer thread
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __PACKETQUEUE_H__
+#define __PACKETQUEUE_H__
+
+#include <stdint.h>
+#include <deque>
+
+#include <mutex_abstraction.h>
+#include <condition_abstraction.h>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+class PacketQueue
+{
+	public:
+		enum { VIDEO, AUDIO, QUEUES };
+
+		struct Entry {
+			AVStream *stream;
+			AVPacket packet;
+			int64_t pts;		/* for the writer, 90kHz */
+			int64_t order;		/* dts in AV_TIME_BASE units, INT64_MIN if unknown */
+			bool restart;		/* no packet, restart audio resampling */
+		};
+
+		struct Depth {
+			size_t packets;
+			size_t bytes;
+			int64_t duration;	/* ms between first and last queued packet */
+		};
+
+	private:
+		Mutex mutex;
+		Condition dataCond;	/* something was queued, or abort / finish */
+		Condition spaceCond;	/* something was taken, or abort / flush */
+		Condition idleCond;	/* the writer is done with its entry */
+		std::deque<Entry> queue[QUEUES];
+		size_t bytes[QUEUES];
+		size_t maxBytes[QUEUES];
+		bool aborted;
+		bool finished;
+		bool busy;		/* the writer holds an entry */
+
+		void drop(int q);
+	public:
+		PacketQueue();
+		~PacketQueue();
+
+		void SetLimit(int q, size_t max_bytes);
+		/* takes over the packet, blocks while the queue is full.
+		 * packet == NULL queues a resampling restart marker */
+		bool Put(int q, AVStream *stream, AVPacket *packet, int64_t pts);
+		/* writer side: blocks until there is an entry, returns the one with
+		 * the lowest dts of all queue heads. false on abort or when finished
+		 * and drained. Every successful Get() needs a Done() */
+		bool Get(Entry &entry);
+		void Done(Entry &entry);
+
+		void Flush();		/* drop everything, wait until the writer is idle */
+		void Finish();		/* no more input, let the writer drain */
+		void Abort();		/* drop everything, stop the writer */
+		void Reset();		/* re-arm after Finish() / Abort() */
+
+		void GetDepth(int q, Depth &depth);
+};
+
+#endif
@@ -31,4 +31,51 @@
 int InsertPesHeader(uint8_t *data, int size, uint8_t stream_id, int64_t pts, int pic_start_code);
 int InsertVideoPrivateDataHeader(uint8_t *data, int payload_size);
 
+#include <limits.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX					1024
+#endif
+#define PES_ARENA_SIZE				4096
+
+class Writer;
+
+/* Collects PES packets for one device write. Headers and small inserts
+ * are built in an arena, payload is referenced where it is. PES longer
+ * than MAX_PES_PACKET_SIZE are continued in a new PES without pts, when
+ * the iovecs or the arena run out, what is there is written out first */
+class PesBuilder
+{
+	private:
+		Writer *writer;
+		struct iovec iov[IOV_MAX];
+		int ic;
+		uint8_t arena[PES_ARENA_SIZE];
+		size_t arenaUsed;
+		uint8_t *header;	/* of the open PES, NULL if there is none */
+		size_t length;		/* PES_packet_length so far */
+		uint8_t streamId;
+		bool failed;		/* a write since the last Flush() failed */
+
+		void End();
+		void Write();
+		void Room(int iovs, size_t bytes);
+		void Continue();
+	public:
+		PesBuilder(Writer *w) : writer(w), ic(0), arenaUsed(0), header(NULL), length(0), streamId(0), failed(false) {}
+
+		/* opens a PES. private_size >= 0 adds the player2 private data
+		 * header announcing a frame of that many bytes */
+		void Start(uint8_t stream_id, int64_t pts, int pic_start_code = 0, int private_size = -1);
+		/* copies small things (start codes, fake headers) into the PES */
+		void Copy(const void *data, size_t len);
+		/* references payload, it has to stay valid until Flush() */
+		void Add(const void *data, size_t len);
+		/* writes everything out, false if this or an intermediate write failed */
+		bool Flush();
+};
+
 #endif
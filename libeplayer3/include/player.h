@@ -41,6 +41,7 @@ extern "C" {
 #include "input.h"
 #include "output.h"
 #include "manager.h"
+#include "stats.h"
 
 struct Chapter
 {
@@ -61,6 +62,7 @@ class Player {
 		Input input;
 		Output output;
 		Manager manager;
+		Stats stats;
 		Mutex chapterMutex;
 		std::vector<Chapter> chapters;
 		pthread_t playThread;
@@ -80,6 +82,7 @@ class Player {
 
 		std::string url;
 		bool noprobe;	/* hack: only minimal probing in av_find_stream_info */
+		int readAheadSize;	/* bytes, 0 disables, -1 picks a default */
 
 		void SetChapters(std::vector<Chapter> &Chapters);
 		static void* playthread(void*);
@@ -97,6 +100,16 @@ class Player {
 		bool GetPts(int64_t &pts);
 		bool GetFrameCount(int64_t &framecount);
 		bool GetDuration(int64_t &duration);
+		bool GetQueueDepth(PacketQueue::Depth &video, PacketQueue::Depth &audio) { return input.GetQueueDepth(video, audio); }
+		/* read-ahead buffer: bytes buffered ahead of the demuxer, buffer size */
+		bool GetBufferFill(int64_t &fill, int64_t &size) { return input.GetBufferFill(fill, size); }
+		/* takes effect on the next Open(). Default is 16 MB for network streams, none for files */
+		void SetReadAheadSize(int bytes) { readAheadSize = bytes; }
+		/* gather audio PES into device writes of up to bytes / ms, 0 bytes disables */
+		void SetAudioCoalescing(size_t bytes, int ms) { output.SetAudioCoalescing(bytes, ms); }
+		void GetAudioWriteStats(uint64_t &pes, uint64_t &writes) { output.GetAudioWriteStats(pes, writes); }
+		/* counters since Open(), plus the current buffer and queue levels */
+		void GetStatistics(playback_stats_t &s);
 
 		bool GetMetadata(std::vector<std::string> &keys, std::vector<std::string> &values);
 		bool SlowMotion(int repeats);
@@ -0,0 +1,81 @@
+/*
+ * read-ahead buffer between the protocol and libavformat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __READAHEAD_H__
+#define __READAHEAD_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include <mutex_abstraction.h>
+#include <condition_abstraction.h>
+
+extern "C" {
+#include <libavutil/time.h>
+#include <libavformat/avformat.h>
+}
+
+class Player;
+
+class ReadAhead
+{
+	private:
+		Player *player;
+		AVIOContext *io;	/* the real protocol, only used by the filler thread */
+		AVIOContext *pb;	/* what libavformat reads from */
+		std::string url;
+		AVDictionary *options;	/* kept for reconnects */
+
+		std::vector<uint8_t> buf;
+		int64_t tail;		/* stream offset of the oldest byte kept */
+		int64_t head;		/* stream offset behind the newest byte */
+		int64_t pos;		/* read position */
+		int64_t size;		/* stream size, -1 if unknown */
+		int64_t seekTo;		/* position the filler has to seek to, or -1 */
+		bool seekable;
+		bool eof;
+		bool aborted;
+		int error;
+
+		Mutex mutex;
+		Condition dataCond;	/* head moved, or eof / error / abort */
+		Condition spaceCond;	/* pos moved, or seek / abort */
+		pthread_t thread;
+		bool running;
+
+		static void *fillthread(void *arg);
+		void Fill();
+		bool Reconnect(int64_t offset);
+		static int read_cb(void *opaque, uint8_t *buf, int buf_size);
+		static int64_t seek_cb(void *opaque, int64_t offset, int whence);
+		int Read(uint8_t *dst, int len);
+		int64_t Seek(int64_t offset, int whence);
+	public:
+		ReadAhead(Player *player, size_t size);
+		~ReadAhead();
+
+		bool Open(const char *url, AVDictionary *options);
+		AVIOContext *GetAVIOContext() { return pb; }
+		void Abort();
+		/* bytes buffered ahead of the read position, buffer capacity */
+		void GetFill(int64_t &fill, int64_t &capacity);
+};
+
+#endif
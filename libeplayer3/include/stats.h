@@ -0,0 +1,53 @@
+/*
+ * playback statistics collector
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <mutex_abstraction.h>
+#include <playback_stats.h>
+
+class Stats
+{
+	private:
+		Mutex mutex;
+		playback_stats_t s;
+		playback_stats_window_t window;
+		int64_t lastPts[PLAYBACK_STATS_STREAMS];
+		int64_t seekStart;		/* of the pending seek, 0 if none */
+		bool seekFlushed;		/* the next write completes it */
+	public:
+		Stats();
+		void Reset();
+
+		/* demux thread */
+		void Read(size_t bytes);
+		/* writer thread, one call per packet. usec is the time the write took */
+		void Write(int stream, size_t bytes, int64_t pts, int64_t usec, bool ok);
+		/* a seek was requested / the queues were flushed for it */
+		void SeekStart();
+		void SeekFlushed();
+
+		/* everything but buffer and queue levels, those are the player's */
+		void Get(playback_stats_t &stats);
+};
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * keyframe index for transport stream files
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __TSINDEX_H__
+#define __TSINDEX_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include <mutex_abstraction.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+class TsIndex
+{
+	public:
+		struct Entry {
+			int64_t offset;		/* of the TS packet starting the PES */
+			int64_t pts;		/* 90kHz, unwrapped */
+		};
+
+	private:
+		Mutex mutex;
+		std::vector<Entry> entries;
+		std::string path;
+		int pid;
+		enum AVCodecID codec;
+		bool complete;		/* scanned up to the end of the file */
+		bool aborted;
+		bool running;
+		pthread_t thread;
+
+		/* unwrapping of the 33 bit pts */
+		int64_t lastPts;
+		int64_t wrap;
+
+		static void *scanthread(void *arg);
+		void Scan();
+		bool Load(int64_t &resume);
+		void Save();
+		void Add(int64_t offset, int64_t pts);
+		bool IsKeyframe(uint32_t code);
+	public:
+		/* path of a local file, pid and codec of the video stream */
+		TsIndex(const char *path, int pid, enum AVCodecID codec);
+		~TsIndex();
+
+		/* loads the cached index, then scans what it doesn't cover */
+		void Start();
+
+		/* time in 90kHz units since the first keyframe of a raw pts,
+		 * offset is a file position near it */
+		bool GetTime(int64_t pts, int64_t offset, int64_t &time);
+		/* last keyframe at or before time, false if it isn't indexed (yet) */
+		bool GetOffset(int64_t time, int64_t &offset);
+		/* same, also returns the time of the keyframe */
+		bool GetKeyframe(int64_t time, int64_t &ktime, int64_t &offset);
+};
+
+#endif
@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 extern "C" {
 #include <libavutil/avutil.h>
@@ -35,16 +36,28 @@ extern "C" {
 
 #include <linux/dvb/stm_ioctls.h>
 
+#include "pes.h"
+
 #define AV_CODEC_ID_INJECTPCM AV_CODEC_ID_PCM_S16LE
 
 class Player;
+class Coalescer;
 
 class Writer
 {
+	friend class PesBuilder;
+
 	protected:
 		int fd;
 		Player *player;
+		Coalescer *buffer;	/* NULL: write to the device directly */
+		PesBuilder pes;
+		/* device writes of complete PES packets */
+		ssize_t WriteV(const struct iovec *iov, int iovcnt);
 	public:
+		Writer() : buffer(NULL), pes(this) {}
+		void SetBuffer(Coalescer *b) { buffer = b; }
+
 		static void Register(Writer *w, enum AVCodecID id, video_encoding_t encoding);
 		static void Register(Writer *w, enum AVCodecID id, audio_encoding_t encoding);
 		static video_encoding_t GetVideoEncoding(enum AVCodecID id);
@@ -53,5 +66,10 @@ class Writer
 
 		virtual void Init(int _fd, AVStream * /*stream*/, Player *_player ) { fd = _fd; player = _player; }
 		virtual bool Write(AVPacket *packet, int64_t pts);
+		/* for writers that work behind Write(): drop what is queued and
+		 * return once nothing uses it any more */
+		virtual void Clear() {}
+		/* like Clear(), and no more data until Init(), the input is closed next */
+		virtual void Stop() { Clear(); }
 };
 #endif
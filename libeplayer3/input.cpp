@@ -28,9 +28,12 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/prctl.h>
 
 #include "player.h"
 #include "misc.h"
+#include "readahead.h"
+#include "tsindex.h"
 
 static const char *FILENAME = "eplayer/input.cpp";
 
@@ -54,6 +57,11 @@ Input::Input()
 	seek_avts_abs = INT64_MIN;
 	seek_avts_rel = 0;
 	abortPlayback = false;
+	readAhead = NULL;
+	tsIndex = NULL;
+	trickGuessFrom = INT64_MIN;
+	trickGuessBack = 0;
+	trickGuessTries = 0;
 }
 
 Input::~Input()
@@ -108,13 +116,57 @@ static void logprintf(const char *format, ...)
 	va_end(ap);
 }
 
+void *Input::writethread(void *arg)
+{
+	prctl(PR_SET_NAME, (unsigned long) "writethread");
+	((Input *) arg)->WriteLoop();
+	pthread_exit(NULL);
+}
+
+void Input::WriteLoop()
+{
+	PacketQueue::Entry e;
+	while (queue.Get(e)) {
+		bool video = e.stream->codec->codec_type == AVMEDIA_TYPE_VIDEO;
+		Track *track = video ? videoTrack : audioTrack;
+		/* skip what was queued before a track switch */
+		if (track && track->stream == e.stream) {
+			if (e.restart)
+				player->output.Write(e.stream, NULL, 0);
+			else {
+				size_t size = e.packet.size; /* the writer may take the packet */
+				int64_t start = av_gettime_relative();
+				bool ok = player->output.Write(e.stream, &e.packet, e.pts);
+				player->stats.Write(video ? PLAYBACK_STATS_VIDEO : PLAYBACK_STATS_AUDIO, size, e.pts, av_gettime_relative() - start, ok);
+				if (!ok)
+					logprintf("writing data to %s device failed\n", video ? "video" : "audio");
+			}
+		}
+		queue.Done(e);
+	}
+}
+
 bool Input::Play()
 {
 	hasPlayThreadStarted = 1;
 
+	queue.Reset();
+	int err = pthread_create(&writeThread, NULL, writethread, this);
+	if (err) {
+		fprintf(stderr, "%s %s %d: pthread_create: %d (%s)\n", FILENAME, __func__, __LINE__, err, strerror(err));
+		hasPlayThreadStarted = 0;
+		return false;
+	}
+
 	int64_t showtime = 0;
 	bool restart_audio_resampling = false;
-	bool bof = false;
+
+	/* trick play: only keyframes go to the video device, audio is dropped */
+	bool trickMode = false;
+	bool trickFrame = false;	/* looking for the keyframe after a trick seek */
+	int64_t trickPos = 0;		/* AV_TIME_BASE units since the start, INT64_MIN: take it from the next keyframe */
+	int64_t trickTarget = 0;	/* where the last trick seek wanted to go */
+	int64_t trickStep = 0;		/* wall clock of the last trick seek */
 
 	// HACK: Dropping all video frames until the first audio frame was seen will keep player2 from stuttering.
 	//       Oddly, this seems to be necessary for network streaming only ...
@@ -132,9 +184,63 @@ bool Input::Play()
 		int seek_target_flag = 0;
 		int64_t seek_target = INT64_MIN; // in AV_TIME_BASE units
 
+		bool trick = player->isBackWard || (player->isForwarding && player->Speed >= TRICK_MIN_SPEED);
+		if (trick != trickMode) {
+			trickMode = trick;
+			trickFrame = false;
+			if (trick) {
+				int64_t pts;
+				trickPos = 0;
+				if (player->output.GetPts(pts))
+					trickPos = MediaTime(pts, avio_tell(avfc->pb));
+				trickStep = av_gettime_relative();
+				trickGuessFrom = INT64_MIN;
+				showtime = 0;
+				queue.Flush();
+			} else {
+				/* continue normal playback where trick play stopped */
+				int64_t pos;
+				TrickSeek(INT64_MIN, trickPos == INT64_MIN ? trickTarget : trickPos, pos);
+				restart_audio_resampling = true;
+				queue.Flush();
+				for (unsigned int i = 0; i < avfc->nb_streams; i++)
+					if (avfc->streams[i]->codec && avfc->streams[i]->codec->codec)
+						avcodec_flush_buffers(avfc->streams[i]->codec);
+				player->output.ClearAudio();
+				player->output.ClearVideo();
+			}
+		}
+		if (trickMode && !trickFrame && seek_avts_abs == INT64_MIN && !seek_avts_rel) {
+			int64_t now = av_gettime_relative();
+			if (now < showtime) {
+				usleep(showtime - now);
+				continue;
+			}
+			/* move through the stream at Speed times real time */
+			int64_t pos = INT64_MIN;
+			trickTarget = trickPos + player->Speed * (now - trickStep);
+			int res = TrickSeek(trickPos, trickTarget, pos);
+			if (res < 0) {
+				if (player->isForwarding)
+					break;	/* end of file */
+				showtime = now + 100000; /* at the beginning, wait for the speed to change */
+				continue;
+			}
+			if (!res) {
+				showtime = now + TRICK_FRAME_US / 2;
+				continue;
+			}
+			trickPos = pos;
+			trickStep = now;
+			trickFrame = true;
+			queue.Flush();
+		}
+
 		if (seek_avts_rel) {
 			if (avfc->iformat->flags & AVFMT_TS_DISCONT) {
-				if (avfc->bit_rate) {
+				if (IndexSeek(seek_avts_rel, false, seek_target)) {
+					seek_target_flag = AVSEEK_FLAG_BYTE;
+				} else if (avfc->bit_rate) {
 					seek_target_flag = AVSEEK_FLAG_BYTE;
 					seek_target = avio_tell(avfc->pb) + av_rescale(seek_avts_rel, avfc->bit_rate, 8 * AV_TIME_BASE);
 				}
@@ -146,7 +252,9 @@ bool Input::Play()
 			seek_avts_rel = 0;
 		} else if (seek_avts_abs != INT64_MIN) {
 			if (avfc->iformat->flags & AVFMT_TS_DISCONT) {
-				if (avfc->bit_rate) {
+				if (IndexSeek(seek_avts_abs, true, seek_target)) {
+					seek_target_flag = AVSEEK_FLAG_BYTE;
+				} else if (avfc->bit_rate) {
 					seek_target_flag = AVSEEK_FLAG_BYTE;
 					seek_target = av_rescale(seek_avts_abs, avfc->bit_rate, 8 * AV_TIME_BASE);
 				}
@@ -154,19 +262,6 @@ bool Input::Play()
 				seek_target = seek_avts_abs;
 			}
 			seek_avts_abs = INT64_MIN;
-		} else if (player->isBackWard && av_gettime_relative() >= showtime) {
-			player->output.ClearVideo();
-
-			if (bof) {
-				showtime = av_gettime_relative();
-				usleep(100000);
-				continue;
-			}
-			seek_avts_rel = player->Speed * AV_TIME_BASE;
-			showtime = av_gettime_relative() + 300000;	//jump back every 300ms
-			continue;
-		} else {
-			bof = false;
 		}
 
 		if (seek_target > INT64_MIN) {
@@ -175,12 +270,21 @@ bool Input::Play()
 				seek_target = 0;
 			res = avformat_seek_file(avfc, -1, INT64_MIN, seek_target, INT64_MAX, seek_target_flag);
 
-			if (res < 0 && player->isBackWard)
-				bof = true;
-
 			seek_target = INT64_MIN;
+			if (trickMode && res >= 0) {
+				/* take the new position from the next keyframe */
+				trickTarget = trickPos == INT64_MIN ? trickTarget : trickPos;
+				trickPos = INT64_MIN;
+				trickStep = av_gettime_relative();
+				trickGuessFrom = INT64_MIN;
+				trickFrame = true;
+			}
 			restart_audio_resampling = true;
 
+			// nothing from before the seek may reach the device after the clear below
+			queue.Flush();
+			player->stats.SeekFlushed();
+
 			// clear streams
 			for (unsigned int i = 0; i < avfc->nb_streams; i++)
 				if (avfc->streams[i]->codec && avfc->streams[i]->codec->codec)
@@ -192,7 +296,7 @@ bool Input::Play()
 		AVPacket packet;
 		av_init_packet(&packet);
 
-		int err = av_read_frame(avfc, &packet);
+		err = av_read_frame(avfc, &packet);
 		if (err == AVERROR(EAGAIN)) {
 #if (LIBAVFORMAT_VERSION_MAJOR == 57 && LIBAVFORMAT_VERSION_MINOR == 25)
 			av_packet_unref(&packet);
@@ -205,6 +309,7 @@ bool Input::Play()
 			break;		// while
 
 		player->readCount += packet.size;
+		player->stats.Read(packet.size);
 
 		AVStream *stream = avfc->streams[packet.stream_index];
 		Track *_videoTrack = videoTrack;
@@ -212,19 +317,47 @@ bool Input::Play()
 		Track *_subtitleTrack = subtitleTrack;
 		Track *_teletextTrack = teletextTrack;
 
+		if (trickMode) {
+			if (trickFrame && _videoTrack && _videoTrack->stream == stream && (packet.flags & AV_PKT_FLAG_KEY)) {
+				int64_t pos = trickPos;
+				if (pos == INT64_MIN) {
+					int64_t pts = calcPts(stream, packet.pts);
+					pos = (pts != INVALID_PTS_VALUE) ? MediaTime(pts, packet.pos) : trickTarget;
+				}
+				trickFrame = false;
+				if (trickPos == INT64_MIN && trickGuessFrom != INT64_MIN && pos >= trickGuessFrom) {
+					/* a guessed rewind found no earlier keyframe, TrickSeek()
+					 * goes back further from the same position */
+					trickPos = trickGuessFrom;
+					showtime = 0;
+				} else {
+					trickPos = pos;
+					trickGuessFrom = INT64_MIN;
+					/* no pts, the decoder shows the frame right away */
+					queue.Put(PacketQueue::VIDEO, stream, &packet, INVALID_PTS_VALUE);
+					showtime = av_gettime_relative() + TRICK_FRAME_US;
+				}
+			}
+#if (LIBAVFORMAT_VERSION_MAJOR == 57 && LIBAVFORMAT_VERSION_MINOR == 25)
+			av_packet_unref(&packet);
+#else
+			av_free_packet(&packet);
+#endif
+			continue;
+		}
+
 		if (_videoTrack && (_videoTrack->stream == stream)) {
 			int64_t pts = calcPts(stream, packet.pts);
-			if (audioSeen && !player->output.Write(stream, &packet, pts))
-				logprintf("writing data to video device failed\n");
+			if (audioSeen)
+				queue.Put(PacketQueue::VIDEO, stream, &packet, pts); /* blocks while full */
 		} else if (_audioTrack && (_audioTrack->stream == stream)) {
 			if (restart_audio_resampling) {
 				restart_audio_resampling = false;
-				player->output.Write(stream, NULL, 0);
+				queue.Put(PacketQueue::AUDIO, stream, NULL, 0);
 			}
 			if (!player->isBackWard) {
 				int64_t pts = calcPts(stream, packet.pts);
-				if (!player->output.Write(stream, &packet, _videoTrack ? pts : 0))
-				logprintf("writing data to audio device failed\n");
+				queue.Put(PacketQueue::AUDIO, stream, &packet, _videoTrack ? pts : 0);
 			}
 			audioSeen = true;
 		} else if (_subtitleTrack && (_subtitleTrack->stream == stream)) {
@@ -265,6 +398,13 @@ bool Input::Play()
 #endif
 	} /* while */
 
+	/* on EOF, let the writer drain the queue before flushing the device */
+	if (player->abortRequested)
+		queue.Abort();
+	else
+		queue.Finish();
+	pthread_join(writeThread, NULL);
+
 	if (player->abortRequested)
 		player->output.Clear();
 	else
@@ -436,6 +576,21 @@ again:
 	{
 		av_dict_set(&options, "headers", headers.c_str(), 0);
 	}
+
+	int readAheadSize = player->readAheadSize;
+	if (readAheadSize < 0)
+		readAheadSize = player->isHttp ? READAHEAD_SIZE_HTTP : 0;
+	if (readAheadSize > 0 && strncmp(filename, "bluray:/", 8)) {
+		/* libavformat reads from the buffer, the protocol is fed by a thread */
+		readAhead = new ReadAhead(player, readAheadSize);
+		if (readAhead->Open(filename, options)) {
+			avfc->pb = readAhead->GetAVIOContext();
+			avfc->flags |= AVFMT_FLAG_CUSTOM_IO;
+		} else {
+			delete readAhead;
+			readAhead = NULL;
+		}
+	}
 #if ENABLE_LOGGING
 	av_log_set_level(AV_LOG_DEBUG);
 #endif
@@ -446,11 +601,13 @@ again:
 	av_dict_free(&options);
 	if (averror(err, avformat_open_input)) {
 		avformat_free_context(avfc);
+		delete readAhead;
+		readAhead = NULL;
 		return false;
 	}
 
 	avfc->iformat->flags |= AVFMT_SEEK_TO_PTS;
-	avfc->flags = AVFMT_FLAG_GENPTS;
+	avfc->flags |= AVFMT_FLAG_GENPTS; /* keep AVFMT_FLAG_CUSTOM_IO */
 	if (player->noprobe) {
 #if (LIBAVFORMAT_VERSION_MAJOR <  55) || \
     (LIBAVFORMAT_VERSION_MAJOR == 55 && LIBAVFORMAT_VERSION_MINOR <  43) || \
@@ -489,6 +646,8 @@ again:
 
 	if (!videoTrack && !audioTrack) {
 		avformat_close_input(&avfc);
+		delete readAhead;
+		readAhead = NULL;
 		return false;
 	}
 
@@ -497,6 +656,13 @@ again:
 	if (audioTrack)
 		player->output.SwitchAudio(audioTrack);
 
+	/* local TS recordings get a keyframe index, built in the background */
+	if (videoTrack && !player->isHttp && !strcmp(avfc->iformat->name, "mpegts")) {
+		const char *path = strncmp(filename, "file://", 7) ? filename : filename + 7;
+		tsIndex = new TsIndex(path, videoTrack->stream->id, videoTrack->stream->codec->codec_id);
+		tsIndex->Start();
+	}
+
 	ReadSubtitles(filename);
 
 	return res;
@@ -649,6 +815,9 @@ bool Input::UpdateTracks()
 bool Input::Stop()
 {
 	abortPlayback = true;
+	queue.Abort(); /* wakes up both the demux and the write thread */
+	if (readAhead)
+		readAhead->Abort(); /* ... and a demux thread waiting for data */
 
 	while (hasPlayThreadStarted != 0)
 		usleep(100000);
@@ -661,6 +830,10 @@ bool Input::Stop()
 			avcodec_close(avfc->streams[i]->codec);
 		avformat_close_input(&avfc);
 	}
+	delete readAhead;
+	readAhead = NULL;
+	delete tsIndex;
+	tsIndex = NULL;
 
 	avformat_network_deinit();
 
@@ -684,6 +857,7 @@ void Input::ReleaseAVFormatContext()
 
 bool Input::Seek(int64_t avts, bool absolute)
 {
+	player->stats.SeekStart();
 	if (absolute)
 		seek_avts_abs = avts, seek_avts_rel = 0;
 	else
@@ -691,6 +865,112 @@ bool Input::Seek(int64_t avts, bool absolute)
 	return true;
 }
 
+/* AV_TIME_BASE units since the start of a calcPts() value, pos is the
+ * file position of the packet */
+int64_t Input::MediaTime(int64_t pts, int64_t pos)
+{
+	int64_t time;
+	if (tsIndex) {
+		if (avfc->start_time != AV_NOPTS_VALUE)
+			pts += 90000 * avfc->start_time / AV_TIME_BASE;
+		if (tsIndex->GetTime(pts, pos, time))
+			return av_rescale(time, AV_TIME_BASE, 90000);
+		if (avfc->start_time != AV_NOPTS_VALUE)
+			pts -= 90000 * avfc->start_time / AV_TIME_BASE;
+	}
+	return av_rescale(pts, AV_TIME_BASE, 90000);
+}
+
+/* trick play: seek to a keyframe between cur and target, both AV_TIME_BASE
+ * units since the start, and set pos to its time if that is known up front.
+ * cur INT64_MIN seeks to the keyframe at or before target.
+ * Returns 1 on success, 0 if there is no keyframe in between (yet), -1 at
+ * the beginning or end of the stream */
+int Input::TrickSeek(int64_t cur, int64_t target, int64_t &pos)
+{
+	bool any = cur == INT64_MIN;
+	bool forward = !any && target > cur;
+	if (forward && avfc->duration > 0 && target > avfc->duration)
+		return -1;
+	if (!any && !forward && cur <= 0)
+		return -1;
+	if (target < 0)
+		target = 0;
+
+	int64_t ktime, offset;
+	if (tsIndex && tsIndex->GetKeyframe(av_rescale(target, 90000, AV_TIME_BASE), ktime, offset)) {
+		ktime = av_rescale(ktime, AV_TIME_BASE, 90000);
+		if (!any && (forward ? ktime <= cur : ktime >= cur))
+			return forward ? 0 : -1;
+		if (avformat_seek_file(avfc, -1, INT64_MIN, offset, INT64_MAX, AVSEEK_FLAG_BYTE) < 0)
+			return -1;
+		pos = ktime;
+		return 1;
+	}
+	if (avfc->iformat->flags & AVFMT_TS_DISCONT) {
+		/* not indexed (yet), guess from the bitrate, the position is
+		 * taken from the keyframe found */
+		if (!avfc->bit_rate)
+			return -1;
+		if (!any && !forward) {
+			/* a step is shorter than a GOP, the seek lands just before
+			 * cur and the demuxer finds the keyframe at cur again. Play()
+			 * then leaves cur as it is, go back twice as far each time */
+			if (cur == trickGuessFrom) {
+				if (cur - trickGuessBack <= 0 || ++trickGuessTries > TRICK_GUESS_TRIES)
+					return -1;
+				trickGuessBack *= 2;
+			} else {
+				trickGuessFrom = cur;
+				trickGuessBack = cur - target;
+				if (trickGuessBack < TRICK_FRAME_US)
+					trickGuessBack = TRICK_FRAME_US;
+				trickGuessTries = 0;
+			}
+			target = cur - trickGuessBack;
+			if (target < 0)
+				target = 0;
+		} else
+			trickGuessFrom = INT64_MIN;
+		offset = av_rescale(target, avfc->bit_rate, 8 * AV_TIME_BASE);
+		return avformat_seek_file(avfc, -1, INT64_MIN, offset, INT64_MAX, AVSEEK_FLAG_BYTE) < 0 ? -1 : 1;
+	}
+
+	/* container index (mkv cues, mp4 sync samples, ...) */
+	int64_t start = (avfc->start_time != AV_NOPTS_VALUE) ? avfc->start_time : 0;
+	int res;
+	if (any)
+		res = avformat_seek_file(avfc, -1, INT64_MIN, start + target, start + target, 0);
+	else if (forward)
+		res = avformat_seek_file(avfc, -1, start + cur + 1, start + target, start + target, 0);
+	else
+		res = avformat_seek_file(avfc, -1, INT64_MIN, start + target, start + cur - 1, 0);
+	if (res < 0)
+		return forward ? 0 : -1;
+	return 1;
+}
+
+/* byte offset of the keyframe to seek to, from the TS index. avts is in
+ * AV_TIME_BASE units, relative to the current position or the start */
+bool Input::IndexSeek(int64_t avts, bool absolute, int64_t &offset)
+{
+	if (!tsIndex)
+		return false;
+	int64_t time = 0;
+	if (!absolute) {
+		int64_t pts;
+		if (!player->output.GetPts(pts))
+			return false;
+		/* undo calcPts() */
+		if (avfc->start_time != AV_NOPTS_VALUE)
+			pts += 90000 * avfc->start_time / AV_TIME_BASE;
+		if (!tsIndex->GetTime(pts, avio_tell(avfc->pb), time))
+			return false;
+	}
+	time += av_rescale(avts, 90000, AV_TIME_BASE);
+	return tsIndex->GetOffset(time < 0 ? 0 : time, offset);
+}
+
 bool Input::GetDuration(int64_t &duration)
 {
 	if (avfc) {
@@ -780,3 +1060,20 @@ bool Input::GetReadCount(uint64_t &readcount)
 	readcount = readCount;
 	return true;
 }
+
+bool Input::GetQueueDepth(PacketQueue::Depth &video, PacketQueue::Depth &audio)
+{
+	queue.GetDepth(PacketQueue::VIDEO, video);
+	queue.GetDepth(PacketQueue::AUDIO, audio);
+	return true;
+}
+
+bool Input::GetBufferFill(int64_t &fill, int64_t &size)
+{
+	if (!readAhead) {
+		fill = size = 0;
+		return false;
+	}
+	readAhead->GetFill(fill, size);
+	return true;
+}
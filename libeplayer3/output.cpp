@@ -59,6 +59,7 @@ Output::Output()
 	videofd = audiofd = -1;
 	videoWriter = audioWriter = NULL;
 	videoTrack = audioTrack = NULL;
+	audioBuffer.SetLimits(AUDIO_COALESCE_BYTES, AUDIO_COALESCE_MS);
 }
 
 Output::~Output()
@@ -140,6 +141,9 @@ bool Output::Play()
 	if (audioTrack && audioTrack->stream && audiofd > -1 && (avcc = audioTrack->stream->codec)) {
 		audioWriter = Writer::GetWriter(avcc->codec_id, avcc->codec_type, audioTrack->ac3flags);
 		audioWriter->Init(audiofd, audioTrack->stream, player);
+		audioBuffer.Clear();
+		audioBuffer.ResetStats();
+		audioWriter->SetBuffer(&audioBuffer);
 		audio_encoding_t audioEncoding = AUDIO_ENCODING_LPCMA;
 		if (audioTrack->ac3flags != 6)
 			audioEncoding = audioWriter->GetAudioEncoding(avcc->codec_id);
@@ -166,6 +170,14 @@ bool Output::Stop()
 	}
 
 	if (audiofd > -1) {
+		uint64_t pes, writes;
+		audioBuffer.GetStats(pes, writes);
+		if (pes)
+			fprintf(stderr, "%s %s %d: audio: %llu PES in %llu writes\n", FILENAME, __func__, __LINE__,
+				(unsigned long long) pes, (unsigned long long) writes);
+		if (audioWriter)
+			audioWriter->Stop();	/* Player::Stop() closes the input next */
+		audioBuffer.Clear();
 		ioctl(audiofd, AUDIO_CLEAR_BUFFER, NULL);
 		/* set back to normal speed (end trickmodes) */
 		dioctl(audiofd, AUDIO_SET_SPEED, DVB_SPEED_NORMAL_PLAY);
@@ -231,11 +243,13 @@ bool Output::Flush()
 		ret = false;
 
 	if (audiofd > -1 && audioWriter) {
+		audioBuffer.Flush();
 		// flush audio decoder
 		AVPacket packet;
 		packet.data = NULL;
 		packet.size = 0;
 		audioWriter->Write(&packet, 0);
+		audioBuffer.Flush();
 
 		if (ioctl(audiofd, AUDIO_FLUSH, NULL))
 			ret = false;
@@ -265,6 +279,9 @@ bool Output::AVSync(bool b)
 bool Output::ClearAudio()
 {
 	ScopedLock a_lock(audioMutex);
+	if (audioWriter)
+		audioWriter->Clear();
+	audioBuffer.Clear();
 	return audiofd > -1 && !ioctl(audiofd, AUDIO_CLEAR_BUFFER, NULL);
 }
 
@@ -309,6 +326,7 @@ bool Output::SwitchAudio(Track *track)
 		dioctl(audiofd, AUDIO_STOP, NULL);
 		ioctl(audiofd, AUDIO_CLEAR_BUFFER, NULL);
 	}
+	audioBuffer.Clear();
 	audioTrack = track;
 	if (track->stream) {
 		AVCodecContext *avcc = track->stream->codec;
@@ -316,6 +334,7 @@ bool Output::SwitchAudio(Track *track)
 			return false;
 			audioWriter = Writer::GetWriter(avcc->codec_id, avcc->codec_type, audioTrack->ac3flags);
 			audioWriter->Init(audiofd, audioTrack->stream, player);
+			audioWriter->SetBuffer(&audioBuffer);
 		if (audiofd > -1) {
 			audio_encoding_t audioEncoding = AUDIO_ENCODING_LPCMA;
 		if (audioTrack->ac3flags != 6)
@@ -356,6 +375,16 @@ bool Output::Write(AVStream *stream, AVPacket *packet, int64_t pts)
 	switch (stream->codec->codec_type) {
 		case AVMEDIA_TYPE_VIDEO: {
 			ScopedLock v_lock(videoMutex);
+			{
+				/* the video write may block, don't hold back audio that is
+				 * needed before this frame is decoded. Compare its dts, the
+				 * pts runs ahead by the reordering delay */
+				int64_t due = pts;
+				if (pts != INVALID_PTS_VALUE && packet && packet->pts != AV_NOPTS_VALUE && packet->dts != AV_NOPTS_VALUE)
+					due -= 90000 * (double)(packet->pts - packet->dts) * stream->time_base.num / stream->time_base.den;
+				ScopedLock a_lock(audioMutex);
+				audioBuffer.FlushDue(due);
+			}
 			return videofd > -1 && videoWriter && videoWriter->Write(packet, pts);
 		}
 		case AVMEDIA_TYPE_AUDIO: {
@@ -366,3 +395,15 @@ bool Output::Write(AVStream *stream, AVPacket *packet, int64_t pts)
 			return false;
 	}
 }
+
+void Output::SetAudioCoalescing(size_t bytes, int ms)
+{
+	ScopedLock a_lock(audioMutex);
+	audioBuffer.SetLimits(bytes, ms);
+}
+
+void Output::GetAudioWriteStats(uint64_t &pes, uint64_t &writes)
+{
+	ScopedLock a_lock(audioMutex);
+	audioBuffer.GetStats(pes, writes);
+}
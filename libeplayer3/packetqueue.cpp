@@ -0,0 +1,195 @@
+/*
+ * bounded packet queues between the demux and the writer thread
+ *
+ * The demux thread keeps reading while the writer is blocked by the
+ * player2 device, the writer keeps feeding the device while the demux
+ * thread waits for the network. Each stream has its own byte budget, so
+ * a stalled stream can't take up the memory of the other.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <scoped_lock.h>
+#include "packetqueue.h"
+
+/* several seconds of HD video resp. compressed audio */
+#define VIDEO_QUEUE_BYTES	(8 << 20)
+#define AUDIO_QUEUE_BYTES	(1 << 20)
+
+static void packet_free(AVPacket *packet)
+{
+#if (LIBAVFORMAT_VERSION_MAJOR == 57 && LIBAVFORMAT_VERSION_MINOR == 25)
+	av_packet_unref(packet);
+#else
+	av_free_packet(packet);
+#endif
+}
+
+PacketQueue::PacketQueue()
+{
+	for (int q = 0; q < QUEUES; q++)
+		bytes[q] = 0;
+	maxBytes[VIDEO] = VIDEO_QUEUE_BYTES;
+	maxBytes[AUDIO] = AUDIO_QUEUE_BYTES;
+	aborted = false;
+	finished = false;
+	busy = false;
+}
+
+PacketQueue::~PacketQueue()
+{
+	for (int q = 0; q < QUEUES; q++)
+		drop(q);
+}
+
+/* mutex held */
+void PacketQueue::drop(int q)
+{
+	for (std::deque<Entry>::iterator it = queue[q].begin(); it != queue[q].end(); ++it)
+		packet_free(&it->packet);
+	queue[q].clear();
+	bytes[q] = 0;
+}
+
+void PacketQueue::SetLimit(int q, size_t max_bytes)
+{
+	ScopedLock lock(mutex);
+	maxBytes[q] = max_bytes;
+	spaceCond.broadcast();
+}
+
+bool PacketQueue::Put(int q, AVStream *stream, AVPacket *packet, int64_t pts)
+{
+	ScopedLock lock(mutex);
+	size_t size = packet ? packet->size : 0;
+	/* an oversized packet still goes into an empty queue */
+	while (!aborted && !queue[q].empty() && bytes[q] + size > maxBytes[q])
+		spaceCond.wait(&mutex);
+	if (aborted)
+		return false;
+
+	Entry e;
+	e.stream = stream;
+	e.pts = pts;
+	e.restart = !packet;
+	e.order = INT64_MIN;
+	av_init_packet(&e.packet);
+	e.packet.data = NULL;
+	e.packet.size = 0;
+	if (packet) {
+		/* move, the caller's packet is empty afterwards */
+		e.packet = *packet;
+		av_init_packet(packet);
+		packet->data = NULL;
+		packet->size = 0;
+		int64_t ts = (e.packet.dts != AV_NOPTS_VALUE) ? e.packet.dts : e.packet.pts;
+		if (ts != AV_NOPTS_VALUE)
+			e.order = av_rescale_q(ts, stream->time_base, AV_TIME_BASE_Q);
+	}
+	queue[q].push_back(e);
+	bytes[q] += size;
+	dataCond.signal();
+	return true;
+}
+
+bool PacketQueue::Get(Entry &entry)
+{
+	ScopedLock lock(mutex);
+	for (;;) {
+		if (aborted)
+			return false;
+		int best = -1;
+		for (int q = 0; q < QUEUES; q++) {
+			if (queue[q].empty())
+				continue;
+			/* unknown timestamps go out right away, they can't be ordered */
+			if (best < 0 || queue[q].front().order < queue[best].front().order)
+				best = q;
+		}
+		if (best > -1) {
+			entry = queue[best].front();
+			queue[best].pop_front();
+			bytes[best] -= entry.packet.size;
+			busy = true;
+			spaceCond.broadcast();
+			return true;
+		}
+		if (finished)
+			return false;
+		dataCond.wait(&mutex);
+	}
+}
+
+void PacketQueue::Done(Entry &entry)
+{
+	packet_free(&entry.packet);
+	ScopedLock lock(mutex);
+	busy = false;
+	idleCond.broadcast();
+}
+
+void PacketQueue::Flush()
+{
+	ScopedLock lock(mutex);
+	for (int q = 0; q < QUEUES; q++)
+		drop(q);
+	spaceCond.broadcast();
+	/* whatever the writer is busy with must reach the device before it is cleared */
+	while (busy && !aborted)
+		idleCond.wait(&mutex);
+}
+
+void PacketQueue::Finish()
+{
+	ScopedLock lock(mutex);
+	finished = true;
+	dataCond.broadcast();
+}
+
+void PacketQueue::Abort()
+{
+	ScopedLock lock(mutex);
+	aborted = true;
+	for (int q = 0; q < QUEUES; q++)
+		drop(q);
+	dataCond.broadcast();
+	spaceCond.broadcast();
+	idleCond.broadcast();
+}
+
+void PacketQueue::Reset()
+{
+	ScopedLock lock(mutex);
+	for (int q = 0; q < QUEUES; q++)
+		drop(q);
+	aborted = false;
+	finished = false;
+	busy = false;
+}
+
+void PacketQueue::GetDepth(int q, Depth &depth)
+{
+	ScopedLock lock(mutex);
+	depth.packets = queue[q].size();
+	depth.bytes = bytes[q];
+	depth.duration = 0;
+	if (depth.packets > 1) {
+		int64_t first = queue[q].front().order, last = queue[q].back().order;
+		if (first != INT64_MIN && last != INT64_MIN && last > first)
+			depth.duration = (last - first) / 1000;
+	}
+}
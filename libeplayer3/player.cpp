@@ -48,6 +48,7 @@ Player::Player()
 	isBackWard = false;
 	isSlowMotion = false;
 	Speed = 0;
+	readAheadSize = -1;
 }
 
 void *Player::playthread(void *arg)
@@ -74,6 +75,7 @@ bool Player::Open(const char *Url, bool _noprobe, std::string headers)
 	abortRequested = false;
 
 	manager.clearTracks();
+	stats.Reset();
 
 	if (!strncmp("mms://", Url, 6)) {
 		url = "mmst";
@@ -185,6 +187,8 @@ bool Player::Continue()
 
 		isPaused = false;
 		//isPlaying  = 1;
+		if (isForwarding && Speed >= TRICK_MIN_SPEED)
+			output.Mute(false);
 		isForwarding = false;
 		if (isBackWard) {
 			isBackWard = false;
@@ -243,7 +247,10 @@ bool Player::FastForward(int speed)
 
 		isForwarding = 1;
 		Speed = speed;
-		output.FastForward(speed);
+		/* from TRICK_MIN_SPEED on Input::Play() feeds keyframes only, without audio */
+		output.Mute(speed >= TRICK_MIN_SPEED);
+		if (speed < TRICK_MIN_SPEED)
+			output.FastForward(speed);
 	} else {
 		fprintf(stderr,"fast forward not possible\n");
 		ret = false;
@@ -264,6 +271,7 @@ bool Player::FastBackward(int speed)
 			return false;
 		}
 
+		bool wasBackWard = isBackWard;
 		if (speed == 0) {
 			isBackWard = false;
 			Speed = 0;	/* reverse end */
@@ -281,14 +289,14 @@ bool Player::FastBackward(int speed)
 			ret = false;
 		}
 #endif
+		/* only touch the mute this call is responsible for */
+		if (isBackWard != wasBackWard)
+			output.Mute(isBackWard);
 	} else {
 		fprintf(stderr,"fast backward not possible\n");
 		ret = false;
 	}
 
-	if (isBackWard)
-		output.Mute(true);
-
 	return ret;
 }
 
@@ -321,6 +329,26 @@ bool Player::Seek(int64_t pos, bool absolute)
 	return input.Seek(pos, absolute);
 }
 
+void Player::GetStatistics(playback_stats_t &s)
+{
+	stats.Get(s);
+
+	int64_t fill, size;
+	if (input.GetBufferFill(fill, size)) {
+		s.buffered_bytes = fill;
+		s.buffer_size = size;
+	} else
+		s.buffered_bytes = s.buffer_size = -1;
+	s.buffer_empty_ms = -1;
+
+	PacketQueue::Depth depth[PLAYBACK_STATS_STREAMS];
+	input.GetQueueDepth(depth[PLAYBACK_STATS_VIDEO], depth[PLAYBACK_STATS_AUDIO]);
+	for (int i = 0; i < PLAYBACK_STATS_STREAMS; i++) {
+		s.stream[i].queued_packets = depth[i].packets;
+		s.stream[i].queued_bytes = depth[i].bytes;
+	}
+}
+
 bool Player::GetPts(int64_t &pts)
 {
 	pts = INVALID_PTS_VALUE;
@@ -0,0 +1,305 @@
+/*
+ * read-ahead buffer between the protocol and libavformat
+ *
+ * A filler thread reads from the real protocol into a large ring buffer,
+ * libavformat reads from the ring through a custom AVIOContext. Seeks
+ * within the buffered range are served from memory, a part of the
+ * buffer behind the read position is kept for short backward seeks.
+ * Other seeks restart the filler at the new position. If the connection
+ * breaks, e.g. because the server dropped it while playback was paused,
+ * it is reopened at the current offset, which makes the http protocol
+ * send a range request.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <algorithm>
+
+#include <scoped_lock.h>
+#include "readahead.h"
+#include "player.h"
+
+static const char *FILENAME = "eplayer/readahead.cpp";
+
+#define IO_BUFFER_SIZE		32768	/* AVIOContext buffer */
+#define FILL_CHUNK		65536	/* max. bytes per protocol read */
+#define BACK_FRACTION		8	/* keep 1/8 of the buffer behind the read position */
+#define MAX_RECONNECTS		5
+#define IDLE_RECONNECT_US	(20 * 1000000ll)	/* servers tend to drop idle connections */
+
+extern int interrupt_cb(void *arg);
+
+ReadAhead::ReadAhead(Player *_player, size_t _size)
+{
+	player = _player;
+	io = NULL;
+	pb = NULL;
+	options = NULL;
+	buf.resize(_size);
+	tail = head = pos = 0;
+	size = -1;
+	seekTo = -1;
+	seekable = false;
+	eof = false;
+	aborted = false;
+	error = 0;
+	running = false;
+}
+
+ReadAhead::~ReadAhead()
+{
+	Abort();
+	if (running)
+		pthread_join(thread, NULL);
+	if (io)
+		avio_closep(&io);
+	if (pb) {
+		av_freep(&pb->buffer);
+		av_freep(&pb);
+	}
+	av_dict_free(&options);
+}
+
+bool ReadAhead::Open(const char *_url, AVDictionary *_options)
+{
+	url = _url;
+	av_dict_copy(&options, _options, 0);
+
+	AVDictionary *o = NULL;
+	av_dict_copy(&o, options, 0);
+	AVIOInterruptCB cb = { interrupt_cb, player };
+	int err = avio_open2(&io, url.c_str(), AVIO_FLAG_READ, &cb, &o);
+	av_dict_free(&o);
+	if (err < 0) {
+		fprintf(stderr, "%s %s %d: avio_open2: %d\n", FILENAME, __func__, __LINE__, err);
+		return false;
+	}
+	size = avio_size(io);
+	seekable = io->seekable;
+
+	uint8_t *iobuf = (uint8_t *) av_malloc(IO_BUFFER_SIZE);
+	pb = avio_alloc_context(iobuf, IO_BUFFER_SIZE, 0, this, read_cb, NULL, seek_cb);
+	if (!pb) {
+		av_free(iobuf);
+		return false;
+	}
+	/* libavformat may only seek freely if the protocol can, seeks within
+	 * the buffer work anyway */
+	pb->seekable = seekable;
+
+	running = !pthread_create(&thread, NULL, fillthread, this);
+	if (!running)
+		return false;
+	fprintf(stderr, "%s %s %d: %u kB read-ahead, size %lld seekable %d\n", FILENAME, __func__, __LINE__,
+		(unsigned int) (buf.size() >> 10), (long long) size, seekable);
+	return true;
+}
+
+void ReadAhead::Abort()
+{
+	ScopedLock lock(mutex);
+	aborted = true;
+	dataCond.broadcast();
+	spaceCond.broadcast();
+}
+
+void ReadAhead::GetFill(int64_t &fill, int64_t &capacity)
+{
+	ScopedLock lock(mutex);
+	fill = (seekTo < 0) ? head - pos : 0;
+	capacity = buf.size();
+}
+
+void *ReadAhead::fillthread(void *arg)
+{
+	prctl(PR_SET_NAME, (unsigned long) "readahead");
+	((ReadAhead *) arg)->Fill();
+	pthread_exit(NULL);
+}
+
+/* called without the mutex, io belongs to the filler thread */
+bool ReadAhead::Reconnect(int64_t offset)
+{
+	fprintf(stderr, "%s %s %d: reconnecting at %lld\n", FILENAME, __func__, __LINE__, (long long) offset);
+	avio_closep(&io);
+	AVDictionary *o = NULL;
+	av_dict_copy(&o, options, 0);
+	AVIOInterruptCB cb = { interrupt_cb, player };
+	int err = avio_open2(&io, url.c_str(), AVIO_FLAG_READ, &cb, &o);
+	av_dict_free(&o);
+	if (err < 0)
+		return false;
+	return offset == 0 || avio_seek(io, offset, SEEK_SET) >= 0;
+}
+
+void ReadAhead::Fill()
+{
+	const size_t cap = buf.size();
+	const int64_t back = cap / BACK_FRACTION;
+	int reconnects = 0;
+	int64_t idle_since = 0;
+
+	mutex.lock();
+	while (!aborted) {
+		if (seekTo >= 0) {
+			int64_t target = seekTo;
+			seekTo = -1;
+			tail = head = target;
+			eof = false;
+			error = 0;
+			mutex.unlock();
+			int64_t r = io ? avio_seek(io, target, SEEK_SET) : -1;
+			if (r < 0 && !aborted && Reconnect(target))
+				r = target;
+			mutex.lock();
+			if (r < 0 && seekTo < 0)
+				error = (int) r;
+			dataCond.broadcast();
+			continue;
+		}
+
+		/* drop what is far enough behind the reader */
+		if (pos - back > tail)
+			tail = std::min(pos - back, head);
+		if (eof || error || head - tail >= (int64_t) cap) {
+			if (!idle_since)
+				idle_since = av_gettime_relative();
+			spaceCond.wait(&mutex);
+			continue;
+		}
+		int64_t at = head;
+		if (idle_since && av_gettime_relative() - idle_since > IDLE_RECONNECT_US && seekable) {
+			/* the connection was idle (paused, buffer full) for long, it
+			 * probably is gone. Reconnecting now is cheaper than running
+			 * into a read error after resuming */
+			mutex.unlock();
+			Reconnect(at);
+			mutex.lock();
+		}
+		idle_since = 0;
+		if (seekTo >= 0 || at != head)
+			continue;
+
+		size_t off = at % cap;
+		size_t len = std::min((size_t) (cap - (head - tail)), cap - off);
+		len = std::min(len, (size_t) FILL_CHUNK);
+		mutex.unlock();
+		/* [head, head + len) is free space, the reader never looks there */
+		int n = io ? avio_read(io, &buf[off], len) : AVERROR(EIO);
+		mutex.lock();
+		if (seekTo >= 0 || at != head)
+			continue;	/* a seek came in between, the data is stale */
+
+		if (n > 0) {
+			head += n;
+			reconnects = 0;
+			dataCond.broadcast();
+			continue;
+		}
+		bool premature = (n == 0 || n == AVERROR_EOF) && size > 0 && head < size;
+		if ((n == 0 || n == AVERROR_EOF) && !premature) {
+			eof = true;
+			dataCond.broadcast();
+			continue;
+		}
+		if (!aborted && seekable && reconnects < MAX_RECONNECTS) {
+			reconnects++;
+			mutex.unlock();
+			usleep(100000 * reconnects);
+			bool ok = Reconnect(at);
+			mutex.lock();
+			if (ok || seekTo >= 0)
+				continue;
+		}
+		error = n ? n : AVERROR(EIO);
+		fprintf(stderr, "%s %s %d: read error %d at %lld\n", FILENAME, __func__, __LINE__, error, (long long) at);
+		dataCond.broadcast();
+	}
+	mutex.unlock();
+}
+
+/* static */ int ReadAhead::read_cb(void *opaque, uint8_t *buf, int buf_size)
+{
+	return ((ReadAhead *) opaque)->Read(buf, buf_size);
+}
+
+/* static */ int64_t ReadAhead::seek_cb(void *opaque, int64_t offset, int whence)
+{
+	return ((ReadAhead *) opaque)->Seek(offset, whence);
+}
+
+int ReadAhead::Read(uint8_t *dst, int len)
+{
+	ScopedLock lock(mutex);
+	while (!aborted && (seekTo >= 0 || (pos >= head && !eof && !error)))
+		dataCond.wait(&mutex);
+	if (aborted)
+		return AVERROR_EXIT;
+	if (pos >= head)
+		return error ? error : AVERROR_EOF;
+
+	const size_t cap = buf.size();
+	size_t off = pos % cap;
+	size_t n = std::min((int64_t) len, head - pos);
+	n = std::min(n, cap - off);
+	memcpy(dst, &buf[off], n);
+	pos += n;
+	spaceCond.signal();
+	return n;
+}
+
+int64_t ReadAhead::Seek(int64_t offset, int whence)
+{
+	ScopedLock lock(mutex);
+	whence &= ~AVSEEK_FORCE;
+	int64_t target;
+	switch (whence) {
+		case AVSEEK_SIZE:
+			return size >= 0 ? size : AVERROR(ENOSYS);
+		case SEEK_SET:
+			target = offset;
+			break;
+		case SEEK_CUR:
+			target = pos + offset;
+			break;
+		case SEEK_END:
+			if (size < 0)
+				return AVERROR(ENOSYS);
+			target = size + offset;
+			break;
+		default:
+			return AVERROR(EINVAL);
+	}
+	if (target < 0)
+		return AVERROR(EINVAL);
+	if (seekTo < 0 && target >= tail && target <= head) {
+		/* buffered, no need to touch the network */
+		pos = target;
+		spaceCond.signal();
+		return target;
+	}
+	if (!seekable)
+		return AVERROR(ENOSYS);
+	pos = target;
+	seekTo = target;
+	eof = false;
+	error = 0;
+	spaceCond.signal();
+	return target;
+}
@@ -0,0 +1,109 @@
+/*
+ * playback statistics collector
+ *
+ * Input bitrate is kept in one second slots, so the 1 / 10 / 60 second
+ * averages cost nothing per packet. The writer thread feeds write
+ * latencies, errors and pts jumps, seeks are timed from the request
+ * to the first device write after the flush.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <scoped_lock.h>
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/time.h>
+}
+
+#include "stats.h"
+#include "misc.h"
+
+Stats::Stats()
+{
+	Reset();
+}
+
+void Stats::Reset()
+{
+	ScopedLock lock(mutex);
+	memset(&s, 0, sizeof(s));
+	playback_stats_window_reset(&window, av_gettime_relative() / 1000000);
+	for (int i = 0; i < PLAYBACK_STATS_STREAMS; i++)
+		lastPts[i] = INVALID_PTS_VALUE;
+	seekStart = 0;
+	seekFlushed = false;
+}
+
+void Stats::Read(size_t bytes)
+{
+	int64_t sec = av_gettime_relative() / 1000000;
+	ScopedLock lock(mutex);
+	playback_stats_window_add(&window, sec, bytes);
+	s.read_bytes += bytes;
+}
+
+void Stats::Write(int stream, size_t bytes, int64_t pts, int64_t usec, bool ok)
+{
+	if (stream < 0 || stream >= PLAYBACK_STATS_STREAMS)
+		return;
+	ScopedLock lock(mutex);
+	playback_stream_stats_t &st = s.stream[stream];
+	if (!ok) {
+		st.write_errors++;
+		return;
+	}
+	playback_stats_count_write(&st, &lastPts[stream], INVALID_PTS_VALUE, bytes, pts, usec);
+
+	if (seekFlushed) {
+		uint32_t ms = (av_gettime_relative() - seekStart) / 1000;
+		s.seeks++;
+		s.seek_latency_last = ms;
+		if (ms > s.seek_latency_max)
+			s.seek_latency_max = ms;
+		seekStart = 0;
+		seekFlushed = false;
+	}
+}
+
+void Stats::SeekStart()
+{
+	ScopedLock lock(mutex);
+	/* a seek requested while another one is pending is timed from the first */
+	if (!seekStart)
+		seekStart = av_gettime_relative();
+}
+
+void Stats::SeekFlushed()
+{
+	ScopedLock lock(mutex);
+	for (int i = 0; i < PLAYBACK_STATS_STREAMS; i++)
+		lastPts[i] = INVALID_PTS_VALUE;
+	if (seekStart)
+		seekFlushed = true;
+}
+
+void Stats::Get(playback_stats_t &stats)
+{
+	int64_t sec = av_gettime_relative() / 1000000;
+	ScopedLock lock(mutex);
+	playback_stats_window_advance(&window, sec);
+	stats = s;
+	stats.bitrate_1s = playback_stats_window_bitrate(&window, sec, 1);
+	stats.bitrate_10s = playback_stats_window_bitrate(&window, sec, 10);
+	stats.bitrate_60s = playback_stats_window_bitrate(&window, sec, 60);
+}
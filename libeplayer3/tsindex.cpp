@@ -0,0 +1,290 @@
+/*
+ * keyframe index for transport stream files
+ *
+ * Transport streams don't carry an index, seeking by the average bitrate
+ * lands far off in VBR recordings. A thread scans the file for PES
+ * packets of the video stream that start a keyframe and records their
+ * pts and file offset. The index is cached next to the recording in the
+ * ".ap" format (big endian 64 bit offset / pts pairs) used by other
+ * receiver software, so the scan is only needed once, and for growing
+ * recordings only the part behind the cached index is scanned.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/prctl.h>
+#include <algorithm>
+
+#include <scoped_lock.h>
+#include "tsindex.h"
+
+static const char *FILENAME = "eplayer/tsindex.cpp";
+
+#define TS_PACKET_SIZE	188
+#define SCAN_CHUNK	(TS_PACKET_SIZE * 1024)
+#define SCAN_LIMIT	1024		/* PES payload bytes searched for a keyframe start code */
+#define DROP_CACHE	(8 << 20)	/* don't let the scan push the playback data out of the page cache */
+#define PTS_MASK	((1ll << 33) - 1)
+
+static bool offset_less(int64_t offset, const TsIndex::Entry &e) { return offset < e.offset; }
+static bool pts_less(int64_t pts, const TsIndex::Entry &e) { return pts < e.pts; }
+
+TsIndex::TsIndex(const char *_path, int _pid, enum AVCodecID _codec)
+{
+	path = _path;
+	pid = _pid;
+	codec = _codec;
+	complete = false;
+	aborted = false;
+	running = false;
+	lastPts = -1;
+	wrap = 0;
+}
+
+TsIndex::~TsIndex()
+{
+	aborted = true;
+	if (running)
+		pthread_join(thread, NULL);
+}
+
+void TsIndex::Start()
+{
+	running = !pthread_create(&thread, NULL, scanthread, this);
+}
+
+void *TsIndex::scanthread(void *arg)
+{
+	prctl(PR_SET_NAME, (unsigned long) "tsindex");
+	((TsIndex *) arg)->Scan();
+	pthread_exit(NULL);
+}
+
+void TsIndex::Add(int64_t offset, int64_t pts)
+{
+	if (lastPts >= 0 && pts < lastPts - (1ll << 32))
+		wrap += 1ll << 33;
+	lastPts = pts;
+	Entry e;
+	e.offset = offset;
+	e.pts = pts + wrap;
+	ScopedLock lock(mutex);
+	entries.push_back(e);
+}
+
+bool TsIndex::IsKeyframe(uint32_t code)
+{
+	switch (codec) {
+		case AV_CODEC_ID_MPEG1VIDEO:
+		case AV_CODEC_ID_MPEG2VIDEO:
+			return code == 0xb3;			/* sequence header */
+		case AV_CODEC_ID_H264:
+			code &= 0x1f;
+			return code == 5 || code == 7;		/* IDR, SPS */
+		case AV_CODEC_ID_HEVC:
+			code = (code >> 1) & 0x3f;
+			return (code >= 16 && code <= 21) || code == 32 || code == 33; /* IRAP, VPS, SPS */
+		default:
+			return false;
+	}
+}
+
+static int64_t get_be64(const uint8_t *p)
+{
+	int64_t r = 0;
+	for (int i = 0; i < 8; i++)
+		r = (r << 8) | p[i];
+	return r;
+}
+
+static void put_be64(uint8_t *p, int64_t v)
+{
+	for (int i = 7; i >= 0; i--, v >>= 8)
+		p[i] = v & 0xff;
+}
+
+bool TsIndex::Load(int64_t &resume)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st))
+		return false;
+	std::string ap = path + ".ap";
+	FILE *f = fopen(ap.c_str(), "r");
+	if (!f)
+		return false;
+	uint8_t b[16];
+	while (fread(b, 1, sizeof(b), f) == sizeof(b)) {
+		int64_t offset = get_be64(b);
+		if (offset >= st.st_size)
+			break;	/* not for this file */
+		Add(offset, get_be64(b + 8) & PTS_MASK);
+	}
+	fclose(f);
+	if (entries.empty())
+		return false;
+	resume = entries.back().offset + TS_PACKET_SIZE;
+	fprintf(stderr, "%s %s %d: %u cached entries\n", FILENAME, __func__, __LINE__, (unsigned int) entries.size());
+	return true;
+}
+
+void TsIndex::Save()
+{
+	std::string ap = path + ".ap";
+	std::string tmp = ap + ".tmp";
+	FILE *f = fopen(tmp.c_str(), "w");
+	if (!f)
+		return;	/* read-only media, fine */
+	bool ok = true;
+	for (std::vector<Entry>::iterator it = entries.begin(); ok && it != entries.end(); ++it) {
+		uint8_t b[16];
+		put_be64(b, it->offset);
+		put_be64(b + 8, it->pts & PTS_MASK);
+		ok = fwrite(b, 1, sizeof(b), f) == sizeof(b);
+	}
+	if (fclose(f) || !ok || rename(tmp.c_str(), ap.c_str()))
+		unlink(tmp.c_str());
+}
+
+void TsIndex::Scan()
+{
+	int64_t pos = 0;
+	bool cached = Load(pos);
+	size_t known = entries.size();
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s %s %d: %s: %s\n", FILENAME, __func__, __LINE__, path.c_str(), strerror(errno));
+		return;
+	}
+
+	uint8_t *buf = new uint8_t[SCAN_CHUNK];
+	size_t have = 0;
+	int64_t dropped = pos;
+
+	/* the PES currently searched for a keyframe start code */
+	bool searching = false;
+	int64_t pesOffset = 0, pesPts = 0;
+	uint32_t state = 0xffffffff;
+	int searched = 0;
+
+	while (!aborted) {
+		ssize_t n = pread(fd, buf + have, SCAN_CHUNK - have, pos + have);
+		if (n <= 0) {
+			ScopedLock lock(mutex);
+			complete = !n;
+			break;
+		}
+		have += n;
+
+		size_t i = 0;
+		for (; i + TS_PACKET_SIZE <= have; i += TS_PACKET_SIZE) {
+			while (i + TS_PACKET_SIZE <= have && buf[i] != 0x47)
+				i++;	/* resync */
+			if (i + TS_PACKET_SIZE > have)
+				break;
+			uint8_t *p = buf + i;
+			if ((((p[1] & 0x1f) << 8) | p[2]) != pid || (p[1] & 0x80))
+				continue;
+			int off = 4;
+			if (p[3] & 0x20)
+				off += 1 + p[4];
+			if (!(p[3] & 0x10) || off >= TS_PACKET_SIZE)
+				continue;
+			uint8_t *pl = p + off;
+			int len = TS_PACKET_SIZE - off;
+			if (p[1] & 0x40) {
+				searching = false;
+				if (len >= 14 && !pl[0] && !pl[1] && pl[2] == 1 && (pl[7] & 0x80)) {
+					pesPts = ((int64_t) (pl[9] & 0x0e) << 29) | (pl[10] << 22) | ((pl[11] & 0xfe) << 14) | (pl[12] << 7) | (pl[13] >> 1);
+					pesOffset = pos + i;
+					searching = true;
+					state = 0xffffffff;
+					searched = 0;
+					int hl = 9 + pl[8];
+					pl += hl;
+					len -= hl;
+				}
+			}
+			for (int j = 0; searching && j < len; j++) {
+				state = (state << 8) | pl[j];
+				if ((state & 0xffffff00) == 0x100 && IsKeyframe(state & 0xff)) {
+					Add(pesOffset, pesPts);
+					searching = false;
+				} else if (++searched > SCAN_LIMIT)
+					searching = false;
+			}
+		}
+		memmove(buf, buf + i, have - i);
+		have -= i;
+		pos += i;
+		if (pos - dropped > DROP_CACHE) {
+			posix_fadvise(fd, dropped, pos - dropped, POSIX_FADV_DONTNEED);
+			dropped = pos;
+		}
+	}
+	delete [] buf;
+	close(fd);
+
+	fprintf(stderr, "%s %s %d: %u entries, %s\n", FILENAME, __func__, __LINE__, (unsigned int) entries.size(),
+		complete ? "complete" : "aborted");
+	if (complete && entries.size() > known)
+		Save();
+	else if (complete && !cached && entries.empty())
+		fprintf(stderr, "%s %s %d: no keyframes found\n", FILENAME, __func__, __LINE__);
+}
+
+bool TsIndex::GetTime(int64_t pts, int64_t offset, int64_t &time)
+{
+	ScopedLock lock(mutex);
+	if (entries.empty() || pts < 0)
+		return false;
+	/* the nearest entry by file position resolves the pts wrap */
+	std::vector<Entry>::iterator it = std::upper_bound(entries.begin(), entries.end(), offset, offset_less);
+	if (it != entries.begin())
+		--it;
+	int64_t diff = (pts - (it->pts & PTS_MASK)) & PTS_MASK;
+	if (diff >= (1ll << 32))
+		diff -= 1ll << 33;
+	time = it->pts + diff - entries.front().pts;
+	return true;
+}
+
+bool TsIndex::GetKeyframe(int64_t time, int64_t &ktime, int64_t &offset)
+{
+	ScopedLock lock(mutex);
+	if (entries.empty())
+		return false;
+	int64_t pts = entries.front().pts + time;
+	if (pts > entries.back().pts && !complete)
+		return false;
+	std::vector<Entry>::iterator it = std::upper_bound(entries.begin(), entries.end(), pts, pts_less);
+	if (it != entries.begin())
+		--it;
+	ktime = it->pts - entries.front().pts;
+	offset = it->offset;
+	return true;
+}
+
+bool TsIndex::GetOffset(int64_t time, int64_t &offset)
+{
+	int64_t ktime;
+	return GetKeyframe(time, ktime, offset);
+}
@@ -28,8 +28,6 @@
 #include <sys/uio.h>
 #include <errno.h>
 
-#include <algorithm>
-
 #include "misc.h"
 #include "pes.h"
 #include "writer.h"
@@ -144,37 +142,19 @@ bool WriterAAC::Write(AVPacket *packet, int64_t pts)
 	if (!packet || !packet->data)
 		return false;
 
-	uint8_t PesHeader[PES_MAX_HEADER_SIZE];
 	uint8_t ExtraData[AAC_HEADER_LENGTH];
+	int PacketLength = packet->size + AAC_HEADER_LENGTH;
 
-	for (int pos = 0; pos < packet->size + AAC_HEADER_LENGTH; )
-	{
-		int PacketLength = std::min(packet->size - pos + AAC_HEADER_LENGTH, MAX_PES_PACKET_SIZE);
-
-		memcpy(ExtraData, aacbuf, AAC_HEADER_LENGTH);
-
-//		ExtraData[3] |= (PacketLength >> 11) & 0x3;
-		ExtraData[4] = (PacketLength >> 3) & 0xff;
-		ExtraData[5] |= (PacketLength << 5) & 0xe0;
+	memcpy(ExtraData, aacbuf, AAC_HEADER_LENGTH);
 
-		struct iovec iov[3];
-		iov[0].iov_base = PesHeader;
-		iov[0].iov_len = InsertPesHeader(PesHeader, PacketLength, AAC_AUDIO_PES_START_CODE, pts, 0);
-		iov[1].iov_base = ExtraData;
-		iov[1].iov_len = AAC_HEADER_LENGTH;
-		iov[2].iov_base = packet->data;
-		iov[2].iov_len = packet->size;
+//	ExtraData[3] |= (PacketLength >> 11) & 0x3;
+	ExtraData[4] = (PacketLength >> 3) & 0xff;
+	ExtraData[5] |= (PacketLength << 5) & 0xe0;
 
-		ssize_t l = writev(fd, iov, 3);
-#if AAC_DEBUG
-//		printf("Packet Size + AAC_HEADER_LENGTH= %d Packet Size= %d Written= %d\n", PacketLength, packet->size, l);
-#endif
-		if (l < 0)
-			return false;
-		pos += PacketLength;
-		pts = INVALID_PTS_VALUE;
-	}
-	return true;
+	pes.Start(AAC_AUDIO_PES_START_CODE, pts);
+	pes.Copy(ExtraData, AAC_HEADER_LENGTH);
+	pes.Add(packet->data, packet->size);
+	return pes.Flush();
 }
 
 WriterAAC::WriterAAC()
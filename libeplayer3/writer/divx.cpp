@@ -57,7 +57,6 @@ bool WriterDIVX::Write(AVPacket *packet, int64_t pts)
 	if (!packet || !packet->data)
 		return false;
 
-	uint8_t PesHeader[PES_MAX_HEADER_SIZE];
 	uint8_t FakeHeaders[64] = { 0 };	// 64bytes should be enough to make the fake headers
 	unsigned int FakeHeaderLength;
 	uint8_t Version = 5;
@@ -81,22 +80,14 @@ bool WriterDIVX::Write(AVPacket *packet, int64_t pts)
 
 	FakeHeaderLength = (ld.Ptr - FakeHeaders);
 
-	struct iovec iov[4];
-	int ic = 0;
-	iov[ic].iov_base = PesHeader;
-	iov[ic++].iov_len = InsertPesHeader(PesHeader, packet->size, MPEG_VIDEO_PES_START_CODE, pts, FakeStartCode);
-	iov[ic].iov_base = FakeHeaders;
-	iov[ic++].iov_len = FakeHeaderLength;
-
+	pes.Start(MPEG_VIDEO_PES_START_CODE, pts, FakeStartCode);
+	pes.Copy(FakeHeaders, FakeHeaderLength);
 	if (initialHeader) {
-		iov[ic].iov_base = stream->codec->extradata;
-		iov[ic++].iov_len = stream->codec->extradata_size;
+		pes.Add(stream->codec->extradata, stream->codec->extradata_size);
 		initialHeader = false;
 	}
-	iov[ic].iov_base = packet->data;
-	iov[ic++].iov_len = packet->size;
-
-	return writev(fd, iov, ic) > -1;
+	pes.Add(packet->data, packet->size);
+	return pes.Flush();
 }
 
 WriterDIVX::WriterDIVX()
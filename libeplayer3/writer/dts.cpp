@@ -30,9 +30,6 @@
 #include "pes.h"
 #include "writer.h"
 
-#define PES_AUDIO_PRIVATE_HEADER_SIZE   16	// consider maximum private header size.
-#define PES_AUDIO_HEADER_SIZE		(32 + PES_AUDIO_PRIVATE_HEADER_SIZE)
-
 class WriterDTS : public Writer
 {
 	public:
@@ -45,33 +42,9 @@ bool WriterDTS::Write(AVPacket *packet, int64_t pts)
 	if (!packet || !packet->data)
 		return false;
 
-	uint8_t PesHeader[PES_AUDIO_HEADER_SIZE];
-
-// #define DO_BYTESWAP
-#ifdef DO_BYTESWAP
-	uint8_t Data[packet->size];
-	memcpy(Data, packet->data, packet->size);
-
-	/* 16-bit byte swap all data before injecting it */
-	for (i = 0; i < packet->size; i += 2) {
-		uint8_t Tmp = Data[i];
-		Data[i] = Data[i + 1];
-		Data[i + 1] = Tmp;
-	}
-#endif
-
-	struct iovec iov[2];
-
-	iov[0].iov_base = PesHeader;
-	iov[0].iov_len = InsertPesHeader(PesHeader, packet->size, MPEG_AUDIO_PES_START_CODE /*PRIVATE_STREAM_1_PES_START_CODE */ , pts, 0);
-#ifdef DO_BYTESPWAP
-	iov[1].iov_base = Data;
-#else
-	iov[1].iov_base = packet->data;
-#endif
-	iov[1].iov_len = packet->size;
-
-	return writev(fd, iov, 2) > -1;
+	pes.Start(MPEG_AUDIO_PES_START_CODE /*PRIVATE_STREAM_1_PES_START_CODE */, pts);
+	pes.Add(packet->data, packet->size);
+	return pes.Flush();
 }
 
 WriterDTS::WriterDTS()
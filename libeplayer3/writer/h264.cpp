@@ -68,8 +68,6 @@ bool WriterH264::Write(AVPacket *packet, int64_t pts)
 {
 	if (!packet || !packet->data)
 		return false;
-	uint8_t PesHeader[PES_MAX_HEADER_SIZE];
-	struct iovec iov[512];
 
 	uint8_t *d = packet->data;
 
@@ -78,28 +76,19 @@ bool WriterH264::Write(AVPacket *packet, int64_t pts)
 			           || (d[0] == 0xff && d[1] == 0xff && d[2] == 0xff && d[3] == 0xff) // FIXME, needed???
 	)) {
 		unsigned int FakeStartCode = /* (call->Version << 8) | */ PES_VERSION_FAKE_START_CODE;
-		int ic = 0;
-		iov[ic++].iov_base = PesHeader;
-		unsigned int len = 0;
+		pes.Start(MPEG_VIDEO_PES_START_CODE, pts, FakeStartCode);
 		if (initialHeader) {
 			initialHeader = false;
-			iov[ic].iov_base = stream->codec->extradata;
-			iov[ic++].iov_len = stream->codec->extradata_size;
-			len += stream->codec->extradata_size;
+			pes.Add(stream->codec->extradata, stream->codec->extradata_size);
 		}
-		iov[ic].iov_base = packet->data;
-		iov[ic++].iov_len = packet->size;
-		len += packet->size;
+		pes.Add(packet->data, packet->size);
 #if 1 // FIXME: needed?
 		// Hellmaster1024:
 		// some packets will only be accepted by the player if we send one byte more than data is available.
 		// The content of this byte does not matter. It will be ignored by the player
-		iov[ic].iov_base = (void *) "";
-		iov[ic++].iov_len = 1;
-		len++;
+		pes.Add("", 1);
 #endif
-		iov[0].iov_len = InsertPesHeader(PesHeader, len, MPEG_VIDEO_PES_START_CODE, pts, FakeStartCode);
-		return writev(fd, iov, ic) > -1;
+		return pes.Flush();
 	}
 
 	// convert NAL units without sync byte sequence to byte-stream format
@@ -152,32 +141,21 @@ bool WriterH264::Write(AVPacket *packet, int64_t pts)
 
 		Header[len++] = 0x80;	// Rsbp trailing bits
 
-		int ic = 0;
-		iov[ic].iov_base = PesHeader;
-		iov[ic++].iov_len = InsertPesHeader(PesHeader, len, MPEG_VIDEO_PES_START_CODE, INVALID_PTS_VALUE, 0);
-		iov[ic].iov_base = Header;
-		iov[ic++].iov_len = len;
-		if (writev(fd, iov, ic) < 0)
-			return false;
+		pes.Start(MPEG_VIDEO_PES_START_CODE, INVALID_PTS_VALUE);
+		pes.Copy(Header, len);
 
-		ic = 0;
-		iov[ic++].iov_base = PesHeader;
+		pes.Start(MPEG_VIDEO_PES_START_CODE, INVALID_PTS_VALUE);
 
 		NalLengthBytes = (avcCHeader->NalLengthMinusOne & 0x03) + 1;
 		unsigned int ParamOffset = 0;
-		len = 0;
 
 		// sequence parameter set
 		unsigned int ParamSets = avcCHeader->NumParamSets & 0x1f;
 		for (unsigned int i = 0; i < ParamSets; i++) {
 			unsigned int PsLength = (avcCHeader->Params[ParamOffset] << 8) | avcCHeader->Params[ParamOffset + 1];
 
-			iov[ic].iov_base = (uint8_t *) "\0\0\0\1";
-			iov[ic++].iov_len = 4;
-			len += 4;
-			iov[ic].iov_base = &avcCHeader->Params[ParamOffset + 2];
-			iov[ic++].iov_len = PsLength;
-			len += PsLength;
+			pes.Copy("\0\0\0\1", 4);
+			pes.Add(&avcCHeader->Params[ParamOffset + 2], PsLength);
 			ParamOffset += PsLength + 2;
 		}
 
@@ -187,23 +165,19 @@ bool WriterH264::Write(AVPacket *packet, int64_t pts)
 		for (unsigned int i = 0; i < ParamSets; i++) {
 			unsigned int PsLength = (avcCHeader->Params[ParamOffset] << 8) | avcCHeader->Params[ParamOffset + 1];
 
-			iov[ic].iov_base = (uint8_t *) "\0\0\0\1";
-			iov[ic++].iov_len = 4;
-			len += 4;
-			iov[ic].iov_base = &avcCHeader->Params[ParamOffset + 2];
-			iov[ic++].iov_len = PsLength;
-			len += PsLength;
+			pes.Copy("\0\0\0\1", 4);
+			pes.Add(&avcCHeader->Params[ParamOffset + 2], PsLength);
 			ParamOffset += PsLength + 2;
 		}
 
-		iov[0].iov_len = InsertPesHeader(PesHeader, len, MPEG_VIDEO_PES_START_CODE, INVALID_PTS_VALUE, 0);
-		ssize_t l = writev(fd, iov, ic);
-		if (l < 0)
+		if (!pes.Flush())
 			return false;
 
 		initialHeader = false;
 	}
 
+	// all NAL units of the access unit go into one PES
+	pes.Start(MPEG_VIDEO_PES_START_CODE, pts);
 	uint8_t *de = d + packet->size;
 	do {
 		unsigned int len = 0;
@@ -230,24 +204,13 @@ bool WriterH264::Write(AVPacket *packet, int64_t pts)
 			break;
 		}
 
-		int ic = 0;
-		iov[ic++].iov_base = PesHeader;
-		iov[ic].iov_base = (uint8_t *) "\0\0\0\1";
-		iov[ic++].iov_len = 4;
-
-		iov[ic].iov_base = d;
-		iov[ic++].iov_len = len;
-		iov[0].iov_len = InsertPesHeader(PesHeader, len + 3, MPEG_VIDEO_PES_START_CODE, pts, 0);
-		ssize_t l = writev(fd, iov, ic);
-		if (l < 0)
-			return false;
+		pes.Copy("\0\0\0\1", 4);
+		pes.Add(d, len);
 
 		d += len;
-		pts = INVALID_PTS_VALUE;
-
 	} while (d < de);
 
-	return true;
+	return pes.Flush();
 }
 
 WriterH264::WriterH264()
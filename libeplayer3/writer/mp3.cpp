@@ -26,8 +26,6 @@
 #include <sys/uio.h>
 #include <errno.h>
 
-#include <algorithm>
-
 #include "misc.h"
 #include "pes.h"
 #include "writer.h"
@@ -44,23 +42,9 @@ bool WriterMP3::Write(AVPacket *packet, int64_t pts)
 	if (!packet || !packet->data)
 		return false;
 
-	uint8_t PesHeader[PES_MAX_HEADER_SIZE];
-
-	for (int pos = 0; pos < packet->size; ) {
-		int PacketLength = std::min(packet->size - pos, MAX_PES_PACKET_SIZE);
-		struct iovec iov[2];
-		iov[0].iov_base = PesHeader;
-		iov[0].iov_len = InsertPesHeader(PesHeader, PacketLength, MPEG_AUDIO_PES_START_CODE, pts, 0);
-		iov[1].iov_base = packet->data + pos;
-		iov[1].iov_len = PacketLength;
-
-		ssize_t l = writev(fd, iov, 2);
-		if (l < 0)
-			return false;
-		pos += PacketLength;
-		pts = INVALID_PTS_VALUE;
-	}
-	return true;
+	pes.Start(MPEG_AUDIO_PES_START_CODE, pts);
+	pes.Add(packet->data, packet->size);
+	return pes.Flush();
 }
 
 WriterMP3::WriterMP3()
@@ -22,16 +22,27 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <stdint.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
+#include <sys/prctl.h>
 #include <sys/uio.h>
 #include <linux/dvb/audio.h>
 
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include <scoped_lock.h>
+#include <condition_abstraction.h>
+
 #include "misc.h"
 #include "pes.h"
 #include "writer.h"
+#include "coalescer.h"
 #include "player.h"
 
 extern "C" {
@@ -42,6 +53,10 @@ extern "C" {
 #include <libavutil/opt.h>
 }
 
+#define PCM_PES_SIZE		2048
+#define PCM_QUEUE_BYTES		(256 << 10)	/* compressed input of the decoder */
+#define PCM_RING_BYTES		(256 << 10)	/* decoded PCM, ~1.3s of 48kHz stereo */
+
 // reference: search for TypeLpcmDVDAudio in player/frame_parser/frame_parser_audio_lpcm.cpp
 static const uint8_t clpcm_prv[14] = {
 	0xA0,	//sub_stream_id
@@ -57,43 +72,86 @@ static const uint8_t clpcm_prv[14] = {
 	0, 0	//resvd for copyright management
 };
 
+/* Software audio decoding for what the hardware can't play itself.
+ * Write() only queues the packet for a worker thread, which decodes and
+ * resamples into a PCM ring. LPCM framing and the device writes run from
+ * that ring on the writer thread, so video injection never waits for the
+ * decoder. */
 class WriterPCM : public Writer
 {
 	private:
+		/* LPCM framing, writer thread. Changed by the worker only while
+		 * the ring is empty */
 		unsigned int SubFrameLen;
 		unsigned int SubFramesPerPES;
 		uint8_t lpcm_prv[14];
-		uint8_t injectBuffer[2048];
-		uint8_t breakBuffer[sizeof(injectBuffer)];
-		uint8_t *output;
-		uint8_t out_samples_max;
-		unsigned int breakBufferFillSize;
 		int uNoOfChannels;
 		int uSampleRate;
 		int uBitsPerSample;
 
-		AVStream *stream;
+		/* decoding, worker thread */
+		AVCodecContext *ctx;	/* own copy, the demuxer flushes stream->codec */
 		SwrContext *swr;
 		AVFrame *decoded_frame;
+		uint8_t *output;
+		int out_samples_max;
 		int out_sample_rate;
 		int out_channels;
 		uint64_t out_channel_layout;
-		bool initialHeader;
-		bool restart_audio_resampling;
 
+		/* shared */
+		struct Mark {
+			uint64_t pos;	/* ring position of the first sample of a frame */
+			int64_t pts;
+		};
+		Mutex mutex;
+		Condition cond;		/* broadcast on every change below */
+		pthread_t thread;
+		bool running;
+		bool aborted;
+		bool busy;		/* the worker is decoding a packet */
+		bool injecting;		/* the writer references ring data */
+		bool restart;		/* the worker has to reopen the decoder */
+		bool clearDevice;	/* new format, clear the device before the next PES */
+		unsigned int generation;	/* bumped when queued data is dropped */
+		bool stopped;		/* Stop() since Init(), packets are refused */
+		/* copies of what the worker needs from the stream, the demuxer may be
+		 * closed while it runs. Replaced by Init() only while it is not busy */
+		AVCodecContext *source;
+		AVRational timeBase;
+		int64_t startTime;	/* AV_TIME_BASE, AV_NOPTS_VALUE if unknown */
+		std::deque<AVPacket> packets;	/* empty packet: drain the decoder */
+		size_t packetBytes;
+		std::vector<uint8_t> ring;	/* a multiple of SubFrameLen */
+		uint64_t head;		/* bytes put by the worker */
+		uint64_t tail;		/* bytes written to the device */
+		std::deque<Mark> marks;
+
+		static void *workerthread(void *arg);
+		void Worker();
+		bool Decode(AVPacket *packet, unsigned int gen);
+		bool Setup(unsigned int gen);
+		int64_t CalcPts(int64_t pts);
+		void Reset();
+		bool Put(const uint8_t *data, size_t len, int64_t pts, unsigned int gen);
+		void Drop();
+		size_t Framable();
+		bool Inject();
+		void swapSubFrame(uint8_t *p);
+		bool prepareClipPlay();
 	public:
 		bool Write(AVPacket *packet, int64_t pts);
-		bool prepareClipPlay();
-		bool writePCM(int64_t Pts, uint8_t *data, unsigned int size);
 		void Init(int _fd, AVStream *_stream, Player *_player);
+		void Clear();
+		void Stop();
 		WriterPCM();
+		~WriterPCM();
 };
 
 bool WriterPCM::prepareClipPlay()
 {
 	SubFrameLen = 0;
 	SubFramesPerPES = 0;
-	breakBufferFillSize = 0;
 
 	memcpy(lpcm_prv, clpcm_prv, sizeof(lpcm_prv));
 
@@ -130,7 +188,7 @@ bool WriterPCM::prepareClipPlay()
 	SubFrameLen *= uBitsPerSample / 8;
 
 	//rewrite PES size to have as many complete subframes per PES as we can
-	SubFramesPerPES = ((sizeof(injectBuffer) - 14) - sizeof(lpcm_prv)) / SubFrameLen;
+	SubFramesPerPES = ((PCM_PES_SIZE - 14) - sizeof(lpcm_prv)) / SubFrameLen;
 	SubFrameLen *= SubFramesPerPES;
 
 	//set number of channels
@@ -149,167 +207,272 @@ bool WriterPCM::prepareClipPlay()
 	return true;
 }
 
-bool WriterPCM::writePCM(int64_t Pts, uint8_t *data, unsigned int size)
+// big endian for the player, in place
+void WriterPCM::swapSubFrame(uint8_t *p)
 {
-	bool res = true;
-	uint8_t PesHeader[PES_MAX_HEADER_SIZE];
-
-	if (initialHeader) {
-		initialHeader = false;
-		prepareClipPlay();
-		ioctl(fd, AUDIO_CLEAR_BUFFER, NULL);
+	if (uBitsPerSample == 16) {
+		for (unsigned int n = 0; n < SubFrameLen; n += 2) {
+			uint8_t tmp = p[n];
+			p[n] = p[n + 1];
+			p[n + 1] = tmp;
+		}
+	} else {
+		//      0   1   2   3   4   5   6   7   8   9  10  11
+		//    A1c A1b A1a B1c B1b B1a A2c A2b A2a B2c B2b B2a
+		// to A1a A1b B1a B1b A2a A2b B2a B2b A1c B1c A2c B2c
+		for (unsigned int n = 0; n < SubFrameLen; n += 12, p += 12) {
+			uint8_t t;
+			t = p[0];
+			p[0] = p[2];
+			p[2] = p[5];
+			p[5] = p[7];
+			p[7] = p[11];
+			p[11] = p[9];
+			p[9] = p[3];
+			p[3] = p[4];
+			p[4] = p[8];
+			p[8] = t;
+		}
 	}
+}
 
-	size += breakBufferFillSize;
-
-	while (size >= SubFrameLen) {
-		if (breakBufferFillSize)
-			memcpy(injectBuffer, breakBuffer, breakBufferFillSize);
-		memcpy(injectBuffer + breakBufferFillSize, data, SubFrameLen - breakBufferFillSize);
-		size -= SubFrameLen;
-		data += SubFrameLen - breakBufferFillSize;
-		breakBufferFillSize = 0;
-
-		//write the PCM data
-		if (uBitsPerSample == 16) {
-			for (unsigned int n = 0; n < SubFrameLen; n += 2) {
-				uint8_t tmp = injectBuffer[n];
-				injectBuffer[n] = injectBuffer[n + 1];
-				injectBuffer[n + 1] = tmp;
-			}
-		} else {
-			//      0   1   2   3   4   5   6   7   8   9  10  11
-			//    A1c A1b A1a B1c B1b B1a A2c A2b A2a B2c B2b B2a
-			// to A1a A1b B1a B1b A2a A2b B2a B2b A1c B1c A2c B2c
-			for (unsigned int n = 0; n < SubFrameLen; n += 12) {
-				uint8_t t, *p = injectBuffer + n;
-				t = p[0];
-				p[0] = p[2];
-				p[2] = p[5];
-				p[5] = p[7];
-				p[7] = p[11];
-				p[11] = p[9];
-				p[9] = p[3];
-				p[3] = p[4];
-				p[4] = p[8];
-				p[8] = t;
-			}
+static void packet_free(AVPacket *packet)
+{
+#if (LIBAVFORMAT_VERSION_MAJOR == 57 && LIBAVFORMAT_VERSION_MINOR == 25)
+	av_packet_unref(packet);
+#else
+	av_free_packet(packet);
+#endif
+}
+
+/* mutex held. Drops queued packets and PCM, and waits until the worker is
+ * done with the packet it is decoding, it still uses the old source */
+void WriterPCM::Drop()
+{
+	for (std::deque<AVPacket>::iterator it = packets.begin(); it != packets.end(); ++it)
+		packet_free(&*it);
+	packets.clear();
+	packetBytes = 0;
+	generation++;
+	restart = true;
+	cond.broadcast();
+	/* Put() gives up on the new generation, so this doesn't take long */
+	while (busy)
+		cond.wait(&mutex);
+	head = tail = 0;
+	marks.clear();
+}
+
+/* mutex held. Bytes that make up complete subframes */
+size_t WriterPCM::Framable()
+{
+	if (!SubFrameLen)
+		return 0;
+	return (head - tail) / SubFrameLen * SubFrameLen;
+}
+
+/* writer thread: sends what the worker has decoded so far */
+bool WriterPCM::Inject()
+{
+	uint64_t pos;
+	size_t len;
+	{
+		ScopedLock lock(mutex);
+		if (clearDevice) {
+			clearDevice = false;
+			if (buffer)
+				buffer->Clear();
+			ioctl(fd, AUDIO_CLEAR_BUFFER, NULL);
 		}
+		pos = tail;
+		len = Framable();
+		if (!len)
+			return true;
+		injecting = true;
+
+		/* the ring is a multiple of SubFrameLen, subframes never wrap */
+		for (size_t done = 0; done < len; done += SubFrameLen) {
+			uint64_t p = pos + done;
+			int64_t pts = INVALID_PTS_VALUE;
+			/* a PES carries the pts of the first frame starting in it */
+			while (!marks.empty() && marks.front().pos < p + SubFrameLen) {
+				if (pts == INVALID_PTS_VALUE)
+					pts = marks.front().pts;
+				marks.pop_front();
+			}
 
-		//increment err... subframe count?
-		lpcm_prv[1] = ((lpcm_prv[1] + SubFramesPerPES) & 0x1F);
-
-		struct iovec iov[3];
-		iov[0].iov_base = PesHeader;
-		iov[1].iov_base = lpcm_prv;
-		iov[1].iov_len = sizeof(lpcm_prv);
-		iov[2].iov_base = injectBuffer;
-		iov[2].iov_len = SubFrameLen;
-		iov[0].iov_len = InsertPesHeader(PesHeader, iov[1].iov_len + iov[2].iov_len, PCM_PES_START_CODE, Pts, 0);
-		int len = writev(fd, iov, 3);
-		if (len < 0) {
-			res = false;
-			break;
+			//increment err... subframe count?
+			lpcm_prv[1] = ((lpcm_prv[1] + SubFramesPerPES) & 0x1F);
+
+			pes.Start(PCM_PES_START_CODE, pts);
+			pes.Copy(lpcm_prv, sizeof(lpcm_prv));
+			pes.Add(&ring[p % ring.size()], SubFrameLen);
 		}
 	}
-	if (size && res) {
-		breakBufferFillSize = size;
-		memcpy(breakBuffer, data, size);
-	}
 
+	/* [pos, pos + len) is ours until tail moves */
+	for (size_t done = 0; done < len; done += SubFrameLen)
+		swapSubFrame(&ring[(pos + done) % ring.size()]);
+
+	bool res = pes.Flush();
+
+	ScopedLock lock(mutex);
+	tail += len;
+	injecting = false;
+	cond.broadcast();
 	return res;
 }
 
-void WriterPCM::Init(int _fd, AVStream *_stream, Player *_player)
+/* worker thread: copies decoded PCM to the ring, waits for space */
+bool WriterPCM::Put(const uint8_t *data, size_t len, int64_t pts, unsigned int gen)
 {
-	fd = _fd;
-	stream = _stream;
-	player = _player;
-	initialHeader = true;
-	restart_audio_resampling = true;
+	ScopedLock lock(mutex);
+	if (generation != gen || ring.empty())
+		return false;
+	Mark m = { head, pts };
+	marks.push_back(m);
+	while (len) {
+		while (!aborted && generation == gen && head - tail == ring.size())
+			cond.wait(&mutex);
+		if (aborted || generation != gen)
+			return false;
+		size_t at = head % ring.size();
+		size_t n = std::min(len, std::min((size_t) (ring.size() - (head - tail)), ring.size() - at));
+		memcpy(&ring[at], data, n);
+		head += n;
+		data += n;
+		len -= n;
+		cond.broadcast();
+	}
+	return true;
 }
 
-bool WriterPCM::Write(AVPacket *packet, int64_t pts)
+static void context_free(AVCodecContext **c)
 {
-	if (!packet) {
-		restart_audio_resampling = true;
-		return true;
+	if (*c) {
+		avcodec_close(*c);
+		av_freep(&(*c)->extradata);
+		av_free(*c);
+		*c = NULL;
 	}
+}
 
-	AVCodecContext *c = stream->codec;
+/* worker thread */
+void WriterPCM::Reset()
+{
+	if (swr) {
+		swr_free(&swr);
+		swr = NULL;
+	}
+	context_free(&ctx);
+}
 
-	if (restart_audio_resampling) {
-		restart_audio_resampling = false;
-		initialHeader = true;
+/* worker thread: opens the decoder and the resampler for the source */
+bool WriterPCM::Setup(unsigned int gen)
+{
+	Reset();
+
+	if (!source)
+		return false;
+	AVCodec *codec = avcodec_find_decoder(source->codec_id);
+	if (!codec) {
+		fprintf(stderr, "%s %d: avcodec_find_decoder(%llx)\n", __func__, __LINE__, (unsigned long long) source->codec_id);
+		return false;
+	}
+	ctx = avcodec_alloc_context3(codec);
+	if (!ctx || avcodec_copy_context(ctx, source) || avcodec_open2(ctx, codec, NULL)) {
+		fprintf(stderr, "%s %d: avcodec_open2 failed\n", __func__, __LINE__);
+		Reset();
+		return false;
+	}
 
-		if (swr) {
-			swr_free(&swr);
-			swr = NULL;
-		}
-		if (decoded_frame) {
-			av_frame_free(&decoded_frame);
-			decoded_frame = NULL;
-		}
+	AVCodecContext *c = ctx;
+	int in_rate = c->sample_rate;
+	// rates in descending order
+	int rates[] = {192000, 176400, 96000, 88200, 48000, 44100, 0};
+	int i = 0;
+	// find the next equal or smallest rate
+	while (rates[i] && in_rate < rates[i])
+		i++;
+	out_sample_rate = rates[i] ? rates[i] : 44100;
+	out_channels = c->channels;
+	if (c->channel_layout == 0) {
+		// FIXME -- need to guess, looks pretty much like a bug in the FFMPEG WMA decoder
+		c->channel_layout = AV_CH_LAYOUT_STEREO;
+	}
 
-		AVCodec *codec = avcodec_find_decoder(c->codec_id);
-		if (!codec) {
-			fprintf(stderr, "%s %d: avcodec_find_decoder(%llx)\n", __func__, __LINE__, (unsigned long long) c->codec_id);
-			return false;
-		}
-		avcodec_close(c);
-		if (avcodec_open2(c, codec, NULL)) {
-			fprintf(stderr, "%s %d: avcodec_open2 failed\n", __func__, __LINE__);
-			return false;
-		}
+	out_channel_layout = c->channel_layout;
+	// player2 won't play mono
+	if (out_channel_layout == AV_CH_LAYOUT_MONO) {
+		out_channel_layout = AV_CH_LAYOUT_STEREO;
+		out_channels = 2;
 	}
 
+	swr = swr_alloc();
 	if (!swr) {
-		int in_rate = c->sample_rate;
-		// rates in descending order
-		int rates[] = {192000, 176400, 96000, 88200, 48000, 44100, 0};
-		int i = 0;
-		// find the next equal or smallest rate
-		while (rates[i] && in_rate < rates[i])
-		i++;
-		out_sample_rate = rates[i] ? rates[i] : 44100;
-		out_channels = c->channels;
-		if (c->channel_layout == 0) {
-			// FIXME -- need to guess, looks pretty much like a bug in the FFMPEG WMA decoder
-			c->channel_layout = AV_CH_LAYOUT_STEREO;
-		}
+		fprintf(stderr, "%s %d: swr_alloc failed\n", __func__, __LINE__);
+		Reset();
+		return false;
+	}
+	av_opt_set_int(swr, "in_channel_layout", c->channel_layout, 0);
+	av_opt_set_int(swr, "out_channel_layout", out_channel_layout, 0);
+	av_opt_set_int(swr, "in_sample_rate", c->sample_rate, 0);
+	av_opt_set_int(swr, "out_sample_rate", out_sample_rate, 0);
+	av_opt_set_sample_fmt(swr, "in_sample_fmt", c->sample_fmt, 0);
+	av_opt_set_sample_fmt(swr, "out_sample_fmt", AV_SAMPLE_FMT_S16, 0);
+
+	int e = swr_init(swr);
+	if (e < 0) {
+		fprintf(stderr, "swr_init: %d (icl=%d ocl=%d isr=%d osr=%d isf=%d osf=%d)\n",
+			-e, (int) c->channel_layout,
+			(int) out_channel_layout, c->sample_rate, out_sample_rate, c->sample_fmt, AV_SAMPLE_FMT_S16);
+		Reset();
+		return false;
+	}
 
-		out_channel_layout = c->channel_layout;
-		// player2 won't play mono
-		if (out_channel_layout == AV_CH_LAYOUT_MONO) {
-			out_channel_layout = AV_CH_LAYOUT_STEREO;
-			out_channels = 2;
-		}
+	/* what is left in the ring belongs to the old format */
+	ScopedLock lock(mutex);
+	while (injecting && !aborted && generation == gen)
+		cond.wait(&mutex);
+	if (aborted || generation != gen) {
+		Reset();
+		return false;
+	}
+	uSampleRate = out_sample_rate;
+	uNoOfChannels = av_get_channel_layout_nb_channels(out_channel_layout);
+	uBitsPerSample = 16;
+	if (!prepareClipPlay() || !SubFrameLen) {
+		Reset();
+		return false;
+	}
+	ring.resize(std::max(PCM_RING_BYTES / SubFrameLen, 2u) * SubFrameLen);
+	head = tail = 0;
+	marks.clear();
+	clearDevice = true;
+	return true;
+}
+
+/* worker thread: Input::calcPts() with the copied stream timing */
+int64_t WriterPCM::CalcPts(int64_t pts)
+{
+	if (pts == AV_NOPTS_VALUE)
+		return INVALID_PTS_VALUE;
 
-		uSampleRate = out_sample_rate;
-		uNoOfChannels = av_get_channel_layout_nb_channels(out_channel_layout);
-		uBitsPerSample = 16;
+	pts = 90000 * (double)pts * timeBase.num / timeBase.den;
+	if (startTime != AV_NOPTS_VALUE)
+		pts -= 90000 * startTime / AV_TIME_BASE;
 
-		swr = swr_alloc();
-		if (!swr) {
-			fprintf(stderr, "%s %d: swr_alloc failed\n", __func__, __LINE__);
-			return false;
-		}
-		av_opt_set_int(swr, "in_channel_layout", c->channel_layout, 0);
-		av_opt_set_int(swr, "out_channel_layout", out_channel_layout, 0);
-		av_opt_set_int(swr, "in_sample_rate", c->sample_rate, 0);
-		av_opt_set_int(swr, "out_sample_rate", out_sample_rate, 0);
-		av_opt_set_sample_fmt(swr, "in_sample_fmt", c->sample_fmt, 0);
-		av_opt_set_sample_fmt(swr, "out_sample_fmt", AV_SAMPLE_FMT_S16, 0);
-
-		int e = swr_init(swr);
-		if (e < 0) {
-			fprintf(stderr, "swr_init: %d (icl=%d ocl=%d isr=%d osr=%d isf=%d osf=%d)\n",
-				-e, (int) c->channel_layout,
-				(int) out_channel_layout, c->sample_rate, out_sample_rate, c->sample_fmt, AV_SAMPLE_FMT_S16);
-			restart_audio_resampling = true;
-			return false;
-		}
-	}
+	if (pts < 0)
+		return INVALID_PTS_VALUE;
+
+	return pts;
+}
+
+/* worker thread: decodes one packet, or drains the decoder if it is empty */
+bool WriterPCM::Decode(AVPacket *packet, unsigned int gen)
+{
+	if (!swr && !Setup(gen))
+		return false;
 
 	unsigned int packet_size = packet->size;
 	while (packet_size > 0 || (!packet_size && !packet->data)) {
@@ -323,14 +486,15 @@ bool WriterPCM::Write(AVPacket *packet, int64_t pts)
 		} else
 			av_frame_unref(decoded_frame);
 
-		int len = avcodec_decode_audio4(c, decoded_frame, &got_frame, packet);
-		if (len < 0) {
-			restart_audio_resampling = true;
-			break;
-		}
+		int len = avcodec_decode_audio4(ctx, decoded_frame, &got_frame, packet);
+		if (len < 0)
+			return false;
 
-		if (packet->data)
+		if (packet->data) {
 			packet_size -= len;
+			packet->data += len;
+			packet->size -= len;
+		}
 
 		if (!got_frame) {
 			if (!packet->data || !packet_size)
@@ -338,39 +502,219 @@ bool WriterPCM::Write(AVPacket *packet, int64_t pts)
 			continue;
 		}
 
-		pts = player->input.calcPts(stream, av_frame_get_best_effort_timestamp(decoded_frame));
+		int64_t pts = CalcPts(av_frame_get_best_effort_timestamp(decoded_frame));
 
 		int in_samples = decoded_frame->nb_samples;
-		int out_samples = av_rescale_rnd(swr_get_delay(swr, c->sample_rate) + in_samples, out_sample_rate, c->sample_rate, AV_ROUND_UP);
+		int out_samples = av_rescale_rnd(swr_get_delay(swr, ctx->sample_rate) + in_samples, out_sample_rate, ctx->sample_rate, AV_ROUND_UP);
 		if (out_samples > out_samples_max) {
 			if (output)
 				av_freep(&output);
 			int e = av_samples_alloc(&output, NULL, out_channels, out_samples, AV_SAMPLE_FMT_S16, 1);
 			if (e < 0) {
 				fprintf(stderr, "av_samples_alloc: %d\n", -e);
-				break;
+				out_samples_max = 0;
+				return false;
 			}
 			out_samples_max = out_samples;
 		}
 
 		out_samples = swr_convert(swr, &output, out_samples, (const uint8_t **) &decoded_frame->data[0], in_samples);
+		if (out_samples > 0 && !Put(output, out_samples * sizeof(short) * out_channels, pts, gen))
+			break;	/* dropped meanwhile */
+	}
+	return true;
+}
+
+void *WriterPCM::workerthread(void *arg)
+{
+	prctl(PR_SET_NAME, (unsigned long) "pcmdecoder");
+	((WriterPCM *) arg)->Worker();
+	pthread_exit(NULL);
+}
 
-		if (!writePCM(pts, output, out_samples * sizeof(short) * out_channels)) {
-			restart_audio_resampling = true;
+void WriterPCM::Worker()
+{
+	ScopedLock lock(mutex);
+	for (;;) {
+		while (!aborted && packets.empty())
+			cond.wait(&mutex);
+		if (aborted)
 			break;
+
+		AVPacket packet = packets.front();
+		packets.pop_front();
+		packetBytes -= packet.size;
+		unsigned int gen = generation;
+		bool reopen = restart;
+		restart = false;
+		busy = true;
+		cond.broadcast();
+
+		mutex.unlock();
+		if (reopen)
+			Reset();
+		uint8_t *data = packet.data;
+		int size = packet.size;
+		if (!Decode(&packet, gen))
+			Reset();	/* try again with the next packet */
+		packet.data = data;
+		packet.size = size;
+		packet_free(&packet);
+		mutex.lock();
+
+		busy = false;
+		cond.broadcast();
+	}
+	Reset();
+}
+
+void WriterPCM::Init(int _fd, AVStream *_stream, Player *_player)
+{
+	ScopedLock lock(mutex);
+	Drop();
+	fd = _fd;
+	player = _player;
+	stopped = false;
+	context_free(&source);
+	if (_stream && _stream->codec) {
+		source = avcodec_alloc_context3(NULL);
+		if (source && avcodec_copy_context(source, _stream->codec))
+			context_free(&source);
+		timeBase = _stream->time_base;
+	}
+	startTime = player->input.avfc ? player->input.avfc->start_time : AV_NOPTS_VALUE;
+	if (!running) {
+		aborted = false;
+		int err = pthread_create(&thread, NULL, workerthread, this);
+		if (err)
+			fprintf(stderr, "%s %d: pthread_create: %d (%s)\n", __func__, __LINE__, err, strerror(err));
+		else
+			running = true;
+	}
+}
+
+bool WriterPCM::Write(AVPacket *packet, int64_t /* pts */)
+{
+	if (!packet) {
+		/* restart marker */
+		ScopedLock lock(mutex);
+		Drop();
+		return true;
+	}
+
+	if (!running)
+		return false;
+	{
+		ScopedLock lock(mutex);
+		if (stopped)
+			return true;	/* stopping, dropped on purpose */
+	}
+
+	if (!packet->data) {
+		/* end of stream: let the worker drain the decoder, send what it yields */
+		{
+			ScopedLock lock(mutex);
+			AVPacket drain;
+			av_init_packet(&drain);
+			drain.data = NULL;
+			drain.size = 0;
+			packets.push_back(drain);
+			cond.broadcast();
+		}
+		for (;;) {
+			if (!Inject())
+				return false;
+			ScopedLock lock(mutex);
+			if (!Framable()) {
+				if (packets.empty() && !busy)
+					return true;
+				cond.wait(&mutex);
+			}
 		}
 	}
-	return !packet_size;
+
+	for (;;) {
+		{
+			ScopedLock lock(mutex);
+			/* an oversized packet still goes into an empty queue */
+			if (packets.empty() || packetBytes + packet->size <= PCM_QUEUE_BYTES) {
+				/* move, like the packet queue does */
+				packets.push_back(*packet);
+				packetBytes += packet->size;
+				av_init_packet(packet);
+				packet->data = NULL;
+				packet->size = 0;
+				cond.broadcast();
+				break;
+			}
+			/* decoding is behind, keep the ring moving meanwhile */
+			if (!Framable()) {
+				cond.wait(&mutex);
+				continue;
+			}
+		}
+		if (!Inject())
+			return false;
+	}
+	return Inject();
+}
+
+/* drops what is queued, returns once the worker is idle */
+void WriterPCM::Clear()
+{
+	ScopedLock lock(mutex);
+	Drop();
+}
+
+/* like Clear(), and refuses packets until the next Init(): the
+ * input may be closed right after this */
+void WriterPCM::Stop()
+{
+	ScopedLock lock(mutex);
+	Drop();
+	stopped = true;
 }
 
 WriterPCM::WriterPCM()
 {
+	SubFrameLen = 0;
+	SubFramesPerPES = 0;
+	ctx = NULL;
 	swr = NULL;
 	output = NULL;
 	out_samples_max = 0;
 	decoded_frame = av_frame_alloc();
+	running = false;
+	aborted = false;
+	busy = false;
+	injecting = false;
+	restart = true;
+	clearDevice = false;
+	generation = 0;
+	stopped = false;
+	source = NULL;
+	timeBase.num = 1;
+	timeBase.den = 90000;
+	startTime = AV_NOPTS_VALUE;
+	packetBytes = 0;
+	head = tail = 0;
 
 	Register(this, AV_CODEC_ID_INJECTPCM, AUDIO_ENCODING_LPCMA);
 }
 
+WriterPCM::~WriterPCM()
+{
+	if (running) {
+		mutex.lock();
+		aborted = true;
+		cond.broadcast();
+		mutex.unlock();
+		pthread_join(thread, NULL);
+	}
+	Drop();
+	context_free(&source);
+	if (output)
+		av_freep(&output);
+}
+
 static WriterPCM writer_pcm __attribute__ ((init_priority (300)));
@@ -29,6 +29,9 @@
 #include <asm/types.h>
 #include "misc.h"
 #include "pes.h"
+#include "writer.h"
+
+#include <algorithm>
 
 int InsertVideoPrivateDataHeader(uint8_t *data, int payload_size)
 {
@@ -114,3 +117,113 @@ int InsertPesHeader(uint8_t *data, int size, uint8_t stream_id, int64_t pts, int
 
 	return (ld2.Ptr - data);
 }
+
+/* closes the open PES by filling in its length */
+void PesBuilder::End()
+{
+	if (!header)
+		return;
+	header[PES_LENGTH_BYTE_1] = (length >> 8) & 0xff;
+	header[PES_LENGTH_BYTE_0] = length & 0xff;
+	header = NULL;
+}
+
+void PesBuilder::Write()
+{
+	if (ic && writer->WriteV(iov, ic) < 0)
+		failed = true;
+	ic = 0;
+	arenaUsed = 0;
+}
+
+/* make sure there are iovs and arena bytes left, write out what is
+ * there otherwise. Only called between PES */
+void PesBuilder::Room(int iovs, size_t bytes)
+{
+	if (ic + iovs > IOV_MAX || arenaUsed + bytes > PES_ARENA_SIZE)
+		Write();
+}
+
+/* the open PES is full, or the iovs or the arena are used up: end it
+ * and go on in a new one */
+void PesBuilder::Continue()
+{
+	uint8_t id = streamId;
+	End();
+	Room(2, PES_MAX_HEADER_SIZE + 1);
+	Start(id, INVALID_PTS_VALUE);
+}
+
+void PesBuilder::Start(uint8_t stream_id, int64_t pts, int pic_start_code, int private_size)
+{
+	End();
+	Room(2, PES_MAX_HEADER_SIZE);
+
+	uint8_t *h = arena + arenaUsed;
+	int len = InsertPesHeader(h, 0, stream_id, pts, pic_start_code);
+	if (private_size >= 0) {
+		int plen = InsertVideoPrivateDataHeader(h + len, private_size);
+		h[PES_HEADER_DATA_LENGTH_BYTE] += plen;
+		h[PES_FLAGS_BYTE] |= PES_EXTENSION_DATA_PRESENT;
+		len += plen;
+	}
+	arenaUsed += len;
+	iov[ic].iov_base = h;
+	iov[ic++].iov_len = len;
+
+	header = h;
+	streamId = stream_id;
+	length = len - 6;	/* PES_packet_length counts what follows it */
+}
+
+void PesBuilder::Copy(const void *data, size_t len)
+{
+	const uint8_t *d = (const uint8_t *) data;
+	while (len) {
+		size_t n = std::min(len, (size_t) MAX_PES_PACKET_SIZE - length);
+		n = std::min(n, (size_t) PES_ARENA_SIZE - arenaUsed);
+		if (!n || ic == IOV_MAX) {
+			Continue();
+			continue;
+		}
+		uint8_t *a = arena + arenaUsed;
+		memcpy(a, d, n);
+		/* extend the last iov if it ends right here, e.g. the PES header */
+		if (ic && (uint8_t *) iov[ic - 1].iov_base + iov[ic - 1].iov_len == a)
+			iov[ic - 1].iov_len += n;
+		else {
+			iov[ic].iov_base = a;
+			iov[ic++].iov_len = n;
+		}
+		arenaUsed += n;
+		length += n;
+		d += n;
+		len -= n;
+	}
+}
+
+void PesBuilder::Add(const void *data, size_t len)
+{
+	const uint8_t *d = (const uint8_t *) data;
+	while (len) {
+		size_t n = std::min(len, (size_t) MAX_PES_PACKET_SIZE - length);
+		if (!n || ic == IOV_MAX) {
+			Continue();
+			continue;
+		}
+		iov[ic].iov_base = (void *) d;
+		iov[ic++].iov_len = n;
+		length += n;
+		d += n;
+		len -= n;
+	}
+}
+
+bool PesBuilder::Flush()
+{
+	End();
+	Write();
+	bool ok = !failed;
+	failed = false;
+	return ok;
+}
@@ -26,8 +26,6 @@
 #include <sys/uio.h>
 #include <errno.h>
 
-#include <algorithm>
-
 #include "misc.h"
 #include "pes.h"
 #include "writer.h"
@@ -88,12 +86,9 @@ bool WriterVC1::Write(AVPacket *packet, int64_t pts)
 			0x00, 0x00, 0x00, 0x00
 		};
 
-		uint8_t PesHeader[PES_MAX_HEADER_SIZE];
 		uint8_t PesPayload[128];
 		uint8_t *PesPtr;
 		unsigned int usecPerFrame = av_rescale(AV_TIME_BASE, stream->r_frame_rate.den, stream->r_frame_rate.num);
-		struct iovec iov[2];
-
 
 		memset(PesPayload, 0, sizeof(PesPayload));
 
@@ -123,61 +118,26 @@ bool WriterVC1::Write(AVPacket *packet, int64_t pts)
 		*PesPtr++ = (usecPerFrame >> 16) & 0xff;
 		*PesPtr++ = usecPerFrame >> 24;
 
-		iov[0].iov_base = PesHeader;
-		iov[1].iov_base = PesPayload;
-		iov[1].iov_len = PesPtr - PesPayload;
-		iov[0].iov_len = InsertPesHeader(PesHeader, iov[1].iov_len, VC1_VIDEO_PES_START_CODE, INVALID_PTS_VALUE, 0);
-		if (writev(fd, iov, 2) < 0)
-			return false;
+		pes.Start(VC1_VIDEO_PES_START_CODE, INVALID_PTS_VALUE);
+		pes.Copy(PesPayload, PesPtr - PesPayload);
 
 		/* For VC1 the codec private data is a standard vc1 sequence header so we just copy it to the output */
-		iov[0].iov_base = PesHeader;
-		iov[1].iov_base = stream->codec->extradata;
-		iov[1].iov_len = stream->codec->extradata_size;
-		iov[0].iov_len = InsertPesHeader(PesHeader, iov[1].iov_len, VC1_VIDEO_PES_START_CODE, INVALID_PTS_VALUE, 0);
-		if (writev(fd, iov, 2) < 0)
-			return false;
-
-		initialHeader = false;
+		pes.Start(VC1_VIDEO_PES_START_CODE, INVALID_PTS_VALUE);
+		pes.Add(stream->codec->extradata, stream->codec->extradata_size);
 	}
 
 	if (packet->size > 0) {
-		int Position = 0;
-		bool insertSampleHeader = true;
-
-		while (Position < packet->size) {
-			int PacketLength = std::min(packet->size - Position, MAX_PES_PACKET_SIZE);
-			uint8_t PesHeader[PES_MAX_HEADER_SIZE];
-			int HeaderLength = InsertPesHeader(PesHeader, PacketLength, VC1_VIDEO_PES_START_CODE, pts, 0);
-
-			if (insertSampleHeader) {
-				const uint8_t Vc1FrameStartCode[] = { 0, 0, 1, VC1_FRAME_START_CODE };
-
-				if (!FrameHeaderSeen && (packet->size > 3) && (memcmp(packet->data, Vc1FrameStartCode, 4) == 0))
-					FrameHeaderSeen = true;
-				if (!FrameHeaderSeen) {
-					memcpy(&PesHeader[HeaderLength], Vc1FrameStartCode, sizeof(Vc1FrameStartCode));
-					HeaderLength += sizeof(Vc1FrameStartCode);
-				}
-				insertSampleHeader = false;
-			}
-
-			struct iovec iov[2];
-			iov[0].iov_base = PesHeader;
-			iov[0].iov_len = HeaderLength;
-			iov[1].iov_base = packet->data + Position;
-			iov[1].iov_len = PacketLength;
-
-			ssize_t l = writev(fd, iov, 2);
-			if (l < 0)
-				return false;
-
-			Position += PacketLength;
-			pts = INVALID_PTS_VALUE;
-		}
+		const uint8_t Vc1FrameStartCode[] = { 0, 0, 1, VC1_FRAME_START_CODE };
+
+		pes.Start(VC1_VIDEO_PES_START_CODE, pts);
+		if (!FrameHeaderSeen && (packet->size > 3) && (memcmp(packet->data, Vc1FrameStartCode, 4) == 0))
+			FrameHeaderSeen = true;
+		if (!FrameHeaderSeen)
+			pes.Copy(Vc1FrameStartCode, sizeof(Vc1FrameStartCode));
+		pes.Add(packet->data, packet->size);
 	}
 
-	return true;
+	return pes.Flush();
 }
 
 WriterVC1::WriterVC1()
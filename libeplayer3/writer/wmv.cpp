@@ -31,8 +31,6 @@
 #include "pes.h"
 #include "writer.h"
 
-#include <algorithm>
-
 #define WMV3_PRIVATE_DATA_LENGTH	4
 
 static const uint8_t Metadata[] = {
@@ -76,14 +74,10 @@ bool WriterWMV::Write(AVPacket *packet, int64_t pts)
 		return false;
 
 	if (initialHeader) {
-#define PES_MIN_HEADER_SIZE 9
-		uint8_t PesPacket[PES_MIN_HEADER_SIZE + 128];
-		uint8_t *PesPtr;
-		unsigned int MetadataLength;
+		uint8_t MetadataPacket[128];
+		uint8_t *PesPtr = MetadataPacket;
 		unsigned int usecPerFrame = av_rescale(AV_TIME_BASE, stream->r_frame_rate.den, stream->r_frame_rate.num);
 
-		PesPtr = &PesPacket[PES_MIN_HEADER_SIZE];
-
 		memcpy(PesPtr, Metadata, sizeof(Metadata));
 		PesPtr += METADATA_STRUCT_C_START;
 
@@ -110,55 +104,22 @@ bool WriterWMV::Write(AVPacket *packet, int64_t pts)
 		*PesPtr++ = (usecPerFrame >> 16) & 0xff;
 		*PesPtr++ = usecPerFrame >> 24;
 
-		MetadataLength = PesPtr - &PesPacket[PES_MIN_HEADER_SIZE];
-
-		int HeaderLength = InsertPesHeader(PesPacket, MetadataLength, VC1_VIDEO_PES_START_CODE, INVALID_PTS_VALUE, 0);
-
-		if (write(fd, PesPacket, HeaderLength + MetadataLength) < 0)
+		pes.Start(VC1_VIDEO_PES_START_CODE, INVALID_PTS_VALUE);
+		pes.Copy(MetadataPacket, PesPtr - MetadataPacket);
+		if (!pes.Flush())
 			return false;
 
 		initialHeader = false;
 	}
 
-	if (packet->size > 0 && packet->data) {
-		int Position = 0;
-		bool insertSampleHeader = true;
-
-		while (Position < packet->size) {
-
-			int PacketLength = std::min(packet->size - Position, MAX_PES_PACKET_SIZE);
-
-			uint8_t PesHeader[PES_MAX_HEADER_SIZE] = { 0 };
-			int HeaderLength = InsertPesHeader(PesHeader, PacketLength, VC1_VIDEO_PES_START_CODE, pts, 0);
-
-			if (insertSampleHeader) {
-				unsigned int PesLength;
-				unsigned int PrivateHeaderLength;
-
-				PrivateHeaderLength = InsertVideoPrivateDataHeader(&PesHeader[HeaderLength], packet->size);
-				/* Update PesLength */
-				PesLength = PesHeader[PES_LENGTH_BYTE_0] + (PesHeader[PES_LENGTH_BYTE_1] << 8) + PrivateHeaderLength;
-				PesHeader[PES_LENGTH_BYTE_0] = PesLength & 0xff;
-				PesHeader[PES_LENGTH_BYTE_1] = (PesLength >> 8) & 0xff;
-				PesHeader[PES_HEADER_DATA_LENGTH_BYTE] += PrivateHeaderLength;
-				PesHeader[PES_FLAGS_BYTE] |= PES_EXTENSION_DATA_PRESENT;
-
-				HeaderLength += PrivateHeaderLength;
-				insertSampleHeader = false;
-			}
-
-			uint8_t PacketStart[packet->size + HeaderLength];
-			memcpy(PacketStart, PesHeader, HeaderLength);
-			memcpy(PacketStart + HeaderLength, packet->data + Position, PacketLength);
-			if (write(fd, PacketStart, PacketLength + HeaderLength) < 0)
-				return false;
-
-			Position += PacketLength;
-			pts = INVALID_PTS_VALUE;
-		}
+	if (packet->size > 0) {
+		/* the private data header announces the whole frame, PES
+		 * continuing a large frame go without it */
+		pes.Start(VC1_VIDEO_PES_START_CODE, pts, 0, packet->size);
+		pes.Add(packet->data, packet->size);
 	}
 
-	return true;
+	return pes.Flush();
 }
 
 WriterWMV::WriterWMV()
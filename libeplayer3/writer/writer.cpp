@@ -28,6 +28,7 @@
 
 #include "pes.h"
 #include "writer.h"
+#include "coalescer.h"
 
 // This does suck ... the original idea was to just link the object files and let them register themselves.
 // Alas, that didn't work as expected.
@@ -59,6 +60,13 @@ void Writer::Register(Writer *w, enum AVCodecID id, audio_encoding_t encoding)
 	aencoding[id] = encoding;
 }
 
+ssize_t Writer::WriteV(const struct iovec *iov, int iovcnt)
+{
+	if (buffer)
+		return buffer->Write(fd, iov, iovcnt);
+	return writev(fd, iov, iovcnt);
+}
+
 bool Writer::Write(AVPacket * /* packet */, int64_t /* pts */)
 {
 	return false;
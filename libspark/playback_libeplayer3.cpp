@@ -425,6 +425,12 @@ uint64_t cPlayback::GetReadCount() {
 	return player->readCount;
 }
 
+bool cPlayback::GetStatistics(playback_stats_t &stats)
+{
+	player->GetStatistics(stats);
+	return true;
+}
+
 int cPlayback::GetAPid(void)
 {
 	lt_info("%s\n", __func__);
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <playback_stats.h>
 
 typedef enum {
 	PLAYMODE_TS = 0,
@@ -62,6 +63,7 @@ class cPlayback
 		void RequestAbort(void);
 		bool IsPlaying(void);
 		uint64_t GetReadCount(void);
+		bool GetStatistics(playback_stats_t &stats);
 		void FindAllSubs(uint16_t *pids, unsigned short *supported, uint16_t *numpida, std::string *language);
 		bool SelectSubtitles(int pid);
 		void GetTitles(std::vector<int> &playlists, std::vector<std::string> &titles, int &current);
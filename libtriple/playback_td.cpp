@@ -447,6 +447,12 @@ bool cPlayback::GetSpeed(int &speed) const
 	return true;
 }
 
+/* no statistics from this player */
+bool cPlayback::GetStatistics(playback_stats_t &/*stats*/)
+{
+	return false;
+}
+
 // in milliseconds
 bool cPlayback::GetPosition(int &position, int &duration)
 {
@@ -5,6 +5,7 @@
 #include <string>
 #include <map>
 #include <vector>
+#include "../include/playback_stats.h"
 
 /* almost 256kB */
 #define INBUF_SIZE (1394 * 188)
@@ -107,6 +108,7 @@ class cPlayback
 		bool SetSpeed(int speed);
 		bool GetSpeed(int &speed) const;
 		bool GetPosition(int &position, int &duration);	/* pos: current time in ms, dur: file length in ms */
+		bool GetStatistics(playback_stats_t &stats);
 		bool SetPosition(int position, bool absolute = false);	/* position: jump in ms */
 		void FindAllPids(uint16_t *apids, unsigned short *ac3flags, uint16_t *numpida, std::string *language);
 		void FindAllSubs(uint16_t *pids, unsigned short *supported, uint16_t *numpida, std::string *language);